@@ -13,6 +13,7 @@
 #include "SYCL/handler.h"
 #include "SYCL/info.h"
 #include "SYCL/kernel.h"
+#include "SYCL/kernel_archive.h"
 #include "SYCL/platform.h"
 #include "SYCL/program.h"
 #include "SYCL/queue.h"
@@ -100,6 +100,24 @@ static debug& operator<<(debug& d, target t) {
 
 }  // namespace access
 
+/**
+ * Not part of the SYCL specification.
+ * Box of buffer elements a device accessor transfers between host and device.
+ * Dimension 0 is the fastest, the pitches are the number of elements in one row
+ * and one slice of the buffer.
+ * All zeros stands for the whole buffer.
+ */
+struct buffer_region {
+  ::size_t origin[3];
+  ::size_t size[3];
+  ::size_t row_pitch;
+  ::size_t slice_pitch;
+
+  bool is_whole() const {
+    return size[0] == 0;
+  }
+};
+
 namespace detail {
 
 // Forward declaration
@@ -109,6 +127,7 @@ struct buffer_access {
   buffer_base* data;
   access::mode mode;
   access::target target;
+  buffer_region region;
 };
 
 }  // namespace detail
@@ -5,6 +5,7 @@
 #include "SYCL/accessor.h"
 #include "SYCL/accessors/buffer_device.h"
 #include "SYCL/accessors/buffer_host.h"
+#include "SYCL/accessors/buffer_image.h"
 #include "SYCL/ranges.h"
 
 namespace cl {
@@ -76,6 +77,9 @@ SYCL_ADD_ACC_BUFFERS(access::mode::discard_read_write)
 /** Can only be read */
 SYCL_ADD_ACCESSOR_BUFFER(access::mode::read, access::target::constant_buffer)
 
+/** Not part of the SYCL specification, read-only image view of the buffer */
+SYCL_ADD_ACCESSOR_BUFFER(access::mode::read, access::target::image)
+
 }  // namespace sycl
 }  // namespace cl
 
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "SYCL/access.h"
+#include "SYCL/accessor.h"
+#include "SYCL/accessors/buffer_base.h"
+#include "SYCL/accessors/device_reference.h"
+#include "SYCL/detail/common.h"
+#include "SYCL/detail/data_ref.h"
+#include "SYCL/detail/image_element.h"
+#include "SYCL/detail/src_handlers/register_resource.h"
+#include "SYCL/ranges/id.h"
+
+namespace cl {
+namespace sycl {
+namespace detail {
+
+/**
+ * Not part of the SYCL specification.
+ * Read-only device accessor that loads through an image1d_buffer_t view of
+ * the buffer instead of a __global pointer. The view shares the memory of the
+ * buffer, so nothing is copied, but the loads go through the texture cache of
+ * devices that have one.
+ */
+SYCL_ACCESSOR_CLASS(target == access::target::image)
+, public accessor_buffer<DataType, dimensions> {
+ private:
+  static_assert(dimensions == 1,
+                "Image views are only supported for 1D buffers");
+
+  using return_t = typename acc_device_return<DataType>::type;
+  using base_acc_buffer = accessor_buffer<DataType, dimensions>;
+
+  template <class T>
+  return_t load(const T& index) const {
+    auto resource_name = kernel_ns::register_resource(*this);
+    return return_t(image_element<DataType>::get(resource_name,
+                                                  data_ref::get_name(index)));
+  }
+
+ public:
+  accessor_detail(cl::sycl::buffer<DataType, dimensions> & bufferRef,
+                  handler & commandGroupHandler, range<dimensions> offset,
+                  range<dimensions> range)
+      : base_acc_buffer(bufferRef, &commandGroupHandler, offset, range) {}
+
+  accessor_detail(cl::sycl::buffer<DataType, dimensions> & bufferRef,
+                  handler & commandGroupHandler)
+      : accessor_detail(bufferRef, commandGroupHandler,
+                        detail::empty_range<dimensions>(),
+                        bufferRef.get_range()) {}
+
+  cl_mem get_cl_mem_object() const final {
+    return base_acc_buffer::get_buffer_object();
+  }
+
+  return_t operator[](id<dimensions> index) const {
+    return load(index);
+  }
+  return_t operator[](const data_ref& index) const {
+    return load(index);
+  }
+  return_t operator[](const ::size_t& index) const {
+    return load(index);
+  }
+
+ protected:
+  void* resource() const final {
+    return base_acc_buffer::buf;
+  }
+
+  ::size_t argument_size() const final {
+    return sizeof(cl_mem);
+  }
+};
+
+}  // namespace detail
+}  // namespace sycl
+}  // namespace cl
@@ -7,6 +7,7 @@
 #include "SYCL/command_group.h"
 #include "SYCL/detail/common.h"
 #include "SYCL/detail/debug.h"
+#include "SYCL/detail/image_element.h"
 #include "SYCL/detail/synchronizer.h"
 #include "SYCL/error_handler.h"
 #include "SYCL/event.h"
@@ -187,6 +188,8 @@ class buffer_detail : public buffer_base {
   buffer_detail& operator=(buffer_detail&&) = default;  // NOLINT
 
   ~buffer_detail() {
+    // Pending command groups may still use the buffer
+    detail::synchronizer::flush_queues();
     event::wait_and_throw(events);
   }
 
@@ -226,6 +229,22 @@ class buffer_detail : public buffer_base {
     buffer->device_data.release_one();
   }
 
+  cl_mem image_view(cl_context ctx) final {
+    if (image_data.get() == nullptr) {
+      const cl_image_format format = image_element<DataType_t>::format();
+      cl_image_desc desc = {};
+      desc.image_type = CL_MEM_OBJECT_IMAGE1D_BUFFER;
+      desc.image_width = get_count();
+      desc.buffer = device_data.get();
+      ::cl_int error_code;
+      image_data = clCreateImage(ctx, CL_MEM_READ_ONLY, &format, &desc,
+                                 nullptr, &error_code);
+      detail::error::report(error_code);
+      image_data.release_one();
+    }
+    return image_data.get();
+  }
+
   void init() {
     if (!is_initialized) {
       command::group_detail::add_buffer_init(create, __func__, this);
@@ -243,14 +262,15 @@ class buffer_detail : public buffer_base {
   using acc_return_t = accessor<DataType_t, dimensions, mode, target>;
 
   template <access::mode mode, access::target target>
-  acc_return_t<mode, target> get_access_device(handler& cgh) {
+  acc_return_t<mode, target> get_access_device(handler& cgh,
+                                               buffer_region region = {}) {
     command::group_detail::check_scope();
     if (mode != access::mode::read) {
       check_read_only();
     }
     init();
-    command::group_detail::add_buffer_access(buffer_access{this, mode, target},
-                                             __func__);
+    command::group_detail::add_buffer_access(
+        buffer_access{this, mode, target, region}, __func__);
     return acc_return_t<mode, target>(
         *(static_cast<cl::sycl::buffer<DataType_t, dimensions>*>(this)), cgh);
   }
@@ -271,6 +291,18 @@ class buffer_detail : public buffer_base {
     return get_access_device<mode, target>(cgh);
   }
 
+  /**
+   * Not part of the SYCL specification.
+   * Device accessor that only transfers the region between host and device.
+   * The kernel may only use the elements inside of it.
+   */
+  template <access::mode mode,
+            access::target target = access::target::global_buffer>
+  accessor<DataType_t, dimensions, mode, target> get_access(
+      handler& cgh, const buffer_region& region) {
+    return get_access_device<mode, target>(cgh, region);
+  }
+
   template <access::mode mode, access::target target>
   accessor<DataType_t, dimensions, mode, target> get_access() {
     return get_access_host<mode, target>();
@@ -279,12 +311,14 @@ class buffer_detail : public buffer_base {
  private:
   // TODO(progtx):
   void enqueue(queue* q, const vector_class<cl_event>& wait_events,
-               clEnqueueBuffer_f clEnqueueBuffer) final {
+               clEnqueueBuffer_f clEnqueueBuffer,
+               const buffer_region& region) final {
     cl_event evnt;
     auto error_code = this->cl_enqueue_buffer(
-        q, get_size(), host_data.get(), wait_events, evnt, clEnqueueBuffer);
+        q, get_size(), data_size<DataType_t>::get(), host_data.get(),
+        wait_events, evnt, clEnqueueBuffer, region);
     detail::error::report(error_code);
-    events.emplace_back(evnt);
+    add_event(evnt);
   }
 
  protected:
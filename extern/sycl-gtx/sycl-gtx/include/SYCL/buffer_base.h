@@ -1,5 +1,6 @@
 #pragma once
 
+#include "SYCL/access.h"
 #include "SYCL/detail/common.h"
 #include "SYCL/detail/debug.h"
 #include "SYCL/event.h"
@@ -14,6 +15,7 @@ namespace detail {
 
 // Forward declarations
 class issue_command;
+class synchronizer;
 namespace command {
 class group_detail;
 }
@@ -26,26 +28,49 @@ class buffer_base {
   friend class issue_command;
   friend class ::cl::sycl::queue;
   friend class command::group_detail;
+  friend class synchronizer;
 
   detail::refc<cl_mem, clRetainMemObject, clReleaseMemObject> device_data;
+  // image1d_buffer_t view of device_data, created on first use
+  detail::refc<cl_mem, clRetainMemObject, clReleaseMemObject> image_data;
+  // Transfers of this buffer that may still be running
   vector_class<event> events;
 
   void create_accessor_command();
 
+  void add_event(cl_event evnt);
+  /** Drops the completed events, returns true if none are left */
+  bool prune_events();
+  /** Blocks until all transfers of this buffer have completed */
+  void wait_for_events();
+
   using clEnqueueBuffer_f = decltype(&clEnqueueWriteBuffer);
   virtual void enqueue(queue* q, const vector_class<cl_event>& wait_events,
-                       clEnqueueBuffer_f clEnqueueBuffer) {
+                       clEnqueueBuffer_f clEnqueueBuffer,
+                       const buffer_region& region) {
+    DSELF() << "not implemented";
+  }
+  /** Image view of the device memory for image accessors */
+  virtual cl_mem image_view(cl_context ctx) {
     DSELF() << "not implemented";
+    return nullptr;
   }
   static void enqueue_command(queue* q,
                               const vector_class<cl_event>& wait_events,
                               buffer_base* buffer,
-                              clEnqueueBuffer_f clEnqueueBuffer) {
-    buffer->enqueue(q, wait_events, clEnqueueBuffer);
+                              clEnqueueBuffer_f clEnqueueBuffer,
+                              buffer_region region) {
+    buffer->enqueue(q, wait_events, clEnqueueBuffer, region);
   }
-  ::cl_int cl_enqueue_buffer(queue* q, ::size_t size, void* host_ptr,
+  /**
+   * Transfers the region of the buffer, as one range if it is contiguous and
+   * with the rectangular variant of the transfer otherwise
+   */
+  ::cl_int cl_enqueue_buffer(queue* q, ::size_t size, ::size_t element_size,
+                             void* host_ptr,
                              const vector_class<cl_event>& wait_events,
-                             cl_event& evnt, clEnqueueBuffer_f clEnqueueBuffer);
+                             cl_event& evnt, clEnqueueBuffer_f clEnqueueBuffer,
+                             const buffer_region& region);
 
   static cl_mem cl_create_buffer(queue* q, const cl_mem_flags& flags,
                                  ::size_t size, void* host_ptr,
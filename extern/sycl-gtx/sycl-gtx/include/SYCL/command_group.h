@@ -6,6 +6,7 @@
 #include "SYCL/buffer_base.h"
 #include "SYCL/detail/common.h"
 #include "SYCL/detail/debug.h"
+#include "SYCL/detail/profile.h"
 #include "SYCL/ranges.h"
 #include <set>
 
@@ -76,6 +77,11 @@ struct info {
   type_t type;
   metadata data;
 
+  // Only set for 1D elementwise kernels, which can be fused
+  shared_ptr_class<kernel> kern;
+  event* evnt;
+  ::size_t global_size;
+
   static void do_nothing(queue* q, const vector_class<cl_event>&) {}
 };
 
@@ -102,6 +108,7 @@ class command_group {
 
   void enter();
   void exit();
+  void fuse_kernels();
 
  public:
   command_group(queue* q) : q(q) {}
@@ -121,6 +128,7 @@ class command_group {
    */
   template <typename functorT>
   command_group(queue& primaryQueue, functorT lambda) : q(&primaryQueue) {
+    SYCL_GTX_PROFILE_SCOPE(command_group);
     enter();
     auto cgh = get_handler(q);
     lambda(*cgh);
@@ -140,6 +148,13 @@ class command_group {
   template <typename functorT>
   command_group(queue& primaryQueue, queue& secondaryQueue, functorT lambda);
 
+  /** A single elementwise kernel, worth waiting for the next group */
+  bool is_elementwise() const;
+  /** The kernels of both groups can run as one */
+  bool can_fuse(const command_group& next) const;
+  /** Moves the commands of the next group to the end of this one */
+  void append(command_group& next);
+
   void optimize();
   void flush(vector_class<cl_event> wait_events);
 };
@@ -159,6 +174,10 @@ class group_detail {
   template <class... Args>
   using kern_fn = fn<shared_ptr_class<kernel>, event*, Args...>;
 
+  /** Remembers the last kernel command for fusion if it is elementwise */
+  static void mark_elementwise(shared_ptr_class<kernel> kern, event* evnt,
+                               ::size_t global_size);
+
   template <type_t type = type_t::unspecified, class F, class... Args>
   static void add_command(F function, string_class name, Args... params) {
     last->commands.push_back({name,
@@ -171,7 +190,7 @@ class group_detail {
   static void add_kernel_enqueue_task(kern_fn<> function, string_class name,
                                       shared_ptr_class<kernel> kern,
                                       event* evnt) {
-    add_command(function, name, kern, evnt);
+    add_command<type_t::kernel>(function, name, kern, evnt);
   }
 
   template <int dimensions>
@@ -179,7 +198,11 @@ class group_detail {
       kern_fn<range<dimensions>, id<dimensions>> function, string_class name,
       shared_ptr_class<kernel> kern, event* evnt,
       range<dimensions> num_work_items, id<dimensions> offset) {
-    add_command(function, name, kern, evnt, num_work_items, offset);
+    add_command<type_t::kernel>(function, name, kern, evnt, num_work_items,
+                                offset);
+    if (dimensions == 1 && static_cast<::size_t&>(offset[0]) == 0) {
+      mark_elementwise(kern, evnt, num_work_items[0]);
+    }
   }
 
   template <int dimensions>
@@ -187,7 +210,7 @@ class group_detail {
       kern_fn<nd_range<dimensions>> function, string_class name,
       shared_ptr_class<kernel> kern, event* evnt,
       nd_range<dimensions> execution_range) {
-    add_command(function, name, kern, evnt, execution_range);
+    add_command<type_t::kernel>(function, name, kern, evnt, execution_range);
   }
 
   template <typename DataType, int dimensions>
@@ -199,9 +222,18 @@ class group_detail {
 
   static void add_buffer_access(buffer_access buf_acc, string_class name);
 
+  /** Accessors requested so far in the current command group, in order */
+  static vector_class<buffer_access> accessors();
+
+  /**
+   * Region of the buffer the current command group transfers,
+   * the whole buffer unless all its accessors asked for the same region
+   */
+  static buffer_region transfer_region(buffer_base* buffer);
+
   static void add_buffer_copy(
       buffer_access buf_acc, access::mode copy_mode,
-      fn<buffer_base*, buffer_base::clEnqueueBuffer_f> function,
+      fn<buffer_base*, buffer_base::clEnqueueBuffer_f, buffer_region> function,
       string_class name, buffer_base* buffer,
       buffer_base::clEnqueueBuffer_f enqueue_function);
 
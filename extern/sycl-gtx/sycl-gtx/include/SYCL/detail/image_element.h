@@ -0,0 +1,47 @@
+#pragma once
+
+#include "SYCL/detail/common.h"
+
+namespace cl {
+namespace sycl {
+namespace detail {
+
+/**
+ * Not part of the SYCL specification.
+ * Pixel format of an image view of a buffer and the sampler-free load of one
+ * element in the kernel. There is no image format for 64 bit types, they are
+ * stored in two 32 bit channels and reinterpreted after the load.
+ */
+template <typename DataType>
+struct image_element;
+
+#define SYCL_ADD_IMAGE_ELEMENT(type, order, load, channels, cast)            \
+  template <>                                                                \
+  struct image_element<type> {                                              \
+    static cl_image_format format() {                                        \
+      return {order, load##_channel};                                        \
+    }                                                                        \
+    static string_class get(const string_class& image,                       \
+                            const string_class& index) {                     \
+      return string_class(cast "(" #load "(") + image + ", (int)(" + index + \
+             "))." channels ")";                                             \
+    }                                                                        \
+  };
+
+static const cl_channel_type read_imagef_channel = CL_FLOAT;
+static const cl_channel_type read_imagei_channel = CL_SIGNED_INT32;
+static const cl_channel_type read_imageui_channel = CL_UNSIGNED_INT32;
+
+SYCL_ADD_IMAGE_ELEMENT(float, CL_R, read_imagef, "x", "")
+SYCL_ADD_IMAGE_ELEMENT(int, CL_R, read_imagei, "x", "")
+SYCL_ADD_IMAGE_ELEMENT(unsigned int, CL_R, read_imageui, "x", "")
+SYCL_ADD_IMAGE_ELEMENT(double, CL_RG, read_imageui, "xy", "as_double")
+SYCL_ADD_IMAGE_ELEMENT(long long, CL_RG, read_imageui, "xy", "as_long")
+SYCL_ADD_IMAGE_ELEMENT(unsigned long long, CL_RG, read_imageui, "xy",
+                       "as_ulong")
+
+#undef SYCL_ADD_IMAGE_ELEMENT
+
+}  // namespace detail
+}  // namespace sycl
+}  // namespace cl
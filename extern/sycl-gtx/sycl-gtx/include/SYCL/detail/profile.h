@@ -0,0 +1,81 @@
+#pragma once
+
+// Host overhead per stage of a submission, only collected if sycl-gtx and the
+// application are compiled with SYCL_GTX_PROFILE
+
+#include "SYCL/detail/common.h"
+#include <chrono>
+#include <cstdint>
+
+namespace cl {
+namespace sycl {
+namespace detail {
+
+class profile {
+ public:
+  enum stage {
+    submit,          // Remaining time of queue::submit
+    create_queue,    // OpenCL queue of the command group
+    command_group,   // Command group functor, without the stages below
+    tracing,         // Kernel functor tracing and source generation
+    cache_lookup,    // Kernel cache and kernel archive lookup
+    compile,         // OpenCL program build
+    synchronizer,    // Checks for host accessors before flushing
+    optimize,        // command_group::optimize
+    transfer,        // Enqueueing buffer copies
+    set_args,        // clSetKernelArg
+    enqueue,         // Enqueueing the kernel
+    flush,           // Remaining time of command_group::flush
+    num_stages
+  };
+
+  struct totals {
+    std::uint64_t nanoseconds[num_stages];
+    std::uint64_t calls[num_stages];
+  };
+
+  static const char* name(stage s);
+  static const totals& get() {
+    return data;
+  }
+  static void reset();
+
+  /**
+   * Adds the time until destruction to the stage.
+   * Nested scopes are not counted in their parent, so stages add up.
+   */
+  class scope {
+   public:
+    explicit scope(stage s);
+    ~scope();
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+   private:
+    using clock = std::chrono::steady_clock;
+
+    stage s;
+    scope* parent;
+    clock::time_point start;
+    std::uint64_t children = 0;
+  };
+
+ private:
+  static totals data;
+  SYCL_THREAD_LOCAL static scope* current;
+};
+
+}  // namespace detail
+}  // namespace sycl
+}  // namespace cl
+
+#define SYCL_GTX_PROFILE_CONCAT_(a, b) a##b
+#define SYCL_GTX_PROFILE_CONCAT(a, b) SYCL_GTX_PROFILE_CONCAT_(a, b)
+
+#ifdef SYCL_GTX_PROFILE
+#define SYCL_GTX_PROFILE_SCOPE(stage)                         \
+  ::cl::sycl::detail::profile::scope SYCL_GTX_PROFILE_CONCAT( \
+      profile_scope_, __LINE__)(::cl::sycl::detail::profile::stage)
+#else
+#define SYCL_GTX_PROFILE_SCOPE(stage)
+#endif
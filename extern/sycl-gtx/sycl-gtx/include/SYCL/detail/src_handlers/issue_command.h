@@ -45,6 +45,18 @@ class issue_command {
   }
 
  public:
+  /**
+   * 1D kernel that only accesses buffers at its own global id,
+   * so it can run in the same work item as other such kernels
+   */
+  static bool is_elementwise(const kernel& kern);
+  /** One kernel running the bodies in order, nullptr if it can't be built */
+  static shared_ptr_class<kernel> fuse(
+      const vector_class<shared_ptr_class<kernel>>& kernels);
+  static command::info::command_f fused_command(shared_ptr_class<kernel> kern,
+                                                event* evnt,
+                                                ::size_t global_size);
+
   static void write_buffers_to_device(shared_ptr_class<kernel> kern);
   static void read_buffers_from_device(shared_ptr_class<kernel> kern);
 
@@ -5,6 +5,7 @@
 #include "SYCL/detail/common.h"
 #include "SYCL/detail/counter.h"
 #include "SYCL/detail/debug.h"
+#include <algorithm>
 #include <map>
 
 namespace cl {
@@ -12,6 +13,7 @@ namespace sycl {
 
 // Forward declarations
 class kernel;
+class kernel_archive;
 class program;
 class queue;
 
@@ -33,6 +35,7 @@ class source : protected counter<source> {
     string_class resource_name;
     string_class type_name;
     ::size_t size;
+    void* resource;
   };
 
   static const string_class resource_name_root;
@@ -42,7 +45,8 @@ class source : protected counter<source> {
 
   string_class kernel_name;
   vector_class<string_class> lines;
-  std::map<void*, buf_info> resources;
+  // Keyed by registration order, which is also the kernel argument order
+  std::map<int, buf_info> resources;
 
   // TODO(progtx): Multithreading support
   SYCL_THREAD_LOCAL static source* scope;
@@ -50,6 +54,7 @@ class source : protected counter<source> {
   template <class Input>
   friend struct constructor;
   friend class ::cl::sycl::detail::issue_command;
+  friend class ::cl::sycl::kernel_archive;
 
   string_class generate_accessor_list() const;
 
@@ -81,15 +86,21 @@ class source : protected counter<source> {
 
     string_class resource_name;
     auto buf = static_cast<buffer<DataType, dimensions>*>(acc.resource());
-    auto it = scope->resources.find(buf);
+    auto it = std::find_if(
+        scope->resources.begin(), scope->resources.end(),
+        [buf](const std::pair<const int, buf_info>& res) {
+          // An image view is a separate argument
+          return res.second.resource == buf && res.second.acc.target == target;
+        });
 
     if (it == scope->resources.end()) {
       resource_name = resource_name_root +
                       get_string<decltype(num_resources)>::get(++num_resources);
-      scope->resources[buf] = {{buf, mode, target},
-                               resource_name,
-                               type_string<DataType>::get() + '*',
-                               acc.argument_size()};
+      scope->resources[num_resources] = {{buf, mode, target},
+                                         resource_name,
+                                         type_name<DataType>(target),
+                                         acc.argument_size(),
+                                         buf};
     } else {
       resource_name = it->second.resource_name;
     }
@@ -112,6 +123,14 @@ class source : protected counter<source> {
   }
 
   static string_class get_name(access::target target);
+
+  template <typename DataType>
+  static string_class type_name(access::target target) {
+    if (target == access::target::image) {
+      return "image1d_buffer_t";
+    }
+    return type_string<DataType>::get() + '*';
+  }
 };
 
 template <typename DataType, int dimensions, access::mode mode,
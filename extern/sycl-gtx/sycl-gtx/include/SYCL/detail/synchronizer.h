@@ -21,10 +21,11 @@ class synchronizer {
   static std::set<queue*> queues;
   static std::map<accessor_base*, buffer_base*> host_accessors;
 
-  static void wait_on_queues(buffer_base* buf);
-  static void flush_queues(buffer_base* buf);
+  static void wait_on_events(buffer_base* buf);
 
  public:
+  /** Also flushes command groups held back for kernel fusion */
+  static void flush_queues();
   static void add(queue* q);
   static void remove(queue* q);
   static void add(accessor_base* acc, buffer_base* buf);
@@ -5,8 +5,10 @@
 #include "SYCL/access.h"
 #include "SYCL/detail/common.h"
 #include "SYCL/detail/function_traits.h"
+#include "SYCL/detail/profile.h"
 #include "SYCL/detail/src_handlers/issue_command.h"
 #include "SYCL/handler_event.h"
+#include "SYCL/kernel_archive.h"
 #include "SYCL/program.h"
 #include "SYCL/ranges.h"
 #include "../../../../src/Timer.h"
@@ -40,19 +42,50 @@ class handler {
 
   static context get_context(queue* q);
 
-  template <class KernelType>
-  shared_ptr_class<kernel> build(KernelType kernFunctor) {
+  template <class KernelName, class KernelType>
+  shared_ptr_class<kernel> build(KernelType kernFunctor,
+                                 const ::size_t* global_size = nullptr,
+                                 int dimensions = 0) {
     detail::command::group_detail::check_scope();
 
-    auto src = detail::kernel_ns::constructor<
-        typename detail::first_arg<KernelType>::type>::get(kernFunctor);
+    if (kernel_archive::is_loaded()) {
+      // Archived kernels don't need to be traced
+      SYCL_GTX_PROFILE_SCOPE(cache_lookup);
+      auto kern = kernel_archive::instantiate(
+          get_context(q),
+          kernel_archive::key<KernelName>(global_size, dimensions));
+      if (kern) {
+        return kern;
+      }
+    }
 
-    string_class kernel_body = "";
-    for (auto& line : src.get_lines()) {
-      kernel_body += line;
+    auto kern = build_traced(kernFunctor);
+    if (kernel_archive::is_recording()) {
+      kernel_archive::add(
+          kernel_archive::key<KernelName>(global_size, dimensions), *kern);
     }
+    return kern;
+  }
 
-    auto cacheItr = kernel_cache.find(kernel_body);
+  template <class KernelType>
+  shared_ptr_class<kernel> build_traced(KernelType kernFunctor) {
+    string_class kernel_body = "";
+    auto src = [&]() -> detail::kernel_ns::source {
+      SYCL_GTX_PROFILE_SCOPE(tracing);
+      auto traced = detail::kernel_ns::constructor<
+          typename detail::first_arg<KernelType>::type>::get(kernFunctor);
+
+      for (auto& line : traced.get_lines()) {
+        kernel_body += line;
+      }
+      return traced;
+    }();
+
+    decltype(kernel_cache)::iterator cacheItr;
+    {
+      SYCL_GTX_PROFILE_SCOPE(cache_lookup);
+      cacheItr = kernel_cache.find(kernel_body);
+    }
     if (cacheItr != kernel_cache.end()) {
         // Found kernel in cache
       auto kern = std::make_shared<kernel>(this->get_context(this->q));
@@ -63,7 +96,10 @@ class handler {
 
     Timer::push("compile");
     program prog(get_context(q));
-    prog.build(kernFunctor, "");
+    {
+      SYCL_GTX_PROFILE_SCOPE(compile);
+      prog.build(kernFunctor, "");
+    }
     Timer::pop("compile");
 
     cl_kernel final_kernel = prog.kernels.begin()->second->get();
@@ -90,7 +126,7 @@ class handler {
   void parallel_for_range(range<dimensions> numWorkItems,
                           id<dimensions> workItemOffset,
                           KernelType kernFunctor) {
-    auto kern = build(kernFunctor);
+    auto kern = build<KernelName>(kernFunctor, &numWorkItems[0], dimensions);
     issue_enqueue(kern, &issue::enqueue_range, numWorkItems, workItemOffset);
   }
   // TODO(progtx): Why is the offset needed? It's already contained in the
@@ -99,7 +135,8 @@ class handler {
   void parallel_for_nd_range(nd_range<dimensions> executionRange,
                              id<dimensions> workItemOffset,
                              KernelType kernFunctor) {
-    auto kern = build(kernFunctor);
+    auto globalSize = executionRange.get_global();
+    auto kern = build<KernelName>(kernFunctor, &globalSize[0], dimensions);
     issue_enqueue(kern, &issue::enqueue_nd_range, executionRange);
   }
 
@@ -116,7 +153,7 @@ class handler {
   /** 3.5.3.1 Single Task invoke */
   template <typename KernelName, class KernelType>
   void single_task(KernelType kernFunctor) {
-    auto kern = build(kernFunctor);
+    auto kern = build<KernelName>(kernFunctor);
     issue_enqueue(kern, &issue::enqueue_task);
   }
 
@@ -5,6 +5,7 @@
 #include "SYCL/context.h"
 #include "SYCL/detail/common.h"
 #include "SYCL/detail/debug.h"
+#include "SYCL/detail/profile.h"
 #include "SYCL/detail/src_handlers/kernel_source.h"
 #include "SYCL/error_handler.h"
 #include "SYCL/info.h"
@@ -22,6 +23,7 @@ class event;
 class queue;
 class program;
 class handler;
+class kernel_archive;
 
 class kernel {
  private:
@@ -29,6 +31,7 @@ class kernel {
   friend class detail::issue_command;
   friend class detail::kernel_ns::source;
   friend class handler;
+  friend class kernel_archive;
 
   detail::refc<cl_kernel, clRetainKernel, clReleaseKernel> kern;
   context ctx;
@@ -100,6 +103,7 @@ class kernel {
   void enqueue_range(queue* q, const vector_class<cl_event>& wait_events,
                      event* evnt, range<dimensions> num_work_items,
                      id<dimensions> offset) const {
+    SYCL_GTX_PROFILE_SCOPE(enqueue);
     ::size_t* global_work_size = &num_work_items[0];
     ::size_t* offst = &static_cast<::size_t&>(offset[0]);
     auto ev = get_cl_event(evnt);
@@ -115,6 +119,7 @@ class kernel {
   void enqueue_nd_range(queue* q, const vector_class<cl_event>& wait_events,
                         event* evnt,
                         nd_range<dimensions> execution_range) const {
+    SYCL_GTX_PROFILE_SCOPE(enqueue);
     ::size_t* local_work_size = &execution_range.get_local()[0];
     ::size_t* offst = &static_cast<::size_t&>(execution_range.get_offset()[0]);
 
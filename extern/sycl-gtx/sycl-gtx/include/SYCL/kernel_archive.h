@@ -0,0 +1,113 @@
+#pragma once
+
+// sycl-gtx extension: kernels generated ahead of time
+
+#include "SYCL/access.h"
+#include "SYCL/context.h"
+#include "SYCL/detail/common.h"
+#include <map>
+#include <typeinfo>
+
+namespace cl {
+namespace sycl {
+
+// Forward declarations
+class handler;
+class kernel;
+
+/**
+ * Stores the OpenCL C code generated from traced kernels in a directory,
+ * so another run can build them by name without tracing the functors.
+ *
+ * Kernels are looked up by the kernel name type, the global range and the
+ * active variant tags. Captured host values are literals in the generated
+ * code, which is why an archive is only valid for the fingerprint it was
+ * recorded with. Keys that produced different code while recording are
+ * dropped and get traced as usual.
+ *
+ * Directory layout: a "manifest" text file and one <id>.cl file per kernel.
+ * An <id>.spv file next to it is preferred if the device accepts SPIR-V.
+ */
+class kernel_archive {
+ public:
+  /** Writes all kernels traced from now on to the directory on save() */
+  static void record(const string_class& directory,
+                     const string_class& fingerprint);
+
+  /**
+   * Loads the manifest from the directory.
+   * @return false if there is none or it was recorded for another fingerprint
+   */
+  static bool load(const string_class& directory,
+                   const string_class& fingerprint);
+
+  /** Writes the manifest and the kernel sources of a recording */
+  static bool save();
+
+  static bool is_recording() {
+    return recording;
+  }
+  static bool is_loaded() {
+    return loaded;
+  }
+
+  /**
+   * Adds a tag to the key of all kernels submitted while it is alive.
+   * Needed when the same kernel is generated from different captured values.
+   */
+  class variant {
+   public:
+    explicit variant(const string_class& tag);
+    ~variant();
+    variant(const variant&) = delete;
+    variant& operator=(const variant&) = delete;
+  };
+
+ private:
+  friend class handler;
+
+  struct argument {
+    ::size_t accessor;  // Index into the accessors of the command group
+    ::size_t size;
+  };
+
+  struct entry {
+    string_class file;
+    string_class function_name;
+    string_class code;
+    vector_class<argument> args;
+    ::size_t num_accessors = 0;
+    bool ambiguous = false;
+    cl_kernel built = nullptr;
+  };
+
+  static bool recording;
+  static bool loaded;
+  static string_class directory;
+  static string_class fingerprint;
+  static std::map<string_class, entry> entries;
+  SYCL_THREAD_LOCAL static vector_class<string_class>* tags;
+
+  template <class KernelName>
+  static string_class key(const ::size_t* global_size, int dimensions) {
+    // Kernel names are usually incomplete types
+    string_class k = typeid(KernelName*).name();
+    for (int i = 0; i < dimensions; ++i) {
+      k += (i == 0 ? '@' : 'x') + std::to_string(global_size[i]);
+    }
+    if (tags != nullptr) {
+      for (auto& tag : *tags) {
+        k += '#' + tag;
+      }
+    }
+    return k;
+  }
+
+  static void add(const string_class& key, const kernel& kern);
+  static shared_ptr_class<kernel> instantiate(const context& ctx,
+                                              const string_class& key);
+  static cl_kernel build(const context& ctx, entry& e);
+};
+
+}  // namespace sycl
+}  // namespace cl
@@ -6,6 +6,7 @@
 #include "SYCL/context.h"
 #include "SYCL/detail/common.h"
 #include "SYCL/detail/debug.h"
+#include "SYCL/detail/profile.h"
 #include "SYCL/detail/synchronizer.h"
 #include "SYCL/device.h"
 #include "SYCL/error_handler.h"
@@ -33,6 +34,8 @@ class queue {
   buffer_set buffers_in_use;
   bool is_flushed = true;
   vector_class<queue> subqueues;
+  // Subqueues before this one are all flushed
+  ::size_t first_unflushed = 0;
 
   void display_device_info() const;
   cl_command_queue create_queue(bool display_info = true,
@@ -104,7 +107,8 @@ class queue {
         SYCL_MOVE_INIT(command_group),
         SYCL_MOVE_INIT(buffers_in_use),
         SYCL_MOVE_INIT(is_flushed),
-        SYCL_MOVE_INIT(subqueues) {
+        SYCL_MOVE_INIT(subqueues),
+        SYCL_MOVE_INIT(first_unflushed) {
     move.command_q = nullptr;
     command_group.q = this;
   }
@@ -122,6 +126,7 @@ class queue {
     SYCL_SWAP(buffers_in_use);
     SYCL_SWAP(is_flushed);
     SYCL_SWAP(subqueues);
+    SYCL_SWAP(first_unflushed);
   }
 
   bool is_host();
@@ -166,8 +171,9 @@ class queue {
   // TODO(progtx):
   template <typename T>
   handler_event submit(T cgf) {
+    SYCL_GTX_PROFILE_SCOPE(submit);
     subqueues.push_back({this, cgf});
-    return subqueues.back().process(buffers_in_use);
+    return process_submitted();
   }
 
   // TODO(progtx):
@@ -179,6 +185,7 @@ class queue {
   void finish();
   void wait_subqueues(bool and_throw);
   handler_event process(buffer_set& buffers_in_use_master);
+  handler_event process_submitted();
   static vector_class<cl_event> get_wait_events(const buffer_set& dependencies,
                                                 buffer_set& buffers_in_use);
 };
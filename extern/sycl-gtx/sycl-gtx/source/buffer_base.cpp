@@ -1,21 +1,57 @@
 #include "SYCL/buffer_base.h"
 
 #include "SYCL/queue.h"
+#include <algorithm>
 
 using namespace cl::sycl;
 using namespace detail;
 
 ::cl_int buffer_base::cl_enqueue_buffer(
-    queue* q, ::size_t size, void* host_ptr,
+    queue* q, ::size_t size, ::size_t element_size, void* host_ptr,
     const vector_class<cl_event>& wait_events, cl_event& evnt,
-    clEnqueueBuffer_f clEnqueueBuffer) {
-  auto num_events_to_wait = wait_events.size();
-
-  return clEnqueueBuffer(
-      q->get(), device_data.get(), false,
-      // TODO(progtx): Sub-buffer access
-      0, size, host_ptr, static_cast<::cl_uint>(num_events_to_wait),
-      (num_events_to_wait == 0 ? nullptr : wait_events.data()), &evnt);
+    clEnqueueBuffer_f clEnqueueBuffer, const buffer_region& region) {
+  SYCL_GTX_PROFILE_SCOPE(transfer);
+  auto num_events_to_wait = static_cast<::cl_uint>(wait_events.size());
+  auto events_ptr = (num_events_to_wait == 0 ? nullptr : wait_events.data());
+
+  if (region.is_whole()) {
+    return clEnqueueBuffer(q->get(), device_data.get(), false, 0, size,
+                           host_ptr, num_events_to_wait, events_ptr, &evnt);
+  }
+
+  // Host and device copy have the same layout
+  const ::size_t row = region.row_pitch * element_size;
+  const ::size_t slice = region.slice_pitch * element_size;
+  const bool whole_rows = region.size[0] == region.row_pitch;
+  const bool whole_slices =
+      whole_rows && region.size[1] * region.row_pitch == region.slice_pitch;
+  const bool contiguous = (region.size[1] == 1 && region.size[2] == 1) ||
+                          (whole_rows && region.size[2] == 1) || whole_slices;
+
+  if (contiguous) {
+    const ::size_t offset = region.origin[0] * element_size +
+                            region.origin[1] * row + region.origin[2] * slice;
+    const ::size_t count =
+        region.size[0] * region.size[1] * region.size[2] * element_size;
+    return clEnqueueBuffer(q->get(), device_data.get(), false, offset, count,
+                           static_cast<char*>(host_ptr) + offset,
+                           num_events_to_wait, events_ptr, &evnt);
+  }
+
+  const ::size_t origin[3] = {region.origin[0] * element_size,
+                              region.origin[1], region.origin[2]};
+  const ::size_t extent[3] = {region.size[0] * element_size, region.size[1],
+                              region.size[2]};
+  if (clEnqueueBuffer == &clEnqueueWriteBuffer) {
+    return clEnqueueWriteBufferRect(q->get(), device_data.get(), false, origin,
+                                    origin, extent, row, slice, row, slice,
+                                    host_ptr, num_events_to_wait, events_ptr,
+                                    &evnt);
+  }
+  return clEnqueueReadBufferRect(q->get(), device_data.get(), false, origin,
+                                 origin, extent, row, slice, row, slice,
+                                 host_ptr, num_events_to_wait, events_ptr,
+                                 &evnt);
 }
 
 cl_mem buffer_base::cl_create_buffer(queue* q, const cl_mem_flags& flags,
@@ -24,3 +60,29 @@ cl_mem buffer_base::cl_create_buffer(queue* q, const cl_mem_flags& flags,
   return clCreateBuffer(q->get_context().get(), flags, size, host_ptr,
                         &error_code);
 }
+
+void buffer_base::add_event(cl_event evnt) {
+  // Keeps the list short, otherwise every later command waits on the whole
+  // history of the buffer
+  prune_events();
+  events.emplace_back(evnt);
+}
+
+bool buffer_base::prune_events() {
+  auto completed = [](event& ev) {
+    ::cl_int status;
+    auto error_code =
+        clGetEventInfo(ev.get(), CL_EVENT_COMMAND_EXECUTION_STATUS,
+                       sizeof(status), &status, nullptr);
+    detail::error::report(error_code);
+    return status == CL_COMPLETE;
+  };
+  events.erase(std::remove_if(events.begin(), events.end(), completed),
+               events.end());
+  return events.empty();
+}
+
+void buffer_base::wait_for_events() {
+  event::wait(events);
+  events.clear();
+}
@@ -2,7 +2,9 @@
 
 #include "SYCL/accessor.h"
 #include "SYCL/buffer.h"
+#include "SYCL/detail/src_handlers/issue_command.h"
 #include "SYCL/queue.h"
+#include <algorithm>
 #include <map>
 #include <unordered_set>
 
@@ -16,9 +18,148 @@ void command_group::exit() {
   detail::command::group_detail::last = nullptr;
 }
 
+static bool same_region(const buffer_region& a, const buffer_region& b) {
+  return std::equal(a.origin, a.origin + 3, b.origin) &&
+         std::equal(a.size, a.size + 3, b.size);
+}
+
+bool command_group::is_elementwise() const {
+  using detail::command::type_t;
+
+  int kernels = 0;
+  for (auto& command : commands) {
+    if (command.type == type_t::kernel) {
+      if (!command.kern) {
+        return false;
+      }
+      ++kernels;
+    }
+  }
+  return kernels == 1;
+}
+
+bool command_group::can_fuse(const command_group& next) const {
+  using detail::command::type_t;
+
+  if (!next.is_elementwise()) {
+    return false;
+  }
+  ::size_t global_size = 0;
+  for (auto& command : next.commands) {
+    if (command.type == type_t::kernel) {
+      global_size = command.global_size;
+    }
+  }
+  for (auto& command : commands) {
+    if (command.type == type_t::kernel &&
+        (!command.kern || command.global_size != global_size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void command_group::append(command_group& next) {
+  for (auto& command : next.commands) {
+    commands.push_back(std::move(command));
+  }
+  next.commands.clear();
+  read_buffers.insert(next.read_buffers.begin(), next.read_buffers.end());
+  write_buffers.insert(next.write_buffers.begin(), next.write_buffers.end());
+}
+
+// Elementwise kernels over the same range run as one kernel,
+// each buffer is uploaded before and downloaded after it only once
+void command_group::fuse_kernels() {
+  using detail::command::type_t;
+
+  vector_class<shared_ptr_class<kernel>> kernels;
+  command_t* first = nullptr;
+  std::map<buffer_base*, buffer_region> regions;
+
+  for (auto& command : commands) {
+    if (command.type == type_t::kernel) {
+      if (!command.kern ||
+          (first != nullptr && command.global_size != first->global_size)) {
+        return;
+      }
+      if (first == nullptr) {
+        first = &command;
+      }
+      kernels.push_back(command.kern);
+    } else if (command.type == type_t::copy_data) {
+      // Dropped transfers have to cover the same part of the buffer
+      auto& buf = command.data.buf_copy.buf;
+      auto it = regions.find(buf.data);
+      if (it == regions.end()) {
+        regions.emplace(buf.data, buf.region);
+      } else if (!same_region(it->second, buf.region)) {
+        return;
+      }
+    }
+  }
+  if (kernels.size() < 2) {
+    return;
+  }
+
+  auto fused = issue_command::fuse(kernels);
+  if (!fused) {
+    return;
+  }
+
+  vector_class<command_t> setup;
+  vector_class<command_t> uploads;
+  vector_class<command_t> downloads;
+  std::map<buffer_base*, ::size_t> download_of;
+  std::set<buffer_base*> on_device;
+
+  auto fused_command = command_t{
+      "fused_kernel",
+      issue_command::fused_command(fused, first->evnt, first->global_size),
+      type_t::kernel};
+
+  for (auto& command : commands) {
+    if (command.type == type_t::copy_data) {
+      // Every kernel using a buffer transfers it one way or the other,
+      // so only the first kernel using the buffer needs its host data
+      auto ptr = command.data.buf_copy.buf.data;
+      auto first_use = on_device.insert(ptr).second;
+      if (command.data.buf_copy.mode == access::mode::write) {
+        if (first_use) {
+          uploads.push_back(std::move(command));
+        }
+      } else {
+        // Only the final values go back
+        auto it = download_of.find(ptr);
+        if (it == download_of.end()) {
+          download_of[ptr] = downloads.size();
+          downloads.push_back(std::move(command));
+        } else {
+          downloads[it->second] = std::move(command);
+        }
+      }
+    } else if (command.type != type_t::kernel) {
+      // Accessors and buffer creation
+      setup.push_back(std::move(command));
+    }
+  }
+
+  commands = std::move(setup);
+  for (auto& command : uploads) {
+    commands.push_back(std::move(command));
+  }
+  commands.push_back(std::move(fused_command));
+  for (auto& command : downloads) {
+    commands.push_back(std::move(command));
+  }
+}
+
 // TODO(progtx): Reschedules commands to achieve better performance
 void command_group::optimize() {
   DSELF();
+  SYCL_GTX_PROFILE_SCOPE(optimize);
+
+  fuse_kernels();
 
   auto size_to_keep = commands.size();
   std::map<command_t*, bool> keep;
@@ -90,6 +231,7 @@ void command_group::optimize() {
 /** Executes all commands in queue and removes them */
 void command_group::flush(vector_class<cl_event> wait_events) {
   DSELF() << q << q->get();
+  SYCL_GTX_PROFILE_SCOPE(flush);
 
   using detail::command::type_t;
 
@@ -128,6 +270,17 @@ void command::group_detail::check_scope() {
   }
 }
 
+void command::group_detail::mark_elementwise(shared_ptr_class<kernel> kern,
+                                             event* evnt,
+                                             ::size_t global_size) {
+  if (issue_command::is_elementwise(*kern)) {
+    auto& command = last->commands.back();
+    command.kern = kern;
+    command.evnt = evnt;
+    command.global_size = global_size;
+  }
+}
+
 void command::group_detail::add_buffer_access(buffer_access buf_acc,
                                               string_class name) {
   last->commands.push_back({name,
@@ -136,7 +289,8 @@ void command::group_detail::add_buffer_access(buffer_access buf_acc,
                             type_t::get_accessor, metadata(buf_acc)});
 
   // TODO(progtx): Maybe other targets
-  if (buf_acc.target == access::target::global_buffer) {
+  if (buf_acc.target == access::target::global_buffer ||
+      buf_acc.target == access::target::image) {
     if (buf_acc.mode != access::mode::discard_write &&
         buf_acc.mode != access::mode::discard_read_write) {
       last->read_buffers.insert(buf_acc.data);
@@ -147,14 +301,47 @@ void command::group_detail::add_buffer_access(buffer_access buf_acc,
   }
 }
 
+vector_class<buffer_access> command::group_detail::accessors() {
+  vector_class<buffer_access> list;
+  for (auto& command : last->commands) {
+    if (command.type == type_t::get_accessor) {
+      list.push_back(command.data.buf_acc);
+    }
+  }
+  return list;
+}
+
+buffer_region command::group_detail::transfer_region(buffer_base* buffer) {
+  bool found = false;
+  buffer_region region = {};
+  for (auto& command : last->commands) {
+    if (command.type != type_t::get_accessor ||
+        command.data.buf_acc.data != buffer) {
+      continue;
+    }
+    auto& other = command.data.buf_acc.region;
+    if (other.is_whole()) {
+      return {};
+    }
+    if (found &&
+        (!std::equal(region.origin, region.origin + 3, other.origin) ||
+         !std::equal(region.size, region.size + 3, other.size))) {
+      return {};
+    }
+    region = other;
+    found = true;
+  }
+  return region;
+}
+
 void command::group_detail::add_buffer_copy(
     buffer_access buf_acc, access::mode copy_mode,
-    fn<buffer_base*, buffer_base::clEnqueueBuffer_f> function,
+    fn<buffer_base*, buffer_base::clEnqueueBuffer_f, buffer_region> function,
     string_class name, buffer_base* buffer,
     buffer_base::clEnqueueBuffer_f enqueue_function) {
   last->commands.push_back(
       {name,
        std::bind(function, std::placeholders::_1, std::placeholders::_2, buffer,
-                 enqueue_function),
+                 enqueue_function, buf_acc.region),
        type_t::copy_data, metadata(buffer_copy{buf_acc, copy_mode})});
 }
@@ -0,0 +1,35 @@
+#include "SYCL/detail/profile.h"
+
+using namespace cl::sycl::detail;
+
+profile::totals profile::data = {};
+SYCL_THREAD_LOCAL profile::scope* profile::current = nullptr;
+
+const char* profile::name(stage s) {
+  static const char* names[num_stages] = {
+      "submit",       "create_queue", "command_group", "tracing",
+      "cache_lookup", "compile",      "synchronizer",  "optimize",
+      "transfer",     "set_args",     "enqueue",       "flush"};
+  return names[s];
+}
+
+void profile::reset() {
+  data = {};
+}
+
+profile::scope::scope(stage s)
+    : s(s), parent(current), start(clock::now()) {
+  current = this;
+}
+
+profile::scope::~scope() {
+  auto elapsed = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start)
+          .count());
+  data.nanoseconds[s] += elapsed > children ? elapsed - children : 0;
+  ++data.calls[s];
+  if (parent != nullptr) {
+    parent->children += elapsed;
+  }
+  current = parent;
+}
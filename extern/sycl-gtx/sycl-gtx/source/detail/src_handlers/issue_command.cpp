@@ -3,6 +3,9 @@
 #include "SYCL/accessors/buffer.h"
 #include "SYCL/buffer.h"
 #include "SYCL/kernel.h"
+#include <cctype>
+#include <map>
+#include <unordered_map>
 
 using namespace cl::sycl;
 using detail::issue_command;
@@ -16,12 +19,16 @@ void issue_command::compile_command(queue* q,
 
 void issue_command::prepare_kernel(shared_ptr_class<kernel> kern) {
   DSELF() << kern->src.kernel_name;
+  SYCL_GTX_PROFILE_SCOPE(set_args);
   auto k = kern->get();
   ::cl_int error_code;
   int i = 0;
   for (auto& acc : kern->src.resources) {
     if (acc.second.acc.target == access::target::local) {
       error_code = clSetKernelArg(k, i, acc.second.size, nullptr);
+    } else if (acc.second.acc.target == access::target::image) {
+      auto mem = acc.second.acc.data->image_view(kern->get_context().get());
+      error_code = clSetKernelArg(k, i, acc.second.size, &mem);
     } else {
       auto mem = acc.second.acc.data->device_data.get();
       error_code = clSetKernelArg(k, i, acc.second.size, &mem);
@@ -31,6 +38,149 @@ void issue_command::prepare_kernel(shared_ptr_class<kernel> kern) {
   }
 }
 
+static const string_class global_id = "_sycl_gid";
+
+bool issue_command::is_elementwise(const kernel& kern) {
+  auto& src = kern.src;
+  if (src.lines.empty()) {
+    // Archived kernels come without source
+    return false;
+  }
+  for (auto& res : src.resources) {
+    if (res.second.acc.target != access::target::global_buffer ||
+        res.second.resource_name.empty()) {
+      return false;
+    }
+  }
+
+  auto& root = source::resource_name_root;
+  for (auto& line : src.lines) {
+    if (line.find("barrier(") != string_class::npos) {
+      return false;
+    }
+    auto pos = line.find(root);
+    while (pos != string_class::npos) {
+      pos += root.size();
+      while (pos < line.size() && std::isdigit(line[pos])) {
+        ++pos;
+      }
+      auto index_end = line.find(']', pos);
+      if (index_end == string_class::npos || line[pos] != '[') {
+        return false;
+      }
+      auto index = line.substr(pos + 1, index_end - pos - 1);
+      if (index != global_id && index != global_id + '0') {
+        return false;
+      }
+      pos = line.find(root, index_end);
+    }
+  }
+  return true;
+}
+
+// Replaces whole resource names, _sycl_buf1 is a prefix of _sycl_buf12
+static string_class rename_resources(
+    const string_class& line, const string_class& root,
+    const std::map<string_class, string_class>& names) {
+  string_class renamed;
+  ::size_t done = 0;
+  auto pos = line.find(root);
+  while (pos != string_class::npos) {
+    auto end = pos + root.size();
+    while (end < line.size() && std::isdigit(line[end])) {
+      ++end;
+    }
+    auto it = names.find(line.substr(pos, end - pos));
+    renamed += line.substr(done, pos - done);
+    renamed += (it == names.end()) ? line.substr(pos, end - pos) : it->second;
+    done = end;
+    pos = line.find(root, end);
+  }
+  return renamed + line.substr(done);
+}
+
+static cl_kernel build_fused(const context& ctx, const string_class& code,
+                             const string_class& name) {
+  auto devices = ctx.get_devices();
+  auto device_pointers = detail::get_cl_array(devices);
+  const char* code_p = code.c_str();
+  ::size_t length = code.size();
+  ::cl_int error_code;
+
+  auto p = clCreateProgramWithSource(ctx.get(), 1, &code_p, &length,
+                                     &error_code);
+  if (error_code != CL_SUCCESS) {
+    return nullptr;
+  }
+  error_code = clBuildProgram(p, static_cast<::cl_uint>(devices.size()),
+                              device_pointers.data(), "", nullptr, nullptr);
+  cl_kernel k = nullptr;
+  if (error_code == CL_SUCCESS) {
+    k = clCreateKernel(p, name.c_str(), &error_code);
+  }
+  clReleaseProgram(p);
+  return (error_code == CL_SUCCESS) ? k : nullptr;
+}
+
+shared_ptr_class<kernel> issue_command::fuse(
+    const vector_class<shared_ptr_class<kernel>>& kernels) {
+  SYCL_GTX_PROFILE_SCOPE(fuse);
+  // Keyed by the fused code, failed builds are remembered as nullptr
+  static std::unordered_map<string_class, cl_kernel> fused_cache;
+
+  auto fused = std::make_shared<kernel>(kernels.front()->ctx);
+  auto& src = fused->src;
+  src.kernel_name = "_sycl_fused";
+
+  // Every buffer becomes one argument, const only if no kernel writes it
+  std::map<buffer_base*, int> position;
+  for (auto& kern : kernels) {
+    std::map<string_class, string_class> names;
+    for (auto& res : kern->src.resources) {
+      auto buf = res.second.acc.data;
+      auto it = position.find(buf);
+      if (it == position.end()) {
+        int id = static_cast<int>(position.size()) + 1;
+        it = position.emplace(buf, id).first;
+        src.resources[id] = res.second;
+        src.resources[id].resource_name =
+            source::resource_name_root + get_string<int>::get(id);
+      } else if (res.second.acc.mode != access::mode::read) {
+        src.resources[it->second].acc.mode = access::mode::read_write;
+      }
+      names[res.second.resource_name] =
+          src.resources[it->second].resource_name;
+    }
+
+    // Own scope for the local variables of each body
+    src.lines.push_back("\t{");
+    for (auto& line : kern->src.lines) {
+      src.lines.push_back(
+          '\t' + rename_resources(line, source::resource_name_root, names));
+    }
+    src.lines.push_back("\t}");
+  }
+
+  auto code = src.get_code();
+  auto it = fused_cache.find(code);
+  if (it == fused_cache.end()) {
+    auto k = build_fused(fused->ctx, code, src.kernel_name);
+    it = fused_cache.emplace(code, k).first;
+  }
+  if (it->second == nullptr) {
+    return nullptr;
+  }
+  fused->set(it->second);
+  return fused;
+}
+
+detail::command::info::command_f issue_command::fused_command(
+    shared_ptr_class<kernel> kern, event* evnt, ::size_t global_size) {
+  return std::bind(enqueue_range_command<1>, std::placeholders::_1,
+                   std::placeholders::_2, kern, evnt, range<1>(global_size),
+                   id<1>());
+}
+
 void issue_command::write_buffers_to_device(shared_ptr_class<kernel> kern) {
   for (auto& acc : kern->src.resources) {
     auto mode = acc.second.acc.mode;
@@ -40,9 +190,11 @@ void issue_command::write_buffers_to_device(shared_ptr_class<kernel> kern) {
       // Don't need to copy data that won't be used
       continue;
     }
+    auto buf_acc = acc.second.acc;
+    buf_acc.region = command::group_detail::transfer_region(buf_acc.data);
     command::group_detail::add_buffer_copy(
-        acc.second.acc, access::mode::write, buffer_base::enqueue_command,
-        __func__, acc.second.acc.data, &clEnqueueWriteBuffer);
+        buf_acc, access::mode::write, buffer_base::enqueue_command, __func__,
+        buf_acc.data, &clEnqueueWriteBuffer);
   }
 }
 
@@ -65,9 +217,11 @@ void issue_command::read_buffers_from_device(shared_ptr_class<kernel> kern) {
       // Don't need to read back read-only buffers
       continue;
     }
+    auto buf_acc = acc.second.acc;
+    buf_acc.region = command::group_detail::transfer_region(buf_acc.data);
     command::group_detail::add_buffer_copy(
-        acc.second.acc, access::mode::read, buffer_base::enqueue_command,
-        __func__, acc.second.acc.data,
+        buf_acc, access::mode::read, buffer_base::enqueue_command, __func__,
+        buf_acc.data,
         reinterpret_cast<buffer_base::clEnqueueBuffer_f>(  // NOLINT
             &clEnqueueReadBuffer));
   }
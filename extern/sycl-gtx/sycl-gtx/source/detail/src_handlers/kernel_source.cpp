@@ -67,7 +67,8 @@ string_class source::generate_accessor_list() const {
 
   for (auto& acc : resources) {
     list += get_name(acc.second.acc.target) + " ";
-    if (acc.second.acc.mode == access::mode::read) {
+    if (acc.second.acc.mode == access::mode::read &&
+        acc.second.acc.target != access::target::image) {
       list += "const ";
     }
     list += acc.second.type_name + " ";
@@ -87,6 +88,8 @@ string_class source::get_name(access::target target) {
       return "__constant";
     case access::target::local:
       return "__local";
+    case access::target::image:
+      return "__read_only";
     default:
       return "";
   }
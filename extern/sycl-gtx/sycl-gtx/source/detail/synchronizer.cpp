@@ -10,19 +10,20 @@ using namespace detail;
 std::set<queue*> synchronizer::queues;
 std::map<accessor_base*, buffer_base*> synchronizer::host_accessors;
 
-void synchronizer::wait_on_queues(buffer_base* buf) {
+// Only the transfers of the buffer itself are waited for,
+// unrelated work stays in flight
+void synchronizer::wait_on_events(buffer_base* buf) {
+  buf->wait_for_events();
   for (auto&& q : queues) {
-    if (q->buffers_in_use.count(buf) > 0) {
-      q->wait();
-    }
+    q->buffers_in_use.erase(buf);
   }
 }
 
-void synchronizer::flush_queues(buffer_base* buf) {
+void synchronizer::flush_queues() {
+  // Command groups held back by the accessor were never flushed,
+  // so the buffer isn't necessarily in use by their queue
   for (auto&& q : queues) {
-    if (q->buffers_in_use.count(buf) > 0) {
-      q->flush();
-    }
+    q->flush();
   }
 }
 
@@ -36,13 +37,14 @@ void synchronizer::remove(queue* q) {
 
 void synchronizer::add(accessor_base* acc, buffer_base* buf) {
   DSELF() << acc << buf;
+  flush_queues();
   host_accessors.emplace(acc, buf);
-  wait_on_queues(buf);
+  wait_on_events(buf);
 }
 
 void synchronizer::remove(accessor_base* acc, buffer_base* buf) {
   host_accessors.erase(acc);
-  flush_queues(buf);
+  flush_queues();
 }
 
 bool synchronizer::can_flush(
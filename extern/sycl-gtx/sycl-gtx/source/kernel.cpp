@@ -24,6 +24,7 @@ cl_command_queue kernel::get_cl_queue(queue* q) {
 
 void kernel::enqueue_task(queue* q, const vector_class<cl_event>& wait_events,
                           event* evnt) const {
+  SYCL_GTX_PROFILE_SCOPE(enqueue);
   auto ev = evnt->evnt.get();
 
   auto error_code = clEnqueueTask(q->get(), kern.get(),
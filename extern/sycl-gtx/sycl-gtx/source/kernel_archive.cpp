@@ -0,0 +1,286 @@
+#include "SYCL/kernel_archive.h"
+
+#include "SYCL/command_group.h"
+#include "SYCL/detail/debug.h"
+#include "SYCL/device.h"
+#include "SYCL/kernel.h"
+#include "SYCL/platform.h"
+#include <cctype>
+#include <fstream>
+#include <iterator>
+
+using namespace cl::sycl;
+
+bool kernel_archive::recording = false;
+bool kernel_archive::loaded = false;
+string_class kernel_archive::directory;
+string_class kernel_archive::fingerprint;
+std::map<string_class, kernel_archive::entry> kernel_archive::entries;
+SYCL_THREAD_LOCAL vector_class<string_class>* kernel_archive::tags = nullptr;
+
+static const char* manifest_header = "sycl-gtx-kernels 1";
+
+static string_class read_file(const string_class& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return "";
+  }
+  return string_class(std::istreambuf_iterator<char>(file),
+                      std::istreambuf_iterator<char>());
+}
+
+void kernel_archive::record(const string_class& directory,
+                            const string_class& fingerprint) {
+  kernel_archive::directory = directory;
+  kernel_archive::fingerprint = fingerprint;
+  entries.clear();
+  recording = true;
+  loaded = false;
+}
+
+bool kernel_archive::load(const string_class& directory,
+                          const string_class& fingerprint) {
+  std::ifstream manifest(directory + "/manifest");
+  string_class line;
+  if (!std::getline(manifest, line) || line != manifest_header) {
+    return false;
+  }
+  if (!std::getline(manifest, line) || line != fingerprint) {
+    return false;
+  }
+
+  std::map<string_class, entry> loaded_entries;
+  while (std::getline(manifest, line)) {
+    std::istringstream fields(line);
+    entry e;
+    ::size_t num_args;
+    fields >> e.file >> e.function_name >> e.num_accessors >> num_args;
+    for (::size_t i = 0; i < num_args; ++i) {
+      argument arg;
+      fields >> arg.accessor >> arg.size;
+      e.args.push_back(arg);
+    }
+    string_class key;
+    fields >> key;
+    if (!fields) {
+      debug() << "Invalid kernel archive entry:" << line;
+      return false;
+    }
+    loaded_entries.emplace(key, std::move(e));
+  }
+
+  kernel_archive::directory = directory;
+  kernel_archive::fingerprint = fingerprint;
+  entries = std::move(loaded_entries);
+  loaded = true;
+  recording = false;
+  return true;
+}
+
+bool kernel_archive::save() {
+  if (!recording) {
+    return false;
+  }
+
+  std::ofstream manifest(directory + "/manifest");
+  manifest << manifest_header << '\n' << fingerprint << '\n';
+
+  ::size_t id = 0;
+  for (auto& it : entries) {
+    auto& e = it.second;
+    if (e.ambiguous) {
+      debug() << "Not archiving kernel" << it.first
+              << ", it was generated with different code";
+      continue;
+    }
+
+    e.file = "k" + std::to_string(id++);
+    std::ofstream source(directory + '/' + e.file + ".cl");
+    source << e.code;
+    if (!source) {
+      return false;
+    }
+
+    manifest << e.file << ' ' << e.function_name << ' ' << e.num_accessors
+             << ' ' << e.args.size();
+    for (auto& arg : e.args) {
+      manifest << ' ' << arg.accessor << ' ' << arg.size;
+    }
+    manifest << ' ' << it.first << '\n';
+  }
+
+  return static_cast<bool>(manifest);
+}
+
+kernel_archive::variant::variant(const string_class& tag) {
+  if (tags == nullptr) {
+    tags = new vector_class<string_class>();
+  }
+  string_class cleaned = tag;
+  for (auto& c : cleaned) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      c = '_';
+    }
+  }
+  tags->push_back(cleaned);
+}
+
+kernel_archive::variant::~variant() {
+  tags->pop_back();
+  if (tags->empty()) {
+    delete tags;
+    tags = nullptr;
+  }
+}
+
+void kernel_archive::add(const string_class& key, const kernel& kern) {
+  auto& src = kern.src;
+  auto accessors = detail::command::group_detail::accessors();
+
+  entry e;
+  e.function_name = src.get_kernel_name();
+  e.code = src.get_code();
+  e.num_accessors = accessors.size();
+
+  // Kernel arguments are in the order of the resources,
+  // map them to the accessors the command group requested
+  for (auto& res : src.resources) {
+    auto& acc = res.second.acc;
+
+    // Local accessors have no buffer, they are identified by creation order
+    ::size_t local_rank = 0;
+    if (acc.target == access::target::local) {
+      for (auto& other : src.resources) {
+        if (other.second.acc.target == access::target::local &&
+            std::less<void*>()(other.second.resource,
+                                   res.second.resource)) {
+          ++local_rank;
+        }
+      }
+    }
+
+    ::size_t index = accessors.size();
+    ::size_t local_index = 0;
+    for (::size_t i = 0; i < accessors.size(); ++i) {
+      if (acc.target == access::target::local) {
+        if (accessors[i].target == access::target::local &&
+            local_index++ == local_rank) {
+          index = i;
+          break;
+        }
+      } else if (accessors[i].data == acc.data &&
+                 accessors[i].mode == acc.mode &&
+                 accessors[i].target == acc.target) {
+        index = i;
+        break;
+      }
+    }
+    if (index == accessors.size()) {
+      // Accessor from outside the command group
+      e.ambiguous = true;
+    }
+    e.args.push_back({index, res.second.size});
+  }
+
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    entries.emplace(key, std::move(e));
+    return;
+  }
+
+  auto& existing = it->second;
+  bool same_args = existing.args.size() == e.args.size();
+  for (::size_t i = 0; same_args && i < e.args.size(); ++i) {
+    same_args = existing.args[i].accessor == e.args[i].accessor &&
+                existing.args[i].size == e.args[i].size;
+  }
+  if (existing.code != e.code || !same_args) {
+    existing.ambiguous = true;
+  }
+}
+
+shared_ptr_class<kernel> kernel_archive::instantiate(const context& ctx,
+                                                     const string_class& key) {
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    return nullptr;
+  }
+  auto& e = it->second;
+
+  auto accessors = detail::command::group_detail::accessors();
+  if (e.ambiguous || accessors.size() != e.num_accessors) {
+    return nullptr;
+  }
+
+  if (e.built == nullptr) {
+    e.built = build(ctx, e);
+    if (e.built == nullptr) {
+      // Trace this kernel from now on
+      e.ambiguous = true;
+      return nullptr;
+    }
+  }
+
+  auto kern = std::make_shared<kernel>(ctx);
+  kern->set(e.built);
+  kern->src.kernel_name = e.function_name;
+
+  int position = 0;
+  for (auto& arg : e.args) {
+    auto acc = accessors[arg.accessor];
+    kern->src.resources[++position] = {acc, "", "", arg.size, acc.data};
+  }
+
+  return kern;
+}
+
+cl_kernel kernel_archive::build(const context& ctx, entry& e) {
+  using create_with_il_f = cl_program(CL_API_CALL*)(
+      cl_context, const void*, ::size_t, ::cl_int*);
+
+  auto devices = ctx.get_devices();
+  auto device_pointers = detail::get_cl_array(devices);
+  ::cl_int error_code = CL_SUCCESS;
+  cl_program p = nullptr;
+
+  auto il = read_file(directory + '/' + e.file + ".spv");
+  if (!il.empty() && !devices.empty()) {
+    auto create_with_il = reinterpret_cast<create_with_il_f>(  // NOLINT
+        clGetExtensionFunctionAddressForPlatform(
+            devices[0].get_platform().get(), "clCreateProgramWithILKHR"));
+    if (create_with_il != nullptr) {
+      p = create_with_il(ctx.get(), il.data(), il.size(), &error_code);
+      if (error_code != CL_SUCCESS) {
+        p = nullptr;
+      }
+    }
+  }
+
+  if (p == nullptr) {
+    auto code = read_file(directory + '/' + e.file + ".cl");
+    if (code.empty()) {
+      return nullptr;
+    }
+    const char* code_p = code.c_str();
+    ::size_t length = code.size();
+    p = clCreateProgramWithSource(ctx.get(), 1, &code_p, &length, &error_code);
+    if (error_code != CL_SUCCESS) {
+      return nullptr;
+    }
+  }
+
+  error_code = clBuildProgram(p, static_cast<::cl_uint>(devices.size()),
+                              device_pointers.data(), "", nullptr, nullptr);
+  cl_kernel k = nullptr;
+  if (error_code == CL_SUCCESS) {
+    k = clCreateKernel(p, e.function_name.c_str(), &error_code);
+  }
+  if (error_code != CL_SUCCESS) {
+    debug() << "Could not build archived kernel" << e.file;
+    k = nullptr;
+  }
+
+  // The kernel keeps its program alive
+  clReleaseProgram(p);
+  return k;
+}
@@ -18,6 +18,7 @@ void queue::display_device_info() const {
 cl_command_queue queue::create_queue(bool display_info,
                                      bool register_with_synchronizer,
                                      info::queue_profiling enable_profiling) {
+  SYCL_GTX_PROFILE_SCOPE(create_queue);
   if (display_info) {
     display_device_info();
   }
@@ -137,19 +138,25 @@ void queue::throw_asynchronous() {
 }
 
 void queue::wait() {
+  flush();
   finish();
   wait_subqueues(false);
 }
 
 void queue::wait_and_throw() {
+  flush();
   finish();
   wait_subqueues(true);
   throw_asynchronous();
 }
 
 void queue::flush() {
-  for (auto& q : subqueues) {
-    q.process(buffers_in_use);
+  for (auto i = first_unflushed; i < subqueues.size(); ++i) {
+    subqueues[i].process(buffers_in_use);
+  }
+  while (first_unflushed < subqueues.size() &&
+         subqueues[first_unflushed].is_flushed) {
+    ++first_unflushed;
   }
 }
 
@@ -171,12 +178,17 @@ void queue::wait_subqueues(bool and_throw) {
 }
 
 handler_event queue::process(buffer_set& buffers_in_use_master) {
-  if (is_flushed ||
-      !detail::synchronizer::can_flush(command_group.read_buffers) ||
-      !detail::synchronizer::can_flush(command_group.write_buffers)) {
-    // TODO(progtx):
+  if (is_flushed) {
     return handler_event();
   }
+  {
+    SYCL_GTX_PROFILE_SCOPE(synchronizer);
+    if (!detail::synchronizer::can_flush(command_group.read_buffers) ||
+        !detail::synchronizer::can_flush(command_group.write_buffers)) {
+      // TODO(progtx):
+      return handler_event();
+    }
+  }
   command_group.optimize();
   command_group.flush(
       get_wait_events(command_group.read_buffers, buffers_in_use_master));
@@ -186,6 +198,26 @@ handler_event queue::process(buffer_set& buffers_in_use_master) {
   return handler_event();
 }
 
+// An elementwise command group waits for the next submission,
+// consecutive ones are then fused into a single kernel
+handler_event queue::process_submitted() {
+  auto& submitted = subqueues.back();
+  if (subqueues.size() > first_unflushed + 1) {
+    auto& previous = subqueues[subqueues.size() - 2];
+    if (!previous.is_flushed &&
+        previous.command_group.can_fuse(submitted.command_group)) {
+      previous.command_group.append(submitted.command_group);
+      subqueues.pop_back();
+      return handler_event();
+    }
+    previous.process(buffers_in_use);
+  }
+  if (submitted.command_group.is_elementwise()) {
+    return handler_event();
+  }
+  return submitted.process(buffers_in_use);
+}
+
 vector_class<cl_event> queue::get_wait_events(const buffer_set& dependencies,
                                               buffer_set& buffers_in_use) {
   vector_class<cl_event> wait_events;
@@ -194,10 +226,11 @@ vector_class<cl_event> queue::get_wait_events(const buffer_set& dependencies,
   for (auto&& buf : dependencies) {
     auto buf_it = buffers_in_use.find(buf);
     if (buf_it != buffers_in_use.end()) {
-      auto size = buf->events.size();
-      if (size == 0) {
+      if (buf->prune_events()) {
+        // Nothing pending, the buffer is no longer in use
         remove_dependencies.push_back(buf_it);
       } else {
+        auto size = buf->events.size();
         wait_events.reserve(wait_events.size() + size);
         for (auto& ev : buf->events) {
           wait_events.push_back(ev.get());
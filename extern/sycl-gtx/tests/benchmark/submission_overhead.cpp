@@ -0,0 +1,144 @@
+#include "../common.h"
+
+#include <SYCL/detail/profile.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Host overhead of sycl-gtx per submission and stage.
+// Prefers a CPU OpenCL device, so it also runs on machines without a GPU.
+// Writes a kernel archive to the working directory.
+// Usage: submission_overhead [submissions]
+//
+// Prints one CSV line per scenario and stage:
+// scenario,stage,calls,total_us,us_per_submission
+
+#define LENGTH (1024)
+
+using namespace cl::sycl;
+using detail::profile;
+
+namespace {
+
+struct buffers {
+  std::vector<float> h_a = std::vector<float>(LENGTH, 1.0f);
+  std::vector<float> h_b = std::vector<float>(LENGTH, 2.0f);
+  std::vector<float> h_c = std::vector<float>(LENGTH, 3.0f);
+  std::vector<float> h_r = std::vector<float>(LENGTH, 0.0f);
+  buffer<float> a{h_a.data(), range<1>(LENGTH)};
+  buffer<float> b{h_b.data(), range<1>(LENGTH)};
+  buffer<float> c{h_c.data(), range<1>(LENGTH)};
+  buffer<float> r{h_r.data(), range<1>(LENGTH)};
+};
+
+// Four buffers and a small loop, comparable to the solver kernels
+void submit(queue& q, buffers& bufs, float scale) {
+  q.submit([&](handler& cgh) {
+    auto a = bufs.a.get_access<access::mode::read>(cgh);
+    auto b = bufs.b.get_access<access::mode::read>(cgh);
+    auto c = bufs.c.get_access<access::mode::read>(cgh);
+    auto r = bufs.r.get_access<access::mode::read_write>(cgh);
+
+    cgh.parallel_for<class overhead>(range<1>(LENGTH), [=](id<1> i) {
+      float1 sum = 0.0f;
+      SYCL_FOR(int1 k = 0, k < 4, k++) {
+        sum += a[i] * scale + b[i] * k;
+      }
+      SYCL_END
+      r[i] += sum - c[i];
+    });
+  });
+}
+
+template <class F>
+void run(const char* scenario, queue& q, int submissions, F body) {
+  buffers bufs;
+  profile::reset();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < submissions; ++i) {
+    body(bufs, i);
+  }
+  q.wait();
+  auto wall = std::chrono::duration<double, std::micro>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+
+  auto& totals = profile::get();
+  for (int s = 0; s < profile::num_stages; ++s) {
+    auto total_us = static_cast<double>(totals.nanoseconds[s]) * 1e-3;
+    std::cout << scenario << ',' << profile::name(profile::stage(s)) << ','
+              << totals.calls[s] << ',' << total_us << ','
+              << total_us / submissions << '\n';
+  }
+  std::cout << scenario << ",wall," << submissions << ',' << wall << ','
+            << wall / submissions << '\n';
+}
+
+device select_device() {
+  try {
+    return cpu_selector().select_device();
+  } catch (cl::sycl::exception&) {
+    std::cerr << "No OpenCL CPU device, using the default device\n";
+    return default_selector().select_device();
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int submissions = argc > 1 ? std::atoi(argv[1]) : 1000;
+  if (submissions <= 0) {
+    std::cerr << "Usage: submission_overhead [submissions]\n";
+    return 1;
+  }
+
+#ifndef SYCL_GTX_PROFILE
+  std::cerr << "sycl-gtx was built without SYCL_GTX_PROFILE, "
+               "only the wall time is measured\n";
+#endif
+
+  auto dev = select_device();
+  std::cerr << "Device: " << dev.get_info<info::device::name>() << '\n';
+  queue q(dev);
+
+  std::cout << "scenario,stage,calls,total_us,us_per_submission\n";
+
+  // Warm up, so the first compilation isn't counted below
+  {
+    buffers bufs;
+    submit(q, bufs, 1.0f);
+    q.wait();
+  }
+
+  // Same kernel every time: tracing and a kernel cache hit per submission
+  run("cached", q, submissions, [&](buffers& bufs, int) {
+    submit(q, bufs, 1.0f);
+  });
+
+  // The captured value is a literal, so every submission compiles a new
+  // kernel
+  int distinct = std::max(submissions / 100, 1);
+  run("compile", q, distinct, [&](buffers& bufs, int i) {
+    submit(q, bufs, static_cast<float>(i + 2));
+  });
+
+  // Kernel from an archive, no tracing at all
+  kernel_archive::record(".", "submission_overhead");
+  {
+    buffers bufs;
+    submit(q, bufs, 1.0f);
+    q.wait();
+  }
+  if (!kernel_archive::save() ||
+      !kernel_archive::load(".", "submission_overhead")) {
+    std::cerr << "Could not write the kernel archive\n";
+    return 1;
+  }
+  run("archived", q, submissions, [&](buffers& bufs, int) {
+    submit(q, bufs, 1.0f);
+  });
+
+  return 0;
+}
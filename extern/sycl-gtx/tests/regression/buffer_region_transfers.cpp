@@ -0,0 +1,61 @@
+#include "../common.h"
+
+#include <vector>
+
+// Device accessors with a region only transfer that part of the buffer,
+// host values outside of it stay untouched
+
+#define SIDE (4)
+#define LENGTH (SIDE * SIDE * SIDE)
+
+using namespace cl::sycl;
+
+int main() {
+  std::vector<int> h_box(LENGTH, -1);
+  std::vector<int> h_r(1, 0);
+  int errors = 0;
+
+  {
+    buffer<int> d_box(h_box);
+    buffer<int> d_r(h_r);
+    queue myQueue;
+
+    // Inner 2x2x2 box, not contiguous, so it is written back as a rectangle
+    const buffer_region box{{1, 1, 1}, {2, 2, 2}, SIDE, SIDE * SIDE};
+    myQueue.submit([&](handler& cgh) {
+      auto b = d_box.get_access<access::mode::discard_write>(cgh, box);
+      cgh.parallel_for<class fill_box>(range<3>(2, 2, 2), [=](id<3> i) {
+        b[(i[2] + 1) * (SIDE * SIDE) + (i[1] + 1) * SIDE + i[0] + 1] = 1;
+      });
+    });
+
+    // Single value, read as a range
+    const buffer_region last{{SIDE - 1, SIDE - 1, SIDE - 1}, {1, 1, 1},
+                             SIDE, SIDE * SIDE};
+    myQueue.submit([&](handler& cgh) {
+      auto b = d_box.get_access<access::mode::read>(cgh, last);
+      auto r = d_r.get_access<access::mode::write>(cgh);
+      cgh.single_task<class read_last>([=]() { r[0] = b[LENGTH - 1] + 2; });
+    });
+  }
+
+  for (int z = 0; z < SIDE; z++) {
+    for (int y = 0; y < SIDE; y++) {
+      for (int x = 0; x < SIDE; x++) {
+        const bool inside = x > 0 && x < 3 && y > 0 && y < 3 && z > 0 && z < 3;
+        const int value = h_box[(z * SIDE + y) * SIDE + x];
+        if (value != (inside ? 1 : -1)) {
+          debug() << x << y << z << "=" << value;
+          ++errors;
+        }
+      }
+    }
+  }
+  if (h_r[0] != 1) {
+    debug() << "read" << h_r[0] << "instead of 1";
+    ++errors;
+  }
+
+  debug() << "Done," << errors << "errors";
+  return static_cast<int>(errors != 0);
+}
@@ -0,0 +1,71 @@
+#include "../common.h"
+
+#include <vector>
+
+// Consecutive elementwise command groups over the same range are fused,
+// the results must be the same as running them one by one
+
+#define LENGTH (1024)
+
+using namespace cl::sycl;
+
+int main() {
+  std::vector<float> h_a(LENGTH, 0);
+  std::vector<float> h_b(LENGTH);
+  std::vector<float> h_c(LENGTH, 0);
+  std::vector<float> h_d(LENGTH, 0);
+  int errors = 0;
+
+  for (int i = 0; i < LENGTH; i++) {
+    h_b[i] = static_cast<float>(i);
+  }
+
+  {
+    buffer<float> d_a(h_a);
+    buffer<float> d_b(h_b);
+    buffer<float> d_c(h_c);
+    buffer<float> d_d(h_d);
+    queue myQueue;
+
+    myQueue.submit([&](handler& cgh) {
+      auto a = d_a.get_access<access::mode::discard_write>(cgh);
+      auto b = d_b.get_access<access::mode::read>(cgh);
+      cgh.parallel_for<class fuse_set>(range<1>(LENGTH),
+                                       [=](id<1> i) { a[i] = b[i] + 1; });
+    });
+    myQueue.submit([&](handler& cgh) {
+      auto a = d_a.get_access<access::mode::read_write>(cgh);
+      cgh.parallel_for<class fuse_scale>(range<1>(LENGTH),
+                                         [=](id<1> i) { a[i] *= 2; });
+    });
+    myQueue.submit([&](handler& cgh) {
+      auto a = d_a.get_access<access::mode::read>(cgh);
+      auto b = d_b.get_access<access::mode::read>(cgh);
+      auto c = d_c.get_access<access::mode::discard_write>(cgh);
+      cgh.parallel_for<class fuse_add>(range<1>(LENGTH),
+                                       [=](id<1> i) { c[i] = a[i] - b[i]; });
+    });
+
+    // Reads a neighbour, so it can't be fused
+    myQueue.submit([&](handler& cgh) {
+      auto c = d_c.get_access<access::mode::read>(cgh);
+      auto d = d_d.get_access<access::mode::discard_write>(cgh);
+      cgh.parallel_for<class reverse>(range<1>(LENGTH), [=](id<1> i) {
+        d[i] = c[LENGTH - 1 - i];
+      });
+    });
+  }
+
+  for (int i = 0; i < LENGTH; i++) {
+    const float a = 2 * (i + 1.0f);
+    const float c = a - i;
+    const float d = 2 * (LENGTH - i) - (LENGTH - 1 - i);
+    if (h_a[i] != a || h_c[i] != c || h_d[i] != d) {
+      debug() << i << ":" << h_a[i] << h_c[i] << h_d[i];
+      ++errors;
+    }
+  }
+
+  debug() << "Done," << errors << "errors";
+  return static_cast<int>(errors != 0);
+}
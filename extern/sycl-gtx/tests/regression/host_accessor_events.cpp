@@ -0,0 +1,59 @@
+#include "../common.h"
+
+#include <vector>
+
+// Host accessors wait only for the transfers of their own buffer,
+// work on other buffers and later command groups still see the right data
+
+#define LENGTH (1024)
+#define STEPS (8)
+
+using namespace cl::sycl;
+
+int main() {
+  std::vector<int> h_a(LENGTH, 0);
+  std::vector<int> h_b(LENGTH, 0);
+  int errors = 0;
+
+  {
+    buffer<int> d_a(h_a);
+    buffer<int> d_b(h_b);
+    queue myQueue;
+
+    for (int step = 1; step <= STEPS; step++) {
+      myQueue.submit([&](handler& cgh) {
+        auto b = d_b.get_access<access::mode::read_write>(cgh);
+        cgh.parallel_for<class increment_b>(range<1>(LENGTH),
+                                            [=](id<> i) { b[i] += 2; });
+      });
+      myQueue.submit([&](handler& cgh) {
+        auto a = d_a.get_access<access::mode::read_write>(cgh);
+        cgh.parallel_for<class increment_a>(range<1>(LENGTH),
+                                            [=](id<> i) { a[i] += 1; });
+      });
+
+      // Reads a while the work on b may still be running
+      auto a =
+          d_a.get_access<access::mode::read, access::target::host_buffer>();
+      for (int i = 0; i < LENGTH; i++) {
+        if (a[i] != step) {
+          debug() << "a[" << i << "] =" << a[i] << "after step" << step;
+          ++errors;
+          break;
+        }
+      }
+    }
+
+    auto b = d_b.get_access<access::mode::read, access::target::host_buffer>();
+    for (int i = 0; i < LENGTH; i++) {
+      if (b[i] != 2 * STEPS) {
+        debug() << "b[" << i << "] =" << b[i];
+        ++errors;
+        break;
+      }
+    }
+  }
+
+  debug() << "Done," << errors << "errors";
+  return static_cast<int>(errors != 0);
+}
@@ -0,0 +1,55 @@
+#include "../common.h"
+
+#include <vector>
+
+// Reads a buffer through an image view with a neighbour stencil,
+// the results must be the same as reading it through a __global pointer
+
+#define LENGTH (1024)
+
+using namespace cl::sycl;
+
+int main() {
+  std::vector<double> h_in(LENGTH);
+  std::vector<double> h_image(LENGTH, 0);
+  std::vector<double> h_global(LENGTH, 0);
+  int errors = 0;
+
+  for (int i = 0; i < LENGTH; i++) {
+    h_in[i] = 0.5 * i * i;
+  }
+
+  {
+    buffer<double> d_in(h_in);
+    buffer<double> d_image(h_image);
+    buffer<double> d_global(h_global);
+    queue myQueue;
+
+    myQueue.submit([&](handler& cgh) {
+      auto in = d_in.get_access<access::mode::read, access::target::image>(cgh);
+      auto out = d_image.get_access<access::mode::discard_write>(cgh);
+      cgh.parallel_for<class image_stencil>(
+          range<1>(LENGTH - 2), [=](id<1> i) {
+            out[i[0] + 1] = in[i[0]] - 2.0 * in[i[0] + 1] + in[i[0] + 2];
+          });
+    });
+    myQueue.submit([&](handler& cgh) {
+      auto in = d_in.get_access<access::mode::read>(cgh);
+      auto out = d_global.get_access<access::mode::discard_write>(cgh);
+      cgh.parallel_for<class global_stencil>(
+          range<1>(LENGTH - 2), [=](id<1> i) {
+            out[i[0] + 1] = in[i[0]] - 2.0 * in[i[0] + 1] + in[i[0] + 2];
+          });
+    });
+  }
+
+  for (int i = 1; i < LENGTH - 1; i++) {
+    if (h_image[i] != 1.0 || h_global[i] != 1.0) {
+      debug() << i << ":" << h_image[i] << h_global[i];
+      ++errors;
+    }
+  }
+
+  debug() << "Done," << errors << "errors";
+  return static_cast<int>(errors != 0);
+}
@@ -0,0 +1,78 @@
+#include "../common.h"
+
+#include <vector>
+
+// Records a kernel to an archive and runs it again from the archive,
+// with the buffers bound in a different order
+
+#define LENGTH (1024)
+
+using namespace cl::sycl;
+
+static void subtract(queue& myQueue, buffer<int>& d_a, buffer<int>& d_b,
+                     buffer<int>& d_r) {
+  myQueue.submit([&](handler& cgh) {
+    auto r = d_r.get_access<access::mode::write>(cgh);
+    auto a = d_a.get_access<access::mode::read>(cgh);
+    auto b = d_b.get_access<access::mode::read>(cgh);
+
+    cgh.parallel_for<class subtraction>(range<1>(LENGTH),
+                                        [=](id<> i) { r[i] = a[i] - b[i]; });
+  });
+}
+
+int main() {
+  std::vector<int> h_a(LENGTH);
+  std::vector<int> h_b(LENGTH);
+  std::vector<int> h_r(LENGTH, 0);
+  for (int i = 0; i < LENGTH; i++) {
+    h_a[i] = 3 * i;
+    h_b[i] = i;
+  }
+
+  queue myQueue;
+
+  debug() << "Recording kernel";
+  kernel_archive::record(".", "kernel_archive_test");
+  {
+    buffer<int> d_a(h_a);
+    buffer<int> d_b(h_b);
+    buffer<int> d_r(h_r);
+    subtract(myQueue, d_a, d_b, d_r);
+  }
+  if (!kernel_archive::save()) {
+    debug() << "Could not save the archive";
+    return 1;
+  }
+
+  if (kernel_archive::load(".", "another fingerprint")) {
+    debug() << "Loaded archive with the wrong fingerprint";
+    return 1;
+  }
+  if (!kernel_archive::load(".", "kernel_archive_test")) {
+    debug() << "Could not load the archive";
+    return 1;
+  }
+
+  debug() << "Running archived kernel";
+  std::vector<int> h_r2(LENGTH, 0);
+  {
+    buffer<int> d_a(h_a);
+    buffer<int> d_b(h_b);
+    buffer<int> d_r(h_r2);
+    subtract(myQueue, d_b, d_a, d_r);
+  }
+
+  int correct = 0;
+  for (int i = 0; i < LENGTH; i++) {
+    if (h_r[i] == 2 * i && h_r2[i] == -2 * i) {
+      correct++;
+    } else {
+      debug() << i << ":" << h_r[i] << h_r2[i];
+    }
+  }
+
+  debug() << correct << "out of" << LENGTH << "results were correct.";
+
+  return static_cast<int>(correct != LENGTH);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "SmallMatrix.h"
+#include <algorithm>
+#include <vector>
+
+// Backend independent part of Anderson acceleration: a ring of at most 'depth' differences of
+// fixed point residuals dF_i and the Gram matrix <dF_i, dF_j> of the stored ones.
+// The vectors themselves are kept by the backend, in the slot returned by nextSlot().
+class AndersonHistory {
+public:
+	explicit AndersonHistory(std::size_t maxDepth)
+		: depth(maxDepth), gram(maxDepth)
+	{}
+
+	// Number of stored differences
+	std::size_t size() const
+	{
+		return count;
+	}
+
+	// Slot the next difference gets stored in, overwrites the oldest one once the ring is full
+	std::size_t nextSlot() const
+	{
+		return next;
+	}
+
+	// Number of stored differences after the next push
+	std::size_t sizeAfterPush() const
+	{
+		return std::min(count + 1, depth);
+	}
+
+	// gramRow[j] = <dF_nextSlot, dF_j> for all j < sizeAfterPush()
+	void push(const std::vector<double>& gramRow)
+	{
+		const std::size_t n = sizeAfterPush();
+		for (std::size_t j = 0; j < n; j++) {
+			gram(next, j) = gramRow[j];
+			gram(j, next) = gramRow[j];
+		}
+		next = (next + 1) % depth;
+		count = n;
+	}
+
+	// Mixing coefficients minimizing ||f - sum_j c_j dF_j||, rhs[j] = <dF_j, f> for all j < size().
+	// Solved via the regularized normal equations, returns zeros if they are singular
+	std::vector<double> coefficients(const std::vector<double>& rhs) const
+	{
+		SmallMatrix a(count);
+		double maxDiag = 0.0;
+		for (std::size_t i = 0; i < count; i++) {
+			maxDiag = std::max(maxDiag, gram(i, i));
+			for (std::size_t j = 0; j < count; j++) {
+				a(i, j) = gram(i, j);
+			}
+		}
+		for (std::size_t i = 0; i < count; i++) {
+			a(i, i) += 1e-12 * maxDiag;
+		}
+
+		std::vector<double> coeff(rhs.begin(), rhs.begin() + count);
+		if (maxDiag == 0.0 || !a.solve(coeff)) {
+			std::fill(coeff.begin(), coeff.end(), 0.0);
+		}
+		return coeff;
+	}
+
+	void clear()
+	{
+		count = 0;
+		next = 0;
+	}
+
+private:
+	std::size_t depth;
+	std::size_t count = 0;
+	std::size_t next = 0;
+	SmallMatrix gram;
+};
@@ -0,0 +1,49 @@
+#include "BlockInverse.h"
+#include "SmallMatrix.h"
+#include <assert.h>
+
+std::vector<double> BlockInverse::build(const Stencil27& op)
+{
+	std::vector<double> table(tableSize, 0.0);
+
+	for (std::size_t s = 0; s < shapes; s++) {
+		const int extent[3] = { (s & 4) ? 1 : 2, (s & 2) ? 1 : 2, (s & 1) ? 1 : 2 };
+		auto inside = [&](int dx, int dy, int dz) {
+			return dx < extent[0] && dy < extent[1] && dz < extent[2];
+		};
+
+		SmallMatrix block(points);
+		for (int ix = 0; ix < 2; ix++) {
+			for (int iy = 0; iy < 2; iy++) {
+				for (int iz = 0; iz < 2; iz++) {
+					const std::size_t row = local(ix, iy, iz);
+					if (!inside(ix, iy, iz)) {
+						block(row, row) = 1.0;
+						continue;
+					}
+					for (int jx = 0; jx < extent[0]; jx++) {
+						for (int jy = 0; jy < extent[1]; jy++) {
+							for (int jz = 0; jz < extent[2]; jz++) {
+								block(row, local(jx, jy, jz)) = op.values[Stencil27::index(jx - ix, jy - iy, jz - iz)];
+							}
+						}
+					}
+				}
+			}
+		}
+
+		// column j of the inverse is the solution for the j-th unit vector
+		for (std::size_t j = 0; j < points; j++) {
+			std::vector<double> column(points, 0.0);
+			column[j] = 1.0;
+			const bool solved = block.solve(column);
+			assert(solved);
+			(void)solved;
+			for (std::size_t i = 0; i < points; i++) {
+				table[(s * points + i) * points + j] = column[i];
+			}
+		}
+	}
+
+	return table;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "Galerkin.h"
+#include <cstddef>
+#include <vector>
+
+// Exact inverses of a constant coefficient operator restricted to the 2x2x2 blocks of the block smoother.
+// Block (bx, by, bz) holds the interior points 2*bx+1 and 2*bx+2 along x and so on. With an odd number of
+// points along an axis the last blocks are only one point thick there, each of these shapes has its own inverse.
+class BlockInverse {
+public:
+	static constexpr std::size_t points = 8; // points of a block
+	static constexpr std::size_t shapes = 8;
+	static constexpr std::size_t tableSize = shapes * points * points;
+
+	// Position of the point x0+dx, y0+dy, z0+dz within its block
+	static constexpr std::size_t local(std::size_t dx, std::size_t dy, std::size_t dz)
+	{
+		return (dx * 2 + dy) * 2 + dz;
+	}
+
+	// Shape of a block that is one point thick along the given axes
+	static constexpr std::size_t shape(bool thinX, bool thinY, bool thinZ)
+	{
+		return (thinX ? 4 : 0) + (thinY ? 2 : 0) + (thinZ ? 1 : 0);
+	}
+
+	// Row-major inverses of all shapes, inverse i of shape s starts at (s * points + i) * points.
+	// Rows and columns of points outside a thin block are the identity, so their correction stays 0 as long as
+	// the residual there is 0.
+	static std::vector<double> build(const Stencil27& op);
+};
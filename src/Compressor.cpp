@@ -0,0 +1,475 @@
+#include "Compressor.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+	constexpr char magic[4] = { 'G', 'S', 'Z', '1' };
+
+	template<class T>
+	void put(std::vector<std::uint8_t>& out, T value)
+	{
+		const std::size_t pos = out.size();
+		out.resize(pos + sizeof(T));
+		std::memcpy(out.data() + pos, &value, sizeof(T));
+	}
+
+	// Reads consecutive values from a byte range, throws if it ends early
+	class Reader {
+	public:
+		Reader(const std::uint8_t* begin, std::size_t length)
+			: data(begin), size(length)
+		{
+		}
+
+		template<class T>
+		T get()
+		{
+			T value;
+			std::memcpy(&value, take(sizeof(T)), sizeof(T));
+			return value;
+		}
+
+		const std::uint8_t* take(std::size_t bytes)
+		{
+			if (bytes > size - pos) {
+				throw std::runtime_error("Compressed data is truncated");
+			}
+			const std::uint8_t* current = data + pos;
+			pos += bytes;
+			return current;
+		}
+
+	private:
+		const std::uint8_t* data;
+		std::size_t size;
+		std::size_t pos = 0;
+	};
+
+	class BitWriter {
+	public:
+		void write(std::uint64_t code, unsigned length)
+		{
+			for (unsigned i = length; i > 0; i--) {
+				current = static_cast<std::uint8_t>((current << 1) | ((code >> (i - 1)) & 1));
+				if (++used == 8) {
+					bytes.push_back(current);
+					current = 0;
+					used = 0;
+				}
+			}
+		}
+
+		std::vector<std::uint8_t> finish()
+		{
+			if (used > 0) {
+				bytes.push_back(static_cast<std::uint8_t>(current << (8 - used)));
+				current = 0;
+				used = 0;
+			}
+			return std::move(bytes);
+		}
+
+	private:
+		std::vector<std::uint8_t> bytes;
+		std::uint8_t current = 0;
+		unsigned used = 0;
+	};
+
+	// Code lengths of a Huffman code for the given frequencies, 0 for unused symbols
+	std::vector<std::uint8_t> huffmanLengths(const std::vector<std::uint64_t>& freq)
+	{
+		struct Node {
+			std::uint64_t weight;
+			int left;
+			int right;
+		};
+		std::vector<Node> nodes;
+		using Entry = std::pair<std::uint64_t, int>;
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+		for (std::size_t s = 0; s < freq.size(); s++) {
+			if (freq[s] > 0) {
+				queue.push({ freq[s], static_cast<int>(nodes.size()) });
+				nodes.push_back({ freq[s], -1, static_cast<int>(s) });
+			}
+		}
+
+		std::vector<std::uint8_t> lengths(freq.size(), 0);
+		if (queue.size() == 1) {
+			lengths[nodes[0].right] = 1;
+			return lengths;
+		}
+		while (queue.size() > 1) {
+			const Entry a = queue.top();
+			queue.pop();
+			const Entry b = queue.top();
+			queue.pop();
+			queue.push({ a.first + b.first, static_cast<int>(nodes.size()) });
+			nodes.push_back({ a.first + b.first, a.second, b.second });
+		}
+
+		// leaves have left == -1 and their symbol in right
+		std::vector<std::pair<int, std::uint8_t>> stack{ { queue.top().second, 0 } };
+		while (!stack.empty()) {
+			const auto [node, depth] = stack.back();
+			stack.pop_back();
+			if (nodes[node].left < 0) {
+				lengths[nodes[node].right] = depth;
+			}else {
+				stack.push_back({ nodes[node].left, static_cast<std::uint8_t>(depth + 1) });
+				stack.push_back({ nodes[node].right, static_cast<std::uint8_t>(depth + 1) });
+			}
+		}
+		return lengths;
+	}
+
+	// Symbols ordered by code length and value, the canonical code assigns consecutive codes in this order
+	std::vector<std::uint32_t> canonicalOrder(const std::vector<std::pair<std::uint32_t, std::uint8_t>>& table)
+	{
+		std::vector<std::pair<std::uint32_t, std::uint8_t>> sorted = table;
+		std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+			return a.second != b.second ? a.second < b.second : a.first < b.first;
+		});
+		std::vector<std::uint32_t> order;
+		order.reserve(sorted.size());
+		for (const auto& entry : sorted) {
+			order.push_back(entry.first);
+		}
+		return order;
+	}
+
+	// Lorenzo prediction from the reconstructed values, points outside of the chunk count as 0
+	inline double predict(const double* recon, std::size_t i, std::size_t j, std::size_t k, std::size_t fast, std::size_t mid)
+	{
+		const std::size_t plane = fast * mid;
+		const std::size_t idx = (k * mid + j) * fast + i;
+		const double a = i > 0 ? recon[idx - 1] : 0.0;
+		const double b = j > 0 ? recon[idx - fast] : 0.0;
+		const double c = k > 0 ? recon[idx - plane] : 0.0;
+		const double ab = i > 0 && j > 0 ? recon[idx - 1 - fast] : 0.0;
+		const double ac = i > 0 && k > 0 ? recon[idx - 1 - plane] : 0.0;
+		const double bc = j > 0 && k > 0 ? recon[idx - fast - plane] : 0.0;
+		const double abc = i > 0 && j > 0 && k > 0 ? recon[idx - 1 - fast - plane] : 0.0;
+		return a + b + c - ab - ac - bc + abc;
+	}
+}
+
+std::vector<std::uint8_t> Compressor::compress(const Vector3& interleavedOrPlain, const Bound& bound, Stats& stats)
+{
+	// the chunks are predicted along the plain flat order, a copy of an interleaved field is plain
+	Vector3 copy;
+	const Vector3& field = interleavedOrPlain.isInterleaved() ? (copy = interleavedOrPlain) : interleavedOrPlain;
+
+	const Layout& layout = field.getLayout();
+	const std::array<std::size_t, 3> axes = layout.axisOrder();
+	const std::size_t fast = layout.dims[axes[0]];
+	const std::size_t mid = layout.dims[axes[1]];
+	const std::size_t slow = layout.dims[axes[2]];
+	const double* values = field.data();
+
+	double errorBound = bound.value;
+	if (bound.mode == Bound::RELATIVE && field.flatSize() > 0) {
+		const auto [minIt, maxIt] = std::minmax_element(values, values + field.flatSize());
+		errorBound = bound.value * (*maxIt - *minIt);
+		if (errorBound <= 0.0) {
+			// constant field
+			errorBound = bound.value;
+		}
+	}
+
+	const std::size_t planes = std::max<std::size_t>(1, chunkPoints / std::max<std::size_t>(1, fast * mid));
+	const std::size_t numChunks = (slow + planes - 1) / planes;
+
+	std::vector<std::vector<std::uint8_t>> chunks(numChunks);
+	double maxError = 0.0;
+#pragma omp parallel for schedule(dynamic) reduction(max:maxError)
+	for (std::int64_t c = 0; c < static_cast<std::int64_t>(numChunks); c++) {
+		const std::size_t first = c * planes;
+		const std::size_t count = std::min(planes, slow - first);
+		double chunkError = 0.0;
+		chunks[c] = compressChunk(values + first * fast * mid, count, fast, mid, errorBound, chunkError);
+		maxError = std::max(maxError, chunkError);
+	}
+
+	std::vector<std::uint8_t> out(std::begin(magic), std::end(magic));
+	put<std::uint32_t>(out, layout.order);
+	for (std::size_t axis = 0; axis < 3; axis++) {
+		put<std::uint64_t>(out, layout.dims[axis]);
+	}
+	put<double>(out, errorBound);
+	put<std::uint64_t>(out, planes);
+	put<std::uint64_t>(out, numChunks);
+	for (const auto& chunk : chunks) {
+		put<std::uint64_t>(out, chunk.size());
+	}
+	for (const auto& chunk : chunks) {
+		out.insert(out.end(), chunk.begin(), chunk.end());
+	}
+
+	stats.rawBytes = field.flatSize() * sizeof(double);
+	stats.compressedBytes = out.size();
+	stats.errorBound = errorBound;
+	stats.maxError = maxError;
+	return out;
+}
+
+Vector3 Compressor::decompress(const std::vector<std::uint8_t>& data)
+{
+	Reader reader(data.data(), data.size());
+	if (std::memcmp(reader.take(sizeof(magic)), magic, sizeof(magic)) != 0) {
+		throw std::runtime_error("Not a compressed field");
+	}
+	const std::uint32_t order = reader.get<std::uint32_t>();
+	if (order != Layout::X_FASTEST && order != Layout::Z_FASTEST) {
+		throw std::runtime_error("Compressed data has an invalid layout order");
+	}
+	std::array<std::size_t, 3> dims;
+	std::size_t points = 1;
+	for (std::size_t axis = 0; axis < 3; axis++) {
+		dims[axis] = reader.get<std::uint64_t>();
+		// corrupt dimensions must not wrap around to a small field
+		if (dims[axis] != 0 && points > std::numeric_limits<std::size_t>::max() / sizeof(double) / dims[axis]) {
+			throw std::runtime_error("Compressed data is corrupt");
+		}
+		points *= dims[axis];
+	}
+	const double errorBound = reader.get<double>();
+	const std::size_t planes = reader.get<std::uint64_t>();
+	const std::size_t numChunks = reader.get<std::uint64_t>();
+
+	Vector3 field(dims[0], dims[1], dims[2], static_cast<Layout::Order>(order));
+	const std::array<std::size_t, 3> axes = field.getLayout().axisOrder();
+	const std::size_t fast = dims[axes[0]];
+	const std::size_t mid = dims[axes[1]];
+	const std::size_t slow = dims[axes[2]];
+	if (planes == 0 || numChunks != (slow + planes - 1) / planes) {
+		throw std::runtime_error("Compressed data is corrupt");
+	}
+
+	std::vector<std::size_t> sizes(numChunks);
+	for (std::size_t c = 0; c < numChunks; c++) {
+		sizes[c] = reader.get<std::uint64_t>();
+	}
+	std::vector<const std::uint8_t*> starts(numChunks);
+	for (std::size_t c = 0; c < numChunks; c++) {
+		starts[c] = reader.take(sizes[c]);
+	}
+
+	double* values = field.data();
+	bool corrupt = false;
+#pragma omp parallel for schedule(dynamic)
+	for (std::int64_t c = 0; c < static_cast<std::int64_t>(numChunks); c++) {
+		const std::size_t first = c * planes;
+		try {
+			decompressChunk(starts[c], sizes[c], values + first * fast * mid, std::min(planes, slow - first), fast, mid, errorBound);
+		}
+		// nothing may leave the parallel region, corrupt sizes can also make the allocations fail
+		catch (const std::exception&) {
+#pragma omp atomic write
+			corrupt = true;
+		}
+	}
+	if (corrupt) {
+		throw std::runtime_error("Compressed data is corrupt");
+	}
+	return field;
+}
+
+bool Compressor::write(const Vector3& field, const Bound& bound, const std::string& file, Stats& stats)
+{
+	const std::vector<std::uint8_t> data = compress(field, bound, stats);
+	std::ofstream out(file, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(data.data()), data.size());
+	return static_cast<bool>(out);
+}
+
+bool Compressor::read(const std::string& file, Vector3& field)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in) {
+		return false;
+	}
+	const std::vector<std::uint8_t> data{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+	try {
+		field = decompress(data);
+	}
+	catch (const std::runtime_error&) {
+		return false;
+	}
+	// dimensions of a corrupt header too large to allocate
+	catch (const std::bad_alloc&) {
+		return false;
+	}
+	catch (const std::length_error&) {
+		return false;
+	}
+	return true;
+}
+
+// Chunk layout: points, number of used symbols, (symbol, code length) per symbol, size of the
+// bit stream, bit stream, number of unpredictable values, the unpredictable values
+std::vector<std::uint8_t> Compressor::compressChunk(const double* values, std::size_t planes, std::size_t fast, std::size_t mid, double errorBound, double& maxError)
+{
+	const std::size_t n = planes * mid * fast;
+	std::vector<double> recon(n);
+	std::vector<std::uint32_t> codes(n);
+	std::vector<double> unpredictable;
+	std::vector<std::uint64_t> freq(2 * radius, 0);
+
+	const double binWidth = 2.0 * errorBound;
+	std::size_t idx = 0;
+	for (std::size_t k = 0; k < planes; k++) {
+		for (std::size_t j = 0; j < mid; j++) {
+			for (std::size_t i = 0; i < fast; i++, idx++) {
+				const double value = values[idx];
+				const double prediction = predict(recon.data(), i, j, k, fast, mid);
+				const double bin = std::round((value - prediction) / binWidth);
+
+				std::uint32_t code = 0;
+				double reconstructed = value;
+				if (std::fabs(bin) < radius) {
+					const double candidate = prediction + bin * binWidth;
+					// the rounding of the reconstruction may still exceed the bound
+					if (std::fabs(candidate - value) <= errorBound) {
+						code = static_cast<std::uint32_t>(static_cast<std::int64_t>(bin) + radius);
+						reconstructed = candidate;
+					}
+				}
+				if (code == 0) {
+					unpredictable.push_back(value);
+				}
+
+				codes[idx] = code;
+				freq[code]++;
+				recon[idx] = reconstructed;
+				maxError = std::max(maxError, std::fabs(reconstructed - value));
+			}
+		}
+	}
+
+	const std::vector<std::uint8_t> lengths = huffmanLengths(freq);
+	std::vector<std::pair<std::uint32_t, std::uint8_t>> table;
+	for (std::size_t s = 0; s < lengths.size(); s++) {
+		if (lengths[s] > 0) {
+			table.push_back({ static_cast<std::uint32_t>(s), lengths[s] });
+		}
+	}
+
+	// canonical code, consecutive codes per length
+	std::vector<std::uint64_t> codeOf(2 * radius, 0);
+	std::uint64_t next = 0;
+	std::uint8_t length = 0;
+	for (std::uint32_t symbol : canonicalOrder(table)) {
+		next <<= lengths[symbol] - length;
+		length = lengths[symbol];
+		codeOf[symbol] = next++;
+	}
+
+	BitWriter bits;
+	for (std::uint32_t code : codes) {
+		bits.write(codeOf[code], lengths[code]);
+	}
+	const std::vector<std::uint8_t> stream = bits.finish();
+
+	std::vector<std::uint8_t> out;
+	put<std::uint64_t>(out, n);
+	put<std::uint32_t>(out, static_cast<std::uint32_t>(table.size()));
+	for (const auto& [symbol, symbolLength] : table) {
+		put<std::uint16_t>(out, static_cast<std::uint16_t>(symbol));
+		put<std::uint8_t>(out, symbolLength);
+	}
+	put<std::uint64_t>(out, stream.size());
+	out.insert(out.end(), stream.begin(), stream.end());
+	put<std::uint64_t>(out, unpredictable.size());
+	for (double value : unpredictable) {
+		put<double>(out, value);
+	}
+	return out;
+}
+
+void Compressor::decompressChunk(const std::uint8_t* data, std::size_t size, double* values, std::size_t planes, std::size_t fast, std::size_t mid, double errorBound)
+{
+	Reader reader(data, size);
+	const std::size_t n = reader.get<std::uint64_t>();
+	if (n != planes * mid * fast) {
+		throw std::runtime_error("Compressed chunk has the wrong size");
+	}
+
+	const std::uint32_t numSymbols = reader.get<std::uint32_t>();
+	std::vector<std::pair<std::uint32_t, std::uint8_t>> table(numSymbols);
+	std::uint8_t maxLength = 0;
+	for (auto& entry : table) {
+		entry.first = reader.get<std::uint16_t>();
+		entry.second = reader.get<std::uint8_t>();
+		if (entry.second == 0 || entry.second > 64) {
+			throw std::runtime_error("Invalid code length");
+		}
+		maxLength = std::max(maxLength, entry.second);
+	}
+
+	// first canonical code and first symbol of every length
+	const std::vector<std::uint32_t> order = canonicalOrder(table);
+	std::vector<std::size_t> count(maxLength + 1, 0);
+	for (const auto& entry : table) {
+		count[entry.second]++;
+	}
+	std::vector<std::uint64_t> firstCode(maxLength + 1, 0);
+	std::vector<std::size_t> firstSymbol(maxLength + 1, 0);
+	std::uint64_t code = 0;
+	std::size_t symbolIndex = 0;
+	for (std::size_t len = 1; len <= maxLength; len++) {
+		firstCode[len] = code;
+		firstSymbol[len] = symbolIndex;
+		code = (code + count[len]) << 1;
+		symbolIndex += count[len];
+	}
+
+	const std::size_t streamSize = reader.get<std::uint64_t>();
+	const std::uint8_t* stream = reader.take(streamSize);
+	const std::size_t numUnpredictable = reader.get<std::uint64_t>();
+	const std::uint8_t* unpredictable = reader.take(numUnpredictable * sizeof(double));
+
+	const double binWidth = 2.0 * errorBound;
+	std::size_t bitPos = 0;
+	std::size_t unpredictableIdx = 0;
+	std::size_t idx = 0;
+	for (std::size_t k = 0; k < planes; k++) {
+		for (std::size_t j = 0; j < mid; j++) {
+			for (std::size_t i = 0; i < fast; i++, idx++) {
+				std::uint64_t current = 0;
+				std::size_t len = 0;
+				std::uint32_t symbol = 0;
+				while (true) {
+					if (++len > maxLength || bitPos >= streamSize * 8) {
+						throw std::runtime_error("Invalid bit stream");
+					}
+					current = (current << 1) | ((stream[bitPos / 8] >> (7 - bitPos % 8)) & 1);
+					bitPos++;
+					if (current - firstCode[len] < count[len]) {
+						symbol = order[firstSymbol[len] + (current - firstCode[len])];
+						break;
+					}
+				}
+
+				if (symbol == 0) {
+					if (unpredictableIdx == numUnpredictable) {
+						throw std::runtime_error("Missing unpredictable value");
+					}
+					std::memcpy(&values[idx], unpredictable + unpredictableIdx * sizeof(double), sizeof(double));
+					unpredictableIdx++;
+				}else {
+					const double bin = static_cast<double>(static_cast<std::int64_t>(symbol) - radius);
+					values[idx] = predict(values, i, j, k, fast, mid) + bin * binWidth;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "cpu/Vector3.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Error-bounded lossy compression of fields (SZ-like). Every value is predicted from its already
+// reconstructed neighbours with the 3D Lorenzo predictor, the difference is quantized to bins of
+// twice the error bound and the bin numbers are Huffman coded. Values that can't be predicted
+// within the bound are stored exactly. The field is split into chunks of planes along the slowest
+// axis of its layout, each chunk is predicted and coded on its own, so they run in parallel.
+// The data keeps the layout of the field and is read back into the same layout.
+class Compressor {
+public:
+	struct Bound {
+		enum Mode {
+			ABSOLUTE,
+			RELATIVE // relative to the value range of the field
+		};
+		Mode mode = RELATIVE;
+		double value = 1e-6;
+	};
+
+	struct Stats {
+		std::size_t rawBytes = 0;
+		std::size_t compressedBytes = 0;
+		double errorBound = 0.0; // absolute
+		double maxError = 0.0; // largest error of the reconstructed values
+
+		double ratio() const
+		{
+			return compressedBytes > 0 ? static_cast<double>(rawBytes) / compressedBytes : 0.0;
+		}
+	};
+
+	static std::vector<std::uint8_t> compress(const Vector3& field, const Bound& bound, Stats& stats);
+	static Vector3 decompress(const std::vector<std::uint8_t>& data);
+
+	// Returns false if the file can't be written or read, or doesn't hold a valid field
+	static bool write(const Vector3& field, const Bound& bound, const std::string& file, Stats& stats);
+	static bool read(const std::string& file, Vector3& field);
+
+private:
+	// Points per chunk, the last chunk may be smaller
+	static constexpr std::size_t chunkPoints = std::size_t(1) << 20;
+	// Quantization bins on each side of the prediction, bin 0 marks an unpredictable value
+	static constexpr std::int64_t radius = 32768;
+
+	static std::vector<std::uint8_t> compressChunk(const double* values, std::size_t planes, std::size_t fast, std::size_t mid, double errorBound, double& maxError);
+	static void decompressChunk(const std::uint8_t* data, std::size_t size, double* values, std::size_t planes, std::size_t fast, std::size_t mid, double errorBound);
+};
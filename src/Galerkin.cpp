@@ -0,0 +1,92 @@
+#include "Galerkin.h"
+#include <assert.h>
+#include <math.h>
+
+namespace {
+	// Scratch grid around a single coarse point, large enough for the support of R*A*P
+	constexpr int radius = 4;
+	constexpr int width = 2 * radius + 1;
+
+	std::size_t scratchIndex(int x, int y, int z)
+	{
+		return ((x + radius) * width + (y + radius)) * width + (z + radius);
+	}
+}
+
+Stencil27 Galerkin::scaledStencil(const Stencil& stencil, double h)
+{
+	Stencil27 op;
+	for (std::size_t i = 0; i < stencil.values.size(); i++) {
+		assert(abs(stencil.getXOffset(i)) <= 1 && abs(stencil.getYOffset(i)) <= 1 && abs(stencil.getZOffset(i)) <= 1);
+		op.values[Stencil27::index(stencil.getXOffset(i), stencil.getYOffset(i), stencil.getZOffset(i))] += stencil.values[i] / (h * h);
+	}
+	return op;
+}
+
+std::vector<Stencil27> Galerkin::buildOperators(const Stencil& stencil, double h, std::size_t numLevels)
+{
+	std::vector<Stencil27> ops(numLevels);
+	ops[0] = scaledStencil(stencil, h);
+
+	for (std::size_t level = 1; level < numLevels; level++) {
+		ops[level] = coarsen(ops[level - 1]);
+	}
+
+	return ops;
+}
+
+// Applies the fine operator to the interpolated unit vector of one coarse point and restricts the result
+Stencil27 Galerkin::coarsen(const Stencil27& fine)
+{
+	// P * e_0
+	std::vector<double> p(width * width * width, 0.0);
+	for (int x = -2; x <= 2; x++) {
+		for (int y = -2; y <= 2; y++) {
+			for (int z = -2; z <= 2; z++) {
+				p[scratchIndex(x, y, z)] = (1.0 - abs(x) / 2.0) * (1.0 - abs(y) / 2.0) * (1.0 - abs(z) / 2.0);
+			}
+		}
+	}
+
+	// A * P * e_0
+	std::vector<double> ap(width * width * width, 0.0);
+	for (int x = -3; x <= 3; x++) {
+		for (int y = -3; y <= 3; y++) {
+			for (int z = -3; z <= 3; z++) {
+				double sum = 0.0;
+				for (std::size_t i = 0; i < fine.values.size(); i++) {
+					if (fine.values[i] != 0.0) {
+						sum += fine.values[i] * p[scratchIndex(x + Stencil27::getXOffset(i), y + Stencil27::getYOffset(i), z + Stencil27::getZOffset(i))];
+					}
+				}
+				ap[scratchIndex(x, y, z)] = sum;
+			}
+		}
+	}
+
+	// R * A * P * e_0 at the neighbouring coarse points, same weights as CpuSolver::restrict
+	Stencil27 coarse;
+	for (std::size_t i = 0; i < coarse.values.size(); i++) {
+		const int xCenter = 2 * Stencil27::getXOffset(i);
+		const int yCenter = 2 * Stencil27::getYOffset(i);
+		const int zCenter = 2 * Stencil27::getZOffset(i);
+
+		double coarseValue = 0.0;
+		for (int ii = -1; ii < 2; ii++) {
+			for (int jj = -1; jj < 2; jj++) {
+				for (int kk = -1; kk < 2; kk++) {
+					double fac = 0.125 * ((2.0 - abs(ii)) / 2.0) * ((2.0 - abs(jj)) / 2.0) * ((2.0 - abs(kk)) / 2.0);
+					coarseValue += fac * ap[scratchIndex(xCenter + ii, yCenter + jj, zCenter + kk)];
+				}
+			}
+		}
+
+		// drop round off, so the kernels can skip the entry
+		if (fabs(coarseValue) < 1e-13 * fabs(fine.center())) {
+			coarseValue = 0.0;
+		}
+		coarse.values[i] = coarseValue;
+	}
+
+	return coarse;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "gridParams.h"
+#include <array>
+#include <vector>
+
+// Constant coefficient stencil reaching one point in every direction, already scaled by 1/h^2
+struct Stencil27 {
+	std::array<double, 27> values{};
+
+	static constexpr std::size_t index(int x, int y, int z)
+	{
+		return (x + 1) * 9 + (y + 1) * 3 + (z + 1);
+	}
+	static int getXOffset(std::size_t i)
+	{
+		return static_cast<int>(i / 9) - 1;
+	}
+	static int getYOffset(std::size_t i)
+	{
+		return static_cast<int>((i / 3) % 3) - 1;
+	}
+	static int getZOffset(std::size_t i)
+	{
+		return static_cast<int>(i % 3) - 1;
+	}
+
+	double center() const
+	{
+		return values[index(0, 0, 0)];
+	}
+};
+
+class Galerkin {
+public:
+	// Coarse grid operators R*A*P built with the full weighting restriction and the trilinear interpolation
+	// of the solvers. ops[0] is the fine stencil scaled by 1/h^2, ops[i] the operator of level i.
+	static std::vector<Stencil27> buildOperators(const Stencil& stencil, double h, std::size_t numLevels);
+	// The stencil scaled by 1/h^2, the operator of a level without Galerkin coarsening
+	static Stencil27 scaledStencil(const Stencil& stencil, double h);
+
+private:
+	static Stencil27 coarsen(const Stencil27& fine);
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <array>
+#include <cstddef>
+
+// Memory layout of a 3D field, shared by Vector3 on the host and SyclBuffer on the device.
+// Fields with the same layout have the same flat memory, so they can be handed between the CPU
+// code and the device as they are. The kernels index through the strides of their buffers.
+struct Layout {
+	enum Order {
+		X_FASTEST, // x is contiguous, z is the slowest axis
+		Z_FASTEST // z is contiguous, x is the slowest axis
+	};
+
+#ifdef GPUSOLVE_CPU
+	// the CPU loops run along z innermost
+	static constexpr Order defaultOrder = Z_FASTEST;
+#else
+	// neighbouring work items differ in x
+	static constexpr Order defaultOrder = X_FASTEST;
+#endif
+
+	// Interleaved fields store blocks of this many consecutive points of every field in turn
+	// (small-block SoA), a block of doubles is one cache line
+	static constexpr std::size_t block = 8;
+
+	std::array<std::size_t, 3> dims{}; // points along x, y and z
+	std::array<std::size_t, 3> strides{};
+	Order order = defaultOrder;
+	std::size_t fields = 1; // fields interleaved in the same memory, 1 for a plain field
+
+	Layout() = default;
+	Layout(std::size_t x, std::size_t y, std::size_t z, Order memoryOrder)
+		: dims{ x, y, z }, order(memoryOrder)
+	{
+		const std::array<std::size_t, 3> axes = axisOrder();
+		strides[axes[0]] = 1;
+		strides[axes[1]] = dims[axes[0]];
+		strides[axes[2]] = dims[axes[0]] * dims[axes[1]];
+	}
+
+	// Axes from the contiguous one to the slowest one
+	std::array<std::size_t, 3> axisOrder() const
+	{
+		if (order == Z_FASTEST) {
+			return { 2, 1, 0 };
+		}
+		return { 0, 1, 2 };
+	}
+
+	// Same points, interleaved with the given number of fields
+	Layout interleaved(std::size_t numFields) const
+	{
+		Layout layout = *this;
+		layout.fields = numFields;
+		return layout;
+	}
+
+	std::size_t index(std::size_t x, std::size_t y, std::size_t z) const
+	{
+		return element(x * strides[0] + y * strides[1] + z * strides[2]);
+	}
+
+	// Offset of the point with the plain flat index p from the first value of the field
+	std::size_t element(std::size_t p) const
+	{
+		if (fields == 1) {
+			return p;
+		}
+		return (p / block) * (block * fields) + p % block;
+	}
+
+	std::size_t size() const
+	{
+		return dims[0] * dims[1] * dims[2];
+	}
+
+	// Values of the memory all interleaved fields share
+	std::size_t storageSize() const
+	{
+		if (fields == 1) {
+			return size();
+		}
+		return (size() + block - 1) / block * block * fields;
+	}
+
+	// Same points in the same order, the fields may be interleaved differently
+	bool operator==(const Layout& rhs) const
+	{
+		return dims == rhs.dims && order == rhs.order;
+	}
+	bool operator!=(const Layout& rhs) const
+	{
+		return !(*this == rhs);
+	}
+};
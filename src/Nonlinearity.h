@@ -0,0 +1,45 @@
+#pragma once
+#include <cmath>
+
+// Reaction term N(v) of the non-linear equation -Laplace(u) + N(u) = f.
+// A policy provides N(v) and its derivative N'(v). The same templates run on doubles in the CPU loops
+// and on double1 inside the sycl-gtx kernels, so the term is inlined into both and adds no calls.
+// gamma is the gamma of the config.
+
+// N(v) = gamma * v * e^v, the term of tutorial_multigrid.pdf, page 102, Formula 6.13
+struct ExpNonlinearity {
+	template<class T>
+	static auto value(double gamma, const T& v)
+	{
+		using std::exp;
+		return gamma * v * exp(v);
+	}
+
+	template<class T>
+	static auto derivative(double gamma, const T& v)
+	{
+		using std::exp;
+		return gamma * (1 + v) * exp(v);
+	}
+};
+
+// N(v) = gamma * v^3
+struct CubicNonlinearity {
+	template<class T>
+	static auto value(double gamma, const T& v)
+	{
+		return gamma * v * v * v;
+	}
+
+	template<class T>
+	static auto derivative(double gamma, const T& v)
+	{
+		return 3.0 * gamma * v * v;
+	}
+};
+
+// Chosen at compile time with the GPUSOLVE_NONLINEARITY CMake option
+#ifndef GPUSOLVE_NONLINEARITY
+#define GPUSOLVE_NONLINEARITY ExpNonlinearity
+#endif
+using Nonlinearity = GPUSOLVE_NONLINEARITY;
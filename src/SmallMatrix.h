@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+// Dense row-major n x n matrix for tiny systems solved on the host
+class SmallMatrix {
+public:
+	explicit SmallMatrix(std::size_t dim)
+		: n(dim), values(dim * dim, 0.0)
+	{}
+
+	double& operator()(std::size_t row, std::size_t col)
+	{
+		return values[row * n + col];
+	}
+	double operator()(std::size_t row, std::size_t col) const
+	{
+		return values[row * n + col];
+	}
+
+	std::size_t size() const
+	{
+		return n;
+	}
+
+	// Solves A x = b with partial pivoting. Returns false if the matrix is singular, b is left unspecified then
+	bool solve(std::vector<double>& b) const
+	{
+		std::vector<double> a = values;
+
+		for (std::size_t col = 0; col < n; col++) {
+			std::size_t pivot = col;
+			for (std::size_t row = col + 1; row < n; row++) {
+				if (std::fabs(a[row * n + col]) > std::fabs(a[pivot * n + col])) {
+					pivot = row;
+				}
+			}
+			if (a[pivot * n + col] == 0.0) {
+				return false;
+			}
+			if (pivot != col) {
+				for (std::size_t k = 0; k < n; k++) {
+					std::swap(a[col * n + k], a[pivot * n + k]);
+				}
+				std::swap(b[col], b[pivot]);
+			}
+
+			for (std::size_t row = col + 1; row < n; row++) {
+				const double fac = a[row * n + col] / a[col * n + col];
+				for (std::size_t k = col; k < n; k++) {
+					a[row * n + k] -= fac * a[col * n + k];
+				}
+				b[row] -= fac * b[col];
+			}
+		}
+
+		for (std::size_t row = n; row-- > 0;) {
+			double sum = b[row];
+			for (std::size_t k = row + 1; k < n; k++) {
+				sum -= a[row * n + k] * b[k];
+			}
+			b[row] = sum / a[row * n + row];
+		}
+
+		return true;
+	}
+
+private:
+	std::size_t n;
+	std::vector<double> values;
+};
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstddef>
+
+// Summary of a solver run, used by drivers that chain several solves
+struct SolveResult {
+    std::size_t iterations = 0;
+    double initialResidual = 0.0;
+    double residual = 0.0;
+    bool converged = false;
+};
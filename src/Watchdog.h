@@ -0,0 +1,126 @@
+#pragma once
+#include "gridParams.h"
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// Divergence watchdog of one solve, fed with the residual norms the solvers compute anyway.
+// A residual diverges if it isn't finite or grew by more than GridParams::watchdogGrowth over the best one
+// so far. The solver then rolls back to the iterate with the best residual and retries with safer settings.
+// The settings are restored when the watchdog goes out of scope. A Newton watchdog keeps the settings its
+// inner multigrid solves backed off to until the Newton iterations end, so every step doesn't diverge again.
+class Watchdog {
+public:
+	enum Kind {
+		CYCLES, // multigrid cycles: half omega and one more pre- and post-smoothing step per retry
+		NEWTON // Newton iterations: half the damping of the corrections per retry
+	};
+
+	enum Verdict {
+		IMPROVED, // new best residual, the solver saves the iterate
+		STALLED, // no improvement, but no divergence either
+		DIVERGED
+	};
+
+	Watchdog(GridParams& params, Kind watchedKind, double initialResidual)
+		: grid(params), kind(watchedKind), best(initialResidual),
+		restores(watchedKind == NEWTON || params.watchdogRestore), outerRestore(params.watchdogRestore),
+		omega(params.omega), preSmoothing(params.preSmoothing), postSmoothing(params.postSmoothing), backOffs(params.watchdogBackOffs)
+	{
+		if (kind == NEWTON) {
+			grid.watchdogRestore = false;
+		}
+	}
+
+	~Watchdog()
+	{
+		if (restores) {
+			grid.omega = omega;
+			grid.preSmoothing = preSmoothing;
+			grid.postSmoothing = postSmoothing;
+			grid.watchdogBackOffs = backOffs;
+		}
+		grid.watchdogRestore = outerRestore;
+	}
+
+	Watchdog(const Watchdog&) = delete;
+	Watchdog& operator=(const Watchdog&) = delete;
+
+	bool enabled() const
+	{
+		return grid.watchdog > 0;
+	}
+
+	Verdict check(double res)
+	{
+		if (!std::isfinite(res) || res > grid.watchdogGrowth * best) {
+			return DIVERGED;
+		}
+		if (res < best) {
+			best = res;
+			return IMPROVED;
+		}
+		return STALLED;
+	}
+
+	// Residual of the iterate the solver rolls back to
+	double bestResidual() const
+	{
+		return best;
+	}
+
+	// Fraction of the Newton corrections that is applied
+	double damping() const
+	{
+		return newtonDamping;
+	}
+
+	std::size_t retries() const
+	{
+		return retry;
+	}
+
+	// Called after a diverged residual, the solver has rolled back already.
+	// Makes the settings safer for the next attempt, returns false once all retries are used up.
+	bool backOff(double res)
+	{
+		const char* name = kind == NEWTON ? "Newton iteration" : "multigrid cycle";
+		std::cout << "watchdog: " << name << " diverged with residual " << res << ", rolled back to residual " << best;
+		if (retry == grid.watchdog) {
+			std::cout << ", giving up after " << retry << " retries\n";
+			return false;
+		}
+		retry++;
+
+		if (kind == NEWTON) {
+			std::cout << ", damping " << newtonDamping;
+			newtonDamping *= 0.5;
+			std::cout << " -> " << newtonDamping;
+		}else {
+			std::cout << ", omega " << grid.omega << " -> " << 0.5 * grid.omega << ", smoothing " << grid.preSmoothing << '/' << grid.postSmoothing
+				<< " -> " << grid.preSmoothing + 1 << '/' << grid.postSmoothing + 1;
+			grid.omega *= 0.5;
+			grid.preSmoothing++;
+			grid.postSmoothing++;
+			grid.watchdogBackOffs++;
+		}
+		std::cout << " (retry " << retry << " of " << grid.watchdog << ")\n";
+		return true;
+	}
+
+private:
+	GridParams& grid;
+	Kind kind;
+	double best;
+	double newtonDamping = 1.0;
+	std::size_t retry = 0;
+	bool restores; // restore the settings at the end, false for inner solves of Newton
+	bool outerRestore;
+
+	// settings at the start of the solve
+	double omega;
+	std::size_t preSmoothing;
+	std::size_t postSmoothing;
+	std::size_t backOffs;
+};
@@ -0,0 +1,256 @@
+#include "AdditiveSolver.h"
+#include "CpuSolver.h"
+#include "Affinity.h"
+#include "Operator.h"
+#include "../Timer.h"
+#include <assert.h>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+namespace {
+	// The teams run inside the parallel loop over the levels, restores the previous setting when it goes out of scope
+	class NestedParallelism {
+	public:
+		NestedParallelism()
+		{
+#ifdef _OPENMP
+			saved = omp_get_max_active_levels();
+			omp_set_max_active_levels(2);
+#endif
+		}
+		~NestedParallelism()
+		{
+#ifdef _OPENMP
+			omp_set_max_active_levels(saved);
+#endif
+		}
+		NestedParallelism(const NestedParallelism&) = delete;
+		NestedParallelism& operator=(const NestedParallelism&) = delete;
+
+	private:
+		int saved = 1;
+	};
+}
+
+SolveResult AdditiveSolver::solve(CpuGridData& grid)
+{
+	assert(grid.mode == GridParams::LINEAR);
+
+	SolveResult result;
+	const std::vector<Team> teams = makeTeams(grid);
+	const NestedParallelism nested;
+
+	double initialResidual = residual(grid);
+	result.initialResidual = initialResidual;
+	result.residual = initialResidual;
+	if (grid.printProgress) {
+		std::cout << "Inital residual: " << initialResidual << '\n';
+		std::cout << "Threads per team of levels:";
+		for (const Team& team : teams) {
+			std::cout << ' ' << team.first;
+			if (team.last != team.first) {
+				std::cout << '-' << team.last;
+			}
+			std::cout << ':' << team.threads;
+		}
+		std::cout << '\n';
+	}
+
+	const double refResidual = grid.referenceResidual > 0.0 ? grid.referenceResidual : initialResidual;
+	const double stopResidual = refResidual / (1.0 / grid.tol);
+
+	for (std::size_t i = 0; i < grid.maxiter; i++) {
+		if (grid.printProgress) {
+			Timer::start();
+		}
+
+		double res = cycle(grid, teams);
+		result.iterations = i + 1;
+		result.residual = res;
+
+		if (grid.printProgress) {
+			std::cout << "iter: " << i << " residual: " << res << ' ';
+			Timer::stop();
+		}
+
+		if (res <= stopResidual) {
+			result.converged = true;
+			return result;
+		}
+		if (!std::isfinite(res)) {
+			// diverged, further cycles can't recover
+			return result;
+		}
+	}
+
+	return result;
+}
+
+// Splits the threads over the levels in proportion to the points they sweep, starting with the finest level.
+// The first level whose share rounds to 0, and all coarser ones, share a team of the remaining threads.
+// One thread is always kept for the levels that follow, so the teams never add up to more than are available.
+std::vector<AdditiveSolver::Team> AdditiveSolver::makeTeams(const CpuGridData& grid)
+{
+	const std::size_t coarsest = grid.numLevels() - 1;
+	std::vector<double> work(grid.numLevels(), 0.0);
+	double total = 0.0;
+	for (std::size_t i = 0; i < grid.numLevels(); i++) {
+		const double points = static_cast<double>(grid.getLevel(i).v.flatSize());
+		if (i == coarsest) {
+			work[i] = points * (grid.preSmoothing + grid.postSmoothing);
+		}else {
+			work[i] = points * grid.postSmoothing + grid.getLevel(i + 1).v.flatSize() * grid.preSmoothing;
+		}
+		total += work[i];
+	}
+
+	const int available = Affinity::availableThreads();
+	int remaining = available;
+	std::vector<Team> teams;
+	for (std::size_t i = 0; i < grid.numLevels(); i++) {
+		const int reserve = i == coarsest ? 0 : 1;
+		int share = static_cast<int>(std::lround(available * work[i] / total));
+		share = std::min(std::min(share, Affinity::levelThreads(grid.getLevel(i).v.flatSize())), remaining - reserve);
+		if (share < 1) {
+			teams.push_back(Team{ i, coarsest, std::max(1, remaining) });
+			break;
+		}
+		teams.push_back(Team{ i, i, share });
+		remaining -= share;
+	}
+	return teams;
+}
+
+double AdditiveSolver::cycle(CpuGridData& grid, const std::vector<Team>& teams)
+{
+	const std::size_t coarsest = grid.numLevels() - 1;
+
+	// right hand side of every level, r on the finest one
+	for (std::size_t i = 0; i < coarsest; i++) {
+		CpuSolver::restrict(i == 0 ? grid.getLevel(i).r : grid.getLevel(i).f, grid.getLevel(i + 1).f);
+	}
+
+	// one team per outer thread, the inner loops run with the threads of the team
+#pragma omp parallel for num_threads(static_cast<int>(teams.size())) schedule(static,1)
+	for (std::int64_t t = 0; t < static_cast<std::int64_t>(teams.size()); t++) {
+		for (std::size_t i = teams[t].first; i <= teams[t].last; i++) {
+			correction(grid, i, teams[t].threads);
+		}
+	}
+
+	// sum up the corrections from the coarsest level to the finest
+	for (std::size_t i = coarsest; i > 0; i--) {
+		const Vector3& coarse = grid.getLevel(i).v;
+		CpuGridData::LevelData& level = grid.getLevel(i - 1);
+		Vector3& x = i - 1 == 0 ? level.restV : level.v;
+
+#pragma omp parallel for num_threads(Affinity::levelThreads(level.v.flatSize())) schedule(static,8)
+		for (std::int64_t x0 = 1; x0 < level.levelDim[0] + 1; x0++) {
+			for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+					x.set(x0, y, z, x.get(x0, y, z) + interpolateAt(coarse, x0, y, z));
+				}
+			}
+		}
+	}
+
+	CpuGridData::LevelData& fine = grid.getLevel(0);
+	fine.v += fine.restV;
+
+	return residual(grid);
+}
+
+void AdditiveSolver::correction(CpuGridData& grid, std::size_t levelNum, int threads)
+{
+	CpuGridData::LevelData& level = grid.getLevel(levelNum);
+	const bool finest = levelNum == 0;
+	const Vector3& rhs = finest ? level.r : level.f;
+	Vector3& x = finest ? level.restV : level.v;
+	Vector3& res = finest ? level.newtonV : level.r;
+
+	if (levelNum == grid.numLevels() - 1) {
+		x.fill(0.0);
+		relax(grid, levelNum, x, rhs, res, grid.preSmoothing + grid.postSmoothing, threads);
+		return;
+	}
+
+	// guess of the coarser levels
+	CpuGridData::LevelData& next = grid.getLevel(levelNum + 1);
+	next.restV.fill(0.0);
+	relax(grid, levelNum + 1, next.restV, next.f, next.newtonV, grid.preSmoothing, threads);
+
+#pragma omp parallel for num_threads(threads) schedule(static,8)
+	for (std::int64_t x0 = 1; x0 < level.levelDim[0] + 1; x0++) {
+		for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
+			for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+				x.set(x0, y, z, interpolateAt(next.restV, x0, y, z));
+			}
+		}
+	}
+
+	relax(grid, levelNum, x, rhs, res, grid.postSmoothing, threads);
+
+	// only keep what the coarser levels don't see
+#pragma omp parallel for num_threads(threads) schedule(static,8)
+	for (std::int64_t x0 = 1; x0 < level.levelDim[0] + 1; x0++) {
+		for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
+			for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+				x.set(x0, y, z, x.get(x0, y, z) - interpolateAt(next.restV, x0, y, z));
+			}
+		}
+	}
+}
+
+void AdditiveSolver::relax(CpuGridData& grid, std::size_t levelNum, Vector3& x, const Vector3& rhs, Vector3& res, std::size_t sweeps, int threads)
+{
+	CpuGridData::LevelData& level = grid.getLevel(levelNum);
+	const bool useGalerkin = grid.galerkin && levelNum > 0;
+	const double preFac = useGalerkin ? level.op.center() : grid.stencil.values[0] / (level.h * level.h);
+	const double alpha = 1.0 / preFac; // stencil center
+
+	for (std::size_t i = 0; i < sweeps; i++) {
+
+#pragma omp parallel for num_threads(threads) schedule(static,8)
+		for (std::int64_t x0 = 1; x0 < level.levelDim[0] + 1; x0++) {
+			for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+					res.set(x0, y, z, rhs.get(x0, y, z) - applyOperator(grid, level, useGalerkin, x, x0, y, z));
+				}
+			}
+		}
+
+#pragma omp parallel for num_threads(threads) schedule(static,8)
+		for (std::int64_t x0 = 1; x0 < level.levelDim[0] + 1; x0++) {
+			for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+					x.set(x0, y, z, x.get(x0, y, z) + grid.omega * (alpha * res.get(x0, y, z)));
+				}
+			}
+		}
+	}
+}
+
+// r = f - A(v) on the finest level, returns its norm
+double AdditiveSolver::residual(CpuGridData& grid)
+{
+	CpuGridData::LevelData& level = grid.getLevel(0);
+
+	double res = 0.0;
+
+#pragma omp parallel for num_threads(Affinity::levelThreads(level.v.flatSize())) schedule(static,8) reduction(+:res)
+	for (std::int64_t x = 1; x < level.levelDim[0] + 1; x++) {
+		for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
+			for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+				double r = level.f.get(x, y, z) - applyOperator(grid, level, false, level.v, x, y, z);
+				level.r.set(x, y, z, r);
+				res += r * r;
+			}
+		}
+	}
+
+	return sqrt(res);
+}
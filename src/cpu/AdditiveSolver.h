@@ -0,0 +1,34 @@
+#pragma once
+#include "CpuGridData.h"
+#include "../SolveResult.h"
+#include <vector>
+
+// Additive multigrid (AFACx). The residual is restricted to all levels first, then every level computes
+// its correction at the same time: a few Jacobi sweeps on the next coarser level give a guess y, Jacobi
+// sweeps on the level itself start from P(y), and the correction is the result minus P(y), so only the
+// part the coarser levels can't represent is left. The coarsest level just smooths. The corrections are
+// interpolated and summed up to the finest level. The fine levels run on their own thread teams, sized by
+// their work, the coarse levels that get less than a thread share one, so they don't wait for the fine ones.
+// Linear mode with the Jacobi smoother. Per level the rhs is in f and the correction in v, r is scratch.
+// The finest level keeps its rhs in r, the correction in restV and uses newtonV as scratch. The guess
+// y of a level lives in restV of the next coarser level, with newtonV of that level as scratch.
+class AdditiveSolver {
+public:
+	static SolveResult solve(CpuGridData& grid);
+
+private:
+	// Thread team computing the corrections of the levels first to last, one after the other
+	struct Team {
+		std::size_t first;
+		std::size_t last;
+		int threads;
+	};
+
+	// Runs one cycle from the residual in r of the finest level, returns the new residual norm
+	static double cycle(CpuGridData& grid, const std::vector<Team>& teams);
+	static void correction(CpuGridData& grid, std::size_t level, int threads);
+	// x += omega * (rhs - A(x)) / diagonal, res holds the residual
+	static void relax(CpuGridData& grid, std::size_t level, Vector3& x, const Vector3& rhs, Vector3& res, std::size_t sweeps, int threads);
+	static double residual(CpuGridData& grid);
+	static std::vector<Team> makeTeams(const CpuGridData& grid);
+};
@@ -0,0 +1,237 @@
+#include "Affinity.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <tuple>
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+#ifdef __linux__
+	#include <sched.h>
+#endif
+
+int Affinity::maxThreads = 0;
+
+namespace {
+	int readInt(const std::string& path, int fallback)
+	{
+		std::ifstream file(path);
+		int value;
+		if (file >> value) {
+			return value;
+		}
+		return fallback;
+	}
+
+	const char* placementName(GridParams::Placement placement)
+	{
+		switch (placement) {
+		case GridParams::COMPACT: return "compact";
+		case GridParams::SCATTER: return "scatter";
+		case GridParams::CORE: return "core";
+		case GridParams::NUMA: return "numa";
+		default: return "none";
+		}
+	}
+}
+
+void Affinity::apply(GridParams::Placement placement, std::size_t threads)
+{
+#ifdef _OPENMP
+	if (placement == GridParams::OS) {
+		if (threads > 0) {
+			omp_set_num_threads(static_cast<int>(threads));
+		}
+		maxThreads = omp_get_max_threads();
+		std::cout << "Using " << maxThreads << " threads, placed by the OpenMP runtime\n";
+		return;
+	}
+
+#ifdef __linux__
+	const std::vector<Cpu> cpus = topology();
+	std::vector<std::vector<int>> slots = placeThreads(placement, cpus);
+	if (slots.empty()) {
+		std::cerr << "Could not read the CPU topology, threads are placed by the OpenMP runtime\n";
+		maxThreads = omp_get_max_threads();
+		return;
+	}
+	if (threads > slots.size()) {
+		std::cerr << "The " << placementName(placement) << " placement has room for " << slots.size() << " threads, using that many\n";
+	}
+	if (threads > 0 && threads < slots.size()) {
+		slots.resize(threads);
+	}
+
+	// The team sizes of the levels may not change behind our back, otherwise threads would run unpinned
+	maxThreads = static_cast<int>(slots.size());
+	omp_set_dynamic(0);
+	omp_set_num_threads(maxThreads);
+
+	bool pinned = true;
+#pragma omp parallel num_threads(maxThreads) reduction(&&:pinned)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int id : slots[omp_get_thread_num()]) {
+			CPU_SET(id, &set);
+		}
+		pinned = ::sched_setaffinity(0, sizeof(set), &set) == 0;
+	}
+
+	std::cout << "Thread placement " << placementName(placement) << ", " << maxThreads << " threads\n";
+	for (std::size_t i = 0; i < slots.size(); i++) {
+		const auto cpu = std::find_if(cpus.begin(), cpus.end(), [&](const Cpu& c) { return c.id == slots[i].front(); });
+		if (placement == GridParams::NUMA) {
+			std::cout << "thread " << i << ": node " << cpu->node << " (cpus " << cpuList(slots[i]) << ")\n";
+		}else {
+			std::cout << "thread " << i << ": cpu " << cpu->id << " (core " << cpu->core << ", package " << cpu->package << ", node " << cpu->node << ")\n";
+		}
+	}
+	if (!pinned) {
+		std::cerr << "Could not pin all threads\n";
+	}
+#else
+	std::cerr << "Thread placement is only supported on Linux, threads are placed by the OpenMP runtime\n";
+	if (threads > 0) {
+		omp_set_num_threads(static_cast<int>(threads));
+	}
+	maxThreads = omp_get_max_threads();
+#endif
+#else
+	if (placement != GridParams::OS || threads > 1) {
+		std::cerr << "Built without OpenMP, running on a single thread\n";
+	}
+	maxThreads = 1;
+#endif
+}
+
+int Affinity::levelThreads(std::size_t points)
+{
+	// Roughly a 16^3 block per thread, less work doesn't pay for the barrier at the end of the loop
+	constexpr std::size_t pointsPerThread = 4096;
+
+	const std::size_t wanted = std::max<std::size_t>(1, points / pointsPerThread);
+	return static_cast<int>(std::min<std::size_t>(wanted, availableThreads()));
+}
+
+int Affinity::availableThreads()
+{
+	int available = maxThreads;
+#ifdef _OPENMP
+	if (available == 0) {
+		available = omp_get_max_threads();
+	}
+#endif
+	return std::max(available, 1);
+}
+
+std::vector<Affinity::Cpu> Affinity::topology()
+{
+	std::vector<Cpu> cpus;
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		return cpus;
+	}
+
+	for (int id = 0; id < CPU_SETSIZE; id++) {
+		if (!CPU_ISSET(id, &allowed)) {
+			continue;
+		}
+
+		const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+		Cpu cpu{ id, readInt(dir + "/topology/core_id", id), readInt(dir + "/topology/physical_package_id", 0), 0 };
+
+		// The NUMA node shows up as a nodeN link in the CPU's directory
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(dir, error)) {
+			const std::string name = entry.path().filename().string();
+			if (name.size() > 4 && name.compare(0, 4, "node") == 0 && std::isdigit(static_cast<unsigned char>(name[4]))) {
+				cpu.node = std::stoi(name.substr(4));
+			}
+		}
+		cpus.push_back(cpu);
+	}
+#endif
+	return cpus;
+}
+
+std::vector<std::vector<int>> Affinity::placeThreads(GridParams::Placement placement, const std::vector<Cpu>& cpus)
+{
+	// SMT rank of every CPU within its core, and the rank of its core within the NUMA node
+	std::map<std::pair<int, int>, std::vector<int>> cores; // (package, core) -> CPUs, ascending
+	for (const Cpu& cpu : cpus) {
+		cores[{ cpu.package, cpu.core }].push_back(cpu.id);
+	}
+	std::map<int, int> smtRank;
+	std::map<int, int> coreRank;
+	std::map<int, int> coresInNode;
+	for (const auto& core : cores) {
+		const int node = std::find_if(cpus.begin(), cpus.end(), [&](const Cpu& c) { return c.id == core.second.front(); })->node;
+		const int rank = coresInNode[node]++;
+		for (std::size_t i = 0; i < core.second.size(); i++) {
+			smtRank[core.second[i]] = static_cast<int>(i);
+			coreRank[core.second[i]] = rank;
+		}
+	}
+
+	std::vector<Cpu> order;
+	for (const Cpu& cpu : cpus) {
+		const bool onePerCore = placement == GridParams::CORE || placement == GridParams::NUMA;
+		if (!onePerCore || smtRank[cpu.id] == 0) {
+			order.push_back(cpu);
+		}
+	}
+
+	if (placement == GridParams::COMPACT || placement == GridParams::CORE) {
+		std::sort(order.begin(), order.end(), [&](const Cpu& a, const Cpu& b) {
+			return std::make_tuple(a.node, a.package, a.core, smtRank[a.id]) < std::make_tuple(b.node, b.package, b.core, smtRank[b.id]);
+		});
+	}else {
+		// round robin over the nodes, every core gets a thread before the SMT threads are used
+		std::sort(order.begin(), order.end(), [&](const Cpu& a, const Cpu& b) {
+			return std::make_tuple(smtRank[a.id], coreRank[a.id], a.node) < std::make_tuple(smtRank[b.id], coreRank[b.id], b.node);
+		});
+	}
+
+	std::vector<std::vector<int>> slots;
+	for (const Cpu& cpu : order) {
+		if (placement == GridParams::NUMA) {
+			std::vector<int> node;
+			for (const Cpu& other : cpus) {
+				if (other.node == cpu.node) {
+					node.push_back(other.id);
+				}
+			}
+			slots.push_back(node);
+		}else {
+			slots.push_back({ cpu.id });
+		}
+	}
+	return slots;
+}
+
+std::string Affinity::cpuList(const std::vector<int>& ids)
+{
+	// 0-3,8-11 style, like the lists in sysfs
+	std::string list;
+	for (std::size_t i = 0; i < ids.size(); i++) {
+		std::size_t last = i;
+		while (last + 1 < ids.size() && ids[last + 1] == ids[last] + 1) {
+			last++;
+		}
+		if (!list.empty()) {
+			list += ',';
+		}
+		list += std::to_string(ids[i]);
+		if (last > i) {
+			list += '-' + std::to_string(ids[last]);
+		}
+		i = last;
+	}
+	return list;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "../gridParams.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Pins the OpenMP threads according to the placement policy, using the CPU topology from sysfs.
+// The placement is ordered, so the first n threads of a smaller team are placed as well as n threads can be.
+class Affinity {
+public:
+	// Pins the threads and prints where they ended up. 'threads' limits their number, 0 uses all CPUs of the placement.
+	static void apply(GridParams::Placement placement, std::size_t threads);
+
+	// Threads for a parallel loop over the given number of grid points, so coarse levels don't pay
+	// for synchronizing threads that have almost no work
+	static int levelThreads(std::size_t points);
+	// Threads of the whole team
+	static int availableThreads();
+
+private:
+	struct Cpu {
+		int id;
+		int core;
+		int package;
+		int node;
+	};
+
+	// CPUs this process may run on
+	static std::vector<Cpu> topology();
+	// Logical CPUs the threads are bound to, in thread order
+	static std::vector<std::vector<int>> placeThreads(GridParams::Placement placement, const std::vector<Cpu>& cpus);
+	static std::string cpuList(const std::vector<int>& ids);
+
+	static int maxThreads;
+};
@@ -0,0 +1,49 @@
+#include "Anderson.h"
+
+Anderson::Anderson(std::size_t depth, const Vector3& shape)
+	: history(depth), deltaF(depth, shape), deltaG(depth, shape), f(shape), fPrev(shape), gPrev(shape)
+{
+}
+
+void Anderson::saveIterate(const Vector3& x)
+{
+	f = x;
+}
+
+void Anderson::mix(Vector3& g)
+{
+	f -= g;
+
+	if (havePrev) {
+		const std::size_t slot = history.nextSlot();
+		deltaF[slot] = f;
+		deltaF[slot] -= fPrev;
+		deltaG[slot] = g;
+		deltaG[slot] -= gPrev;
+
+		std::vector<double> gramRow(history.sizeAfterPush());
+		for (std::size_t j = 0; j < gramRow.size(); j++) {
+			gramRow[j] = deltaF[slot].dot(deltaF[j]);
+		}
+		history.push(gramRow);
+	}
+
+	fPrev = f;
+	gPrev = g;
+	havePrev = true;
+
+	if (history.size() == 0) {
+		return;
+	}
+
+	std::vector<double> rhs(history.size());
+	for (std::size_t j = 0; j < rhs.size(); j++) {
+		rhs[j] = deltaF[j].dot(f);
+	}
+
+	// x_{k+1} = G(x_k) - sum_j c_j dG_j
+	const std::vector<double> coeff = history.coefficients(rhs);
+	for (std::size_t j = 0; j < coeff.size(); j++) {
+		g.addScaled(deltaG[j], -coeff[j]);
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "Vector3.h"
+#include "../AndersonHistory.h"
+#include <vector>
+
+// Anderson acceleration of a fixed point iteration x_{k+1} = G(x_k) on the finest level.
+// Usage per outer iteration: saveIterate(x_k), run the step, then mix(G(x_k)).
+class Anderson {
+public:
+	Anderson(std::size_t depth, const Vector3& shape);
+
+	void saveIterate(const Vector3& x);
+	// Replaces g = G(x_k) with the accelerated iterate x_{k+1}
+	void mix(Vector3& g);
+
+private:
+	AndersonHistory history;
+	std::vector<Vector3> deltaF;
+	std::vector<Vector3> deltaG;
+	// The fixed point residuals are stored negated, f = x - G(x), which doesn't change the mixing coefficients
+	Vector3 f;
+	Vector3 fPrev;
+	Vector3 gPrev;
+	bool havePrev = false;
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include "CpuGridData.h"
+#include "../SolveResult.h"
+
+// Solves the nonlinear (FAS or Newton) problem by ramping gamma from
+// grid.continuationStart up to grid.gamma, warm starting every stage from the previous solution
+class ContinuationSolver {
+public:
+	static SolveResult solve(CpuGridData& grid);
+
+private:
+	static SolveResult solveStage(CpuGridData& grid);
+	static Vector3& solution(CpuGridData& grid);
+};
@@ -1,4 +1,6 @@
 #include "CpuGridData.h"
+#include "../Nonlinearity.h"
+#include "../BlockInverse.h"
 #include <math.h>
 #include <algorithm>
 #include <tuple>
@@ -29,16 +31,44 @@ CpuGridData::CpuGridData(const GridParams& grid)
 			level.levelDim[2] = levels[i - 1].levelDim[2] / 2;
 		}
 
-		level.v = Vector3(level.levelDim[0] + 2, level.levelDim[1] + 2, level.levelDim[2] + 2);
-		level.restV = Vector3(level.levelDim[0] + 2, level.levelDim[1] + 2, level.levelDim[2] + 2);
-		level.newtonV = Vector3(level.levelDim[0] + 2, level.levelDim[1] + 2, level.levelDim[2] + 2);
-		level.f = Vector3(level.levelDim[0] + 2, level.levelDim[1] + 2, level.levelDim[2] + 2);
-		level.r = Vector3(level.levelDim[0] + 2, level.levelDim[1] + 2, level.levelDim[2] + 2);
+		const Layout levelLayout(level.levelDim[0] + 2, level.levelDim[1] + 2, level.levelDim[2] + 2, layout);
+		if (interleave) {
+			// the residual and the smoothers read v and f and write r at the same points
+			Vector3::interleave(levelLayout, { &level.v, &level.f, &level.r });
+		}else {
+			level.v = Vector3(levelLayout);
+			level.f = Vector3(levelLayout);
+			level.r = Vector3(levelLayout);
+		}
+		level.restV = Vector3(levelLayout);
+		level.newtonV = Vector3(levelLayout);
 		if (i + 1 != maxlevel) {
-			level.e = Vector3(level.levelDim[0] + 2, level.levelDim[1] + 2, level.levelDim[2] + 2);
+			level.e = Vector3(levelLayout);
 		}
 
 		level.h = 1.0 / (level.levelDim[1] + 1);
+
+		// only worth it on levels with a few tiles along every axis
+		for (std::size_t axis = 0; axis < 3; axis++) {
+			level.tiles[axis] = (level.levelDim[axis] + tileSize - 1) / tileSize;
+		}
+		if (activeSet > 0.0 && std::min(std::min(level.tiles[0], level.tiles[1]), level.tiles[2]) >= 4) {
+			level.tileResidual.resize(level.tiles[0] * level.tiles[1] * level.tiles[2], 0.0);
+		}
+	}
+
+	if (galerkin) {
+		const std::vector<Stencil27> ops = Galerkin::buildOperators(stencil, levels[0].h, levels.size());
+		for (std::size_t i = 0; i < levels.size(); i++) {
+			levels[i].op = ops[i];
+		}
+	}
+
+	if (smoother == BLOCK) {
+		for (std::size_t i = 0; i < levels.size(); i++) {
+			const bool useGalerkin = galerkin && i > 0;
+			levels[i].blockInverse = BlockInverse::build(useGalerkin ? levels[i].op : Galerkin::scaledStencil(stencil, levels[i].h));
+		}
 	}
 
 	// fill right hand side for the first level
@@ -66,9 +96,9 @@ CpuGridData::CpuGridData(const GridParams& grid)
 					double y = j * h;
 					double z = k * h;
 
+					// f = -Laplace(u) + N(u) for the solution u = (x - x^2)(y - y^2)(z - z^2)
 					double val = 2.0 * ((y - y * y) * (z - z * z) + (x - x * x) * (z - z * z) + (x - x * x) * (y - y * y))
-						+ gamma * (x - x * x) * (y - y * y) * (z - z * z)
-						* exp((x - x * x) * (y - y * y) * (z - z * z));
+						+ Nonlinearity::value(gamma, (x - x * x) * (y - y * y) * (z - z * z));
 
 					levels[0].f.set(i, j, k, val);
 				}
@@ -1,11 +1,15 @@
 #pragma once
 #include "../gridParams.h"
+#include "../Galerkin.h"
 #include "Vector3.h"
 #include <vector>
 
 class CpuGridData final : public GridParams {
 public:
 
+    // Edge length of the active set tiles
+    static constexpr std::size_t tileSize = 8;
+
     struct LevelData {
         Vector3 v; // left side, target
         Vector3 restV; // restricted v from previous level
@@ -15,6 +19,17 @@ public:
         Vector3 e; // error
         std::array<std::size_t, 3> levelDim;
         double h;
+        Stencil27 op; // Galerkin operator, only used on coarse levels if enabled
+        std::vector<double> blockInverse; // BlockInverse table of the level, only filled for the block smoother
+
+        // Largest |r| of every tile in the last residual pass, empty if the level doesn't use the active set
+        std::vector<double> tileResidual;
+        std::array<std::size_t, 3> tiles; // tiles per axis
+
+        std::size_t tileOf(std::size_t x, std::size_t y, std::size_t z) const
+        {
+            return (((x - 1) / tileSize) * tiles[1] + (y - 1) / tileSize) * tiles[2] + (z - 1) / tileSize;
+        }
     };
 
     CpuGridData(const GridParams& grid);
@@ -35,6 +50,12 @@ public:
 
     Vector3 newtonF;
 
+    // Level the solvers treat as the finest one, grid sequencing solves on coarser levels first
+    std::size_t finestLevel = 0;
+
+    // Set by the solver for the V-cycles whose Jacobi sweeps may skip the quiet tiles
+    bool activeSetSweep = false;
+
 private:
     std::vector<LevelData> levels; // levels[0] is the finest level and levels[-1] is the coarsed level
 };
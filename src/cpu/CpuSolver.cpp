@@ -3,26 +3,108 @@
 #include <iostream>
 #include <chrono>
 #include <math.h>
+#include <cmath>
 #include "../Timer.h"
+#include "Anderson.h"
+#include "Affinity.h"
+#include "Operator.h"
+#include "../Nonlinearity.h"
+#include "../BlockInverse.h"
+#include "../Watchdog.h"
+#include <memory>
+#include <algorithm>
 #ifdef _WIN32
 	#include <windows.h>
 	#include <psapi.h>
 #endif
 
-void CpuSolver::solve(CpuGridData& grid)
+namespace {
+	// r = f - A(v) - N(v) at one point
+	double residualAt(const CpuGridData& grid, const CpuGridData::LevelData& level, bool useGalerkin, std::size_t x, std::size_t y, std::size_t z)
+	{
+		double stencilsum = applyOperator(grid, level, useGalerkin, level.v, x, y, z);
+
+		if (grid.mode == GridParams::NEWTON) {
+			stencilsum += Nonlinearity::derivative(grid.gamma, level.newtonV.get(x, y, z)) * level.v.get(x,y,z);
+		}
+		else if(grid.mode == GridParams::NONLINEAR) {
+			stencilsum += Nonlinearity::value(grid.gamma, level.v.get(x, y, z));
+		}
+
+		return level.f.get(x, y, z) - stencilsum;
+	}
+
+	// New v of a Jacobi step from the residual in r
+	double jacobiAt(const CpuGridData& grid, const CpuGridData::LevelData& level, double preFac, std::size_t x, std::size_t y, std::size_t z)
+	{
+		if (grid.mode == GridParams::LINEAR) {
+			return level.v.get(x, y, z) + grid.omega * ((1.0 / preFac) * level.r.get(x, y, z));
+		}else if(grid.mode == GridParams::NONLINEAR) {
+			// See tutorial_multigrid.pdf, page 103, Formula 6.14
+			double denuminator = preFac + Nonlinearity::derivative(grid.gamma, level.v.get(x, y, z));
+
+			return level.v.get(x, y, z) + grid.omega * (level.r.get(x, y, z) / denuminator);
+		}
+
+		// Newton
+		double denuminator = preFac + Nonlinearity::derivative(grid.gamma, level.newtonV.get(x, y, z));
+
+		return level.v.get(x, y, z) + grid.omega * (level.r.get(x, y, z) / denuminator);
+	}
+}
+
+SolveResult CpuSolver::solve(CpuGridData& grid)
 {
+	SolveResult result;
+
 	// Compute inital residual
-	double initialResidual = compResidual(grid, 0);
+	const std::size_t finest = grid.finestLevel;
+	double initialResidual = compResidual(grid, finest);
+	result.initialResidual = initialResidual;
+	result.residual = initialResidual;
 	if (grid.printProgress) {
 		std::cout << "Inital residual: " << initialResidual << '\n';
 	}
 
+	const double refResidual = grid.referenceResidual > 0.0 ? grid.referenceResidual : initialResidual;
+	const double stopResidual = refResidual / (1.0 / grid.tol);
+
+	// tau-extrapolation needs the restricted right hand side of the finest level in every cycle
+	const bool tauExtrapolation = grid.tauExtrapolation && grid.mode == GridParams::NONLINEAR && grid.numLevels() > finest + 1;
+	Vector3 restrictedF;
+	if (tauExtrapolation) {
+		restrictedF = grid.getLevel(finest + 1).f;
+		restrict(grid.getLevel(finest).f, restrictedF);
+	}
+	double lastRes = initialResidual;
+
+	// Accelerates the FAS cycles, the linear inner solves of Newton are left alone
+	std::unique_ptr<Anderson> anderson;
+	if (grid.andersonDepth > 0 && grid.mode == GridParams::NONLINEAR) {
+		anderson = std::make_unique<Anderson>(grid.andersonDepth, grid.getLevel(finest).v);
+	}
+
+	// the iterate with the best residual so far, the watchdog rolls back to it
+	Watchdog watchdog(grid, Watchdog::CYCLES, initialResidual);
+	Vector3 lastGood;
+	if (watchdog.enabled()) {
+		lastGood = grid.getLevel(finest).v;
+	}
+
 	for (std::size_t i = 0; i < grid.maxiter; i++) {
 		if (grid.printProgress) {
 			Timer::start();
 		}
 
-		double res = vcycle(grid);
+		if (anderson) {
+			anderson->saveIterate(grid.getLevel(finest).v);
+		}
+
+		// quiet tiles are skipped, except every activeSetPeriod-th cycle
+		grid.activeSetSweep = grid.activeSet > 0.0 && (i + 1) % grid.activeSetPeriod != 0;
+		double res = vcycle(grid, tauExtrapolation ? &restrictedF : nullptr);
+		result.iterations = i + 1;
+		result.residual = res;
 
 		if (grid.printProgress) {
 			std::cout << "iter: " << i << " residual: " << res << ' ';
@@ -36,44 +118,74 @@ void CpuSolver::solve(CpuGridData& grid)
 		}
 #endif
 
-		if (res <= initialResidual / (1.0 / grid.tol)) {
-			return;
+		if (res <= stopResidual) {
+			result.converged = true;
+			return result;
+		}
+		if (watchdog.enabled()) {
+			const Watchdog::Verdict verdict = watchdog.check(res);
+			if (verdict == Watchdog::IMPROVED) {
+				lastGood = grid.getLevel(finest).v;
+			}else if (verdict == Watchdog::DIVERGED) {
+				grid.getLevel(finest).v = lastGood;
+				result.residual = compResidual(grid, finest);
+				if (!watchdog.backOff(res)) {
+					return result;
+				}
+				lastRes = result.residual;
+				if (anderson) {
+					// the history belongs to the abandoned iterates
+					anderson = std::make_unique<Anderson>(grid.andersonDepth, grid.getLevel(finest).v);
+				}
+				continue;
+			}
+		}
+		if (!std::isfinite(res)) {
+			// diverged, further cycles can't recover
+			return result;
+		}
+		// With tau-extrapolation the fine grid residual doesn't vanish, it converges to a non-zero value
+		if (tauExtrapolation && fabs(res - lastRes) <= grid.tol * lastRes) {
+			result.converged = true;
+			return result;
+		}
+		lastRes = res;
+
+		if (anderson) {
+			anderson->mix(grid.getLevel(finest).v);
 		}
 	}
+
+	return result;
 }
 
 double CpuSolver::compResidual(CpuGridData& grid, std::size_t levelNum)
 {
 	CpuGridData::LevelData& level = grid.getLevel(levelNum);
+	const bool useGalerkin = grid.galerkin && levelNum > grid.finestLevel;
+	const bool trackTiles = !level.tileResidual.empty();
 
 	double res = 0.0;
 
-#pragma omp parallel for schedule(static,8) reduction(+:res)
+	// With the active set, the chunks of 8 planes are the tile slabs, so every tile is only written by one thread
+#pragma omp parallel for num_threads(Affinity::levelThreads(level.v.flatSize())) schedule(static,8) reduction(+:res)
 	for (std::int64_t x = 1; x < level.levelDim[0]+1; x++) {
+		if (trackTiles && (x - 1) % CpuGridData::tileSize == 0) {
+			const std::size_t first = level.tileOf(x, 1, 1);
+			std::fill_n(level.tileResidual.begin() + first, level.tiles[1] * level.tiles[2], 0.0);
+		}
+
 		for (std::size_t y = 1; y < level.levelDim[1]+1; y++) {
 			for (std::size_t z = 1; z < level.levelDim[2]+1; z++) {
 
-				double stencilsum = 0.0;
-				for (std::size_t i = 0; i < grid.stencil.values.size(); i++) {
-					double vVal = level.v.get(x + grid.stencil.getXOffset(i), y + grid.stencil.getYOffset(i), z + grid.stencil.getZOffset(i));
-					stencilsum += grid.stencil.values[i] * vVal;
-				}
-				stencilsum /= level.h * level.h;
+				double r = residualAt(grid, level, useGalerkin, x, y, z);
+				level.r.set(x, y, z, r);
 
-				if (grid.mode == GridParams::NEWTON) {
-					double ex = exp(level.newtonV.get(x, y, z));
-					stencilsum += grid.gamma * (1 + level.newtonV.get(x, y, z)) * level.v.get(x,y,z) * ex;
-				}
-				else if(grid.mode == GridParams::NONLINEAR) {
-					// See tutorial_multigrid.pdf, page 102, Formula 6.13
-					double ex = exp(level.v.get(x, y, z));
-					double nonLinear = grid.gamma * level.v.get(x, y, z) * ex;
-					stencilsum += nonLinear;
+				if (trackTiles) {
+					double& tile = level.tileResidual[level.tileOf(x, y, z)];
+					tile = std::max(tile, std::abs(r));
 				}
 
-				double r = level.f.get(x, y, z) - stencilsum;
-				level.r.set(x, y, z, r);
-
 				res += r * r;
 			}
 		}
@@ -82,41 +194,32 @@ double CpuSolver::compResidual(CpuGridData& grid, std::size_t levelNum)
 	return sqrt(res);
 }
 
-double CpuSolver::vcycle(CpuGridData& grid)
+// restrictedF: restricted right hand side of the finest level if tau-extrapolation is used, nullptr otherwise
+double CpuSolver::vcycle(CpuGridData& grid, const Vector3* restrictedF)
 {
-	for (std::size_t i = 0; i < grid.numLevels()-1; i++) {
-		jacobi(grid, i, grid.preSmoothing);
+	for (std::size_t i = grid.finestLevel; i < grid.numLevels()-1; i++) {
+		smooth(grid, i, grid.preSmoothing);
 
 		CpuGridData::LevelData& nextLevel = grid.getLevel(i + 1);
 
 		// compute residual
 		compResidual(grid, i);
-		Vector3& r = grid.getLevel(i).r;
-
-		// restrict residual to next level f
-		// f^2h = r^2h
-		restrict(r, nextLevel.f);
 
 		if (grid.mode != GridParams::NONLINEAR) {
+			// restrict residual to next level f
+			// f^2h = r^2h
+			restrict(grid.getLevel(i).r, nextLevel.f);
 			nextLevel.v.fill(0.0);
 		}else {
 			// See tutorial_multigrid.pdf, page 98, Full Approximation Scheme (FAS)
-
-			// restrict v^h to next level v^2h
-			restrict(grid.getLevel(i).v, nextLevel.restV);
-			restrict(grid.getLevel(i).v, nextLevel.v);
-
-			// Compute A^2h (v^2h) and store it in r
-			applyStencil(grid, i + 1, nextLevel.restV);
-			// Add A^2h (v^2h) to r^2h
-			nextLevel.f += nextLevel.r;
+			fasTransfer(grid, i, i == grid.finestLevel ? restrictedF : nullptr);
 		}
 	}
 	
 	// reached coarsed level, solve now
-	jacobi(grid, grid.numLevels() - 1, grid.preSmoothing+grid.postSmoothing);
+	smooth(grid, grid.numLevels() - 1, grid.preSmoothing+grid.postSmoothing);
 
-	for (std::size_t i = grid.numLevels() - 1; i > 0; i--) {
+	for (std::size_t i = grid.numLevels() - 1; i > grid.finestLevel; i--) {
 		
 		if (grid.mode == GridParams::NONLINEAR) {
 			CpuGridData::LevelData& level = grid.getLevel(i);
@@ -131,78 +234,297 @@ double CpuSolver::vcycle(CpuGridData& grid)
 		auto& levelPrev = grid.getLevel(i - 1);
 		levelPrev.v += levelPrev.e;
 
-		jacobi(grid, i - 1, grid.postSmoothing);
+		smooth(grid, i - 1, grid.postSmoothing);
 	}
 
 	// returns current residual
-	return compResidual(grid, 0);
+	return compResidual(grid, grid.finestLevel);
+}
+
+void CpuSolver::smooth(CpuGridData& grid, std::size_t levelNum, std::size_t maxiter)
+{
+	if (grid.smoother == GridParams::BLOCK) {
+		blockJacobi(grid, levelNum, maxiter);
+		return;
+	}
+
+	const std::vector<std::size_t> lineAxes = grid.lineAxes();
+	if (lineAxes.empty()) {
+		jacobi(grid, levelNum, maxiter);
+		return;
+	}
+
+	// zebra line relaxation, the lines of one color don't couple with each other
+	for (std::size_t i = 0; i < maxiter; i++) {
+		for (std::size_t axis : lineAxes) {
+			for (std::size_t color = 0; color < 2; color++) {
+				compResidual(grid, levelNum);
+				lineRelax(grid, levelNum, axis, color);
+			}
+		}
+	}
 }
 
 void CpuSolver::jacobi(CpuGridData& grid, std::size_t levelNum, std::size_t maxiter)
 {	
 	CpuGridData::LevelData& level = grid.getLevel(levelNum);
-	const double preFac = grid.stencil.values[0] / (level.h * level.h);
-	const double alpha = (level.h * level.h) / grid.stencil.values[0]; // stencil center
+	if (grid.activeSetSweep && !level.tileResidual.empty()) {
+		activeJacobi(grid, levelNum, maxiter);
+		return;
+	}
+
+	const bool useGalerkin = grid.galerkin && levelNum > grid.finestLevel;
+	const double preFac = useGalerkin ? level.op.center() : grid.stencil.values[0] / (level.h * level.h);
 
 	for (std::size_t i = 0; i < maxiter; i++) {
 		
 		compResidual(grid, levelNum);
 		
-#pragma omp parallel for schedule(static,8)
+#pragma omp parallel for num_threads(Affinity::levelThreads(level.v.flatSize())) schedule(static,8)
 		for (std::int64_t x = 1; x < level.levelDim[0] + 1; x++) {
 			for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
 				for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+					level.v.set(x, y, z, jacobiAt(grid, level, preFac, x, y, z));
+				}
+			}
+		}
+	}
+}
 
-					double newV;
-					if (grid.mode == GridParams::LINEAR) {
-						newV = level.v.get(x, y, z) + grid.omega * (alpha * level.r.get(x, y, z));
-					}else if(grid.mode == GridParams::NONLINEAR) {
-						// See tutorial_multigrid.pdf, page 103, Formula 6.14
-						double ex = exp(level.v.get(x, y, z));
-						double denuminator = preFac + grid.gamma * (1 + level.v.get(x, y, z)) * ex;
+// Jacobi sweeps over the tiles whose residual in the last full residual pass was at least
+// grid.activeSet times the largest one, the other tiles keep their v and r
+void CpuSolver::activeJacobi(CpuGridData& grid, std::size_t levelNum, std::size_t maxiter)
+{
+	CpuGridData::LevelData& level = grid.getLevel(levelNum);
+	const bool useGalerkin = grid.galerkin && levelNum > grid.finestLevel;
+	const double preFac = useGalerkin ? level.op.center() : grid.stencil.values[0] / (level.h * level.h);
+
+	const double threshold = grid.activeSet * *std::max_element(level.tileResidual.begin(), level.tileResidual.end());
+	std::vector<std::array<std::size_t, 3>> active;
+	for (std::size_t tx = 0; tx < level.tiles[0]; tx++) {
+		for (std::size_t ty = 0; ty < level.tiles[1]; ty++) {
+			for (std::size_t tz = 0; tz < level.tiles[2]; tz++) {
+				if (level.tileResidual[(tx * level.tiles[1] + ty) * level.tiles[2] + tz] >= threshold) {
+					active.push_back({ 1 + tx * CpuGridData::tileSize, 1 + ty * CpuGridData::tileSize, 1 + tz * CpuGridData::tileSize });
+				}
+			}
+		}
+	}
+
+	const int threads = Affinity::levelThreads(active.size() * CpuGridData::tileSize * CpuGridData::tileSize * CpuGridData::tileSize);
+	for (std::size_t i = 0; i < maxiter; i++) {
 
-						newV = level.v.get(x, y, z) + grid.omega * (level.r.get(x, y, z) / denuminator);
+#pragma omp parallel for num_threads(threads) schedule(static)
+		for (std::int64_t t = 0; t < static_cast<std::int64_t>(active.size()); t++) {
+			const std::array<std::size_t, 3>& begin = active[t];
+			double tileMax = 0.0;
+			for (std::size_t x = begin[0]; x < std::min(begin[0] + CpuGridData::tileSize, level.levelDim[0] + 1); x++) {
+				for (std::size_t y = begin[1]; y < std::min(begin[1] + CpuGridData::tileSize, level.levelDim[1] + 1); y++) {
+					for (std::size_t z = begin[2]; z < std::min(begin[2] + CpuGridData::tileSize, level.levelDim[2] + 1); z++) {
+						double r = residualAt(grid, level, useGalerkin, x, y, z);
+						level.r.set(x, y, z, r);
+						tileMax = std::max(tileMax, std::abs(r));
 					}
-					else {
-						// Newton
-						double ex = exp(level.newtonV.get(x, y, z));
-						double denuminator = preFac + grid.gamma * (1 + level.newtonV.get(x, y, z)) * ex;
+				}
+			}
+			level.tileResidual[level.tileOf(begin[0], begin[1], begin[2])] = tileMax;
+		}
 
-						newV = level.v.get(x, y, z) + grid.omega * (level.r.get(x, y, z) / denuminator);
+#pragma omp parallel for num_threads(threads) schedule(static)
+		for (std::int64_t t = 0; t < static_cast<std::int64_t>(active.size()); t++) {
+			const std::array<std::size_t, 3>& begin = active[t];
+			for (std::size_t x = begin[0]; x < std::min(begin[0] + CpuGridData::tileSize, level.levelDim[0] + 1); x++) {
+				for (std::size_t y = begin[1]; y < std::min(begin[1] + CpuGridData::tileSize, level.levelDim[1] + 1); y++) {
+					for (std::size_t z = begin[2]; z < std::min(begin[2] + CpuGridData::tileSize, level.levelDim[2] + 1); z++) {
+						level.v.set(x, y, z, jacobiAt(grid, level, preFac, x, y, z));
 					}
+				}
+			}
+		}
+	}
+}
 
-					level.v.set(x, y, z, newV);
+// Damped block-Jacobi sweeps, the correction of every 2x2x2 block is the exact solution of the block
+// equations for the residual in r. Linear mode only.
+void CpuSolver::blockJacobi(CpuGridData& grid, std::size_t levelNum, std::size_t maxiter)
+{
+	CpuGridData::LevelData& level = grid.getLevel(levelNum);
+	assert(grid.mode == GridParams::LINEAR && !level.blockInverse.empty());
+	const std::array<std::size_t, 3>& dim = level.levelDim;
+	// blocks two points thick along z, with an odd number of points the thin last one follows
+	const std::size_t fullZ = dim[2] / 2;
+
+	for (std::size_t i = 0; i < maxiter; i++) {
+
+		compResidual(grid, levelNum);
+
+#pragma omp parallel for num_threads(Affinity::levelThreads(level.v.flatSize())) schedule(static,4)
+		for (std::int64_t bx = 0; bx < static_cast<std::int64_t>((dim[0] + 1) / 2); bx++) {
+			const std::size_t x0 = 2 * bx + 1;
+			for (std::size_t y0 = 1; y0 < dim[1] + 1; y0 += 2) {
+				const bool thinX = x0 == dim[0];
+				const bool thinY = y0 == dim[1];
+				const double* inverse = level.blockInverse.data() + BlockInverse::shape(thinX, thinY, false) * BlockInverse::points * BlockInverse::points;
+				for (std::size_t bz = 0; bz < fullZ; bz += blockLanes) {
+					blockRun(level, grid.omega, inverse, x0, y0, 2 * bz + 1, std::min(blockLanes, fullZ - bz));
+				}
+				if (dim[2] % 2 == 1) {
+					const double* thinInverse = level.blockInverse.data() + BlockInverse::shape(thinX, thinY, true) * BlockInverse::points * BlockInverse::points;
+					blockRun(level, grid.omega, thinInverse, x0, y0, dim[2], 1);
 				}
 			}
 		}
 	}
 }
 
-// Only needed for non-linear code
-void CpuSolver::applyStencil(CpuGridData& grid, std::size_t levelNum, const Vector3& v)
+// Corrections of 'count' neighbouring blocks along z, all of the same shape, starting at the point z0.
+// The residual is gathered with one block per lane, so the 8x8 products run across the blocks.
+// r is 0 on the boundary, which the thin blocks reach into.
+void CpuSolver::blockRun(CpuGridData::LevelData& level, double omega, const double* inverse, std::size_t x0, std::size_t y0, std::size_t z0, std::size_t count)
 {
-	assert(grid.mode == GridParams::NONLINEAR);
+	constexpr std::size_t n = BlockInverse::points;
+	const Layout& rLayout = level.r.getLayout();
+	const Layout& vLayout = level.v.getLayout();
+	const double* r = level.r.data();
+	double* v = level.v.data();
+
+	double res[n][blockLanes] = {};
+	for (std::size_t j = 0; j < n; j++) {
+		for (std::size_t lane = 0; lane < count; lane++) {
+			res[j][lane] = r[rLayout.index(x0 + j / 4, y0 + (j / 2) % 2, z0 + 2 * lane + j % 2)];
+		}
+	}
+
+	double delta[n][blockLanes] = {};
+	for (std::size_t p = 0; p < n; p++) {
+		for (std::size_t j = 0; j < n; j++) {
+			const double coeff = inverse[p * n + j];
+#pragma omp simd
+			for (std::size_t lane = 0; lane < blockLanes; lane++) {
+				delta[p][lane] += coeff * res[j][lane];
+			}
+		}
+	}
 
+	for (std::size_t p = 0; p < n; p++) {
+		const std::size_t x = x0 + p / 4;
+		const std::size_t y = y0 + (p / 2) % 2;
+		if (x > level.levelDim[0] || y > level.levelDim[1]) {
+			continue;
+		}
+		for (std::size_t lane = 0; lane < count; lane++) {
+			const std::size_t z = z0 + 2 * lane + p % 2;
+			if (z <= level.levelDim[2]) {
+				v[vLayout.index(x, y, z)] += omega * delta[p][lane];
+			}
+		}
+	}
+}
+
+// Solves the linearized equations exactly along all lines in direction 'axis' whose other two
+// coordinates sum up to the given parity. Uses the residual in r and updates v with the correction.
+void CpuSolver::lineRelax(CpuGridData& grid, std::size_t levelNum, std::size_t axis, std::size_t color)
+{
 	CpuGridData::LevelData& level = grid.getLevel(levelNum);
-	assert(level.v.flatSize() == v.flatSize());
-	Vector3& result = level.r;
-
-#pragma omp parallel for schedule(static,8)
-	for (std::int64_t x = 1; x < level.levelDim[0] + 1; x++) {
-		for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
-			for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
-
-				double stencilsum = 0.0;
-				for (std::size_t i = 0; i < grid.stencil.values.size(); i++) {
-					double vVal = v.get(x + grid.stencil.getXOffset(i), y + grid.stencil.getYOffset(i), z + grid.stencil.getZOffset(i));
-					stencilsum += grid.stencil.values[i] * vVal;
+	const double invH2 = 1.0 / (level.h * level.h);
+	const bool useGalerkin = grid.galerkin && levelNum > grid.finestLevel;
+	std::array<int, 3> offset{ 0, 0, 0 };
+	const double center = useGalerkin ? level.op.center() : grid.stencil.values[0] * invH2;
+	offset[axis] = -1;
+	const double lower = useGalerkin ? level.op.values[Stencil27::index(offset[0], offset[1], offset[2])] : grid.stencil.valueAt(offset[0], offset[1], offset[2]) * invH2;
+	offset[axis] = 1;
+	const double upper = useGalerkin ? level.op.values[Stencil27::index(offset[0], offset[1], offset[2])] : grid.stencil.valueAt(offset[0], offset[1], offset[2]) * invH2;
+
+	const std::size_t axisB = (axis + 1) % 3;
+	const std::size_t axisC = (axis + 2) % 3;
+	const std::size_t n = level.levelDim[axis];
+
+	// scratch of the Thomas algorithm, allocated once per thread
+#pragma omp parallel num_threads(Affinity::levelThreads(level.v.flatSize()))
+	{
+		std::vector<double> cPrime(n + 1);
+		std::vector<double> dPrime(n + 1);
+
+#pragma omp for schedule(static,8)
+		for (std::int64_t p = 1; p < level.levelDim[axisB] + 1; p++) {
+			std::array<std::size_t, 3> pos;
+			pos[axisB] = p;
+
+			for (std::size_t q = 1 + (p + 1 + color) % 2; q < level.levelDim[axisC] + 1; q += 2) {
+				pos[axisC] = q;
+
+				// Thomas algorithm, forward sweep
+				double cPrev = 0.0;
+				double dPrev = 0.0;
+				for (std::size_t t = 1; t < n + 1; t++) {
+					pos[axis] = t;
+
+					double diag = center;
+					if (grid.mode == GridParams::NONLINEAR) {
+						diag += Nonlinearity::derivative(grid.gamma, level.v.get(pos[0], pos[1], pos[2]));
+					}
+					else if (grid.mode == GridParams::NEWTON) {
+						diag += Nonlinearity::derivative(grid.gamma, level.newtonV.get(pos[0], pos[1], pos[2]));
+					}
+
+					const double denom = diag - lower * cPrev;
+					cPrev = upper / denom;
+					dPrev = (level.r.get(pos[0], pos[1], pos[2]) - lower * dPrev) / denom;
+					cPrime[t] = cPrev;
+					dPrime[t] = dPrev;
+				}
+
+				// backward substitution, adds the correction to v
+				double delta = 0.0;
+				for (std::size_t t = n; t > 0; t--) {
+					pos[axis] = t;
+					delta = dPrime[t] - cPrime[t] * delta;
+					level.v.set(pos[0], pos[1], pos[2], level.v.get(pos[0], pos[1], pos[2]) + delta);
+				}
+			}
+		}
+	}
+}
+
+// FAS transfer to the next level, reads the fine r and v only once:
+// v^2h = restV^2h = R v^h and f^2h = R r^h + A^2h(restV^2h).
+// restrictedF: restricted right hand side of the finest level for tau-extrapolation, nullptr otherwise
+void CpuSolver::fasTransfer(CpuGridData& grid, std::size_t levelNum, const Vector3* restrictedF)
+{
+	assert(grid.mode == GridParams::NONLINEAR);
+
+	const CpuGridData::LevelData& fine = grid.getLevel(levelNum);
+	CpuGridData::LevelData& coarse = grid.getLevel(levelNum + 1);
+	const bool useGalerkin = grid.galerkin && levelNum + 1 > grid.finestLevel;
+
+#pragma omp parallel num_threads(Affinity::levelThreads(coarse.v.flatSize()))
+	{
+#pragma omp for schedule(static,8)
+		for (std::int64_t x = 1; x < coarse.levelDim[0] + 1; x++) {
+			for (std::size_t y = 1; y < coarse.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < coarse.levelDim[2] + 1; z++) {
+					const double restV = restrictAt(fine.v, x, y, z);
+					coarse.restV.set(x, y, z, restV);
+					coarse.v.set(x, y, z, restV);
+					coarse.f.set(x, y, z, restrictAt(fine.r, x, y, z));
 				}
-				stencilsum /= level.h * level.h;
-				// See tutorial_multigrid.pdf, page 102, Formula 6.13
-				double nonLinear = grid.gamma * v.get(x, y, z) * exp(v.get(x, y, z));
-				stencilsum += nonLinear;
+			}
+		}
 
-				result.set(x, y, z, stencilsum);
+		// A^2h needs the restricted neighbours, the coarse grid is small enough to still be in cache
+#pragma omp for schedule(static,8)
+		for (std::int64_t x = 1; x < coarse.levelDim[0] + 1; x++) {
+			for (std::size_t y = 1; y < coarse.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < coarse.levelDim[2] + 1; z++) {
+					const double restV = coarse.restV.get(x, y, z);
+					double f = coarse.f.get(x, y, z) + applyOperator(grid, coarse, useGalerkin, coarse.restV, x, y, z) + Nonlinearity::value(grid.gamma, restV);
+
+					if (restrictedF) {
+						// f^2h = R f^h + tau, extrapolate to R f^h + 4/3 tau for a second order discretization
+						f = 4.0 / 3.0 * f - 1.0 / 3.0 * restrictedF->get(x, y, z);
+					}
+					coarse.f.set(x, y, z, f);
+				}
 			}
 		}
 	}
@@ -211,26 +533,12 @@ void CpuSolver::applyStencil(CpuGridData& grid, std::size_t levelNum, const Vect
 void CpuSolver::restrict(const Vector3& fine, Vector3& coarse)
 {
 
-#pragma omp parallel for schedule(static,8)
+#pragma omp parallel for num_threads(Affinity::levelThreads(coarse.flatSize())) schedule(static,8)
 	for (std::int64_t x = 1; x < coarse.getXdim()-1; x++) {
 		for (std::size_t y = 1; y < coarse.getYdim()-1; y++) {
 			for (std::size_t z = 1; z < coarse.getZdim()-1; z++) {
 
-				std::size_t xCenter = 2 * x;
-				std::size_t yCenter = 2 * y;
-				std::size_t zCenter = 2 * z;
-
-				double coarseValue = 0.0;
-
-				for (int ii = -2 + 1; ii < 2; ii++) {
-					for (int jj = -2 + 1; jj < 2; jj++) {
-						for (int kk = -2 + 1; kk < 2; kk++) {
-							double fac = 0.125 * ((2.0 - abs(ii)) / 2.0) * ((2.0 - abs(jj)) / 2.0) * ((2.0 - abs(kk)) / 2.0);
-							coarseValue += fac * fine.get(xCenter + ii, yCenter + jj, zCenter + kk);
-						}
-					}
-				}
-
+				double coarseValue = restrictAt(fine, x, y, z);
 				coarse.set(x, y, z, coarseValue);
 			}
 		}
@@ -244,7 +552,7 @@ void CpuSolver::interpolate(CpuGridData& grid, std::size_t level)
 	Vector3& fine = grid.getLevel(level).e;
 
 	// prepare
-#pragma omp parallel for schedule(static,4)
+#pragma omp parallel for num_threads(Affinity::levelThreads(fine.flatSize())) schedule(static,4)
 	for (std::int64_t x = 0; x < fine.getXdim() - 1; x += 2) {
 		for (std::size_t y = 0; y < fine.getYdim() - 1; y += 2) {
 			for (std::size_t z = 0; z < fine.getZdim() - 1; z += 2) {
@@ -255,7 +563,7 @@ void CpuSolver::interpolate(CpuGridData& grid, std::size_t level)
 	}
 
 	// Interpolate in x-direction
-#pragma omp parallel for schedule(static,4)
+#pragma omp parallel for num_threads(Affinity::levelThreads(fine.flatSize())) schedule(static,4)
 	for (std::int64_t x = 0; x < fine.getXdim()-2; x += 2) {
 		for (std::size_t y = 0; y < fine.getYdim(); y += 2) {
 			for (std::size_t z = 0; z < fine.getZdim(); z += 2) {
@@ -266,7 +574,7 @@ void CpuSolver::interpolate(CpuGridData& grid, std::size_t level)
 	}
 
 	// Interpolate in y-direction
-#pragma omp parallel for schedule(static,4)
+#pragma omp parallel for num_threads(Affinity::levelThreads(fine.flatSize())) schedule(static,4)
 	for (std::int64_t x = 0; x < fine.getXdim(); x++) {
 		for (std::size_t y = 0; y + 2 < fine.getYdim(); y += 2) {
 			for (std::size_t z = 0; z < fine.getZdim(); z += 2) {
@@ -277,7 +585,7 @@ void CpuSolver::interpolate(CpuGridData& grid, std::size_t level)
 	}
 
 	// Interpolate in z-direction
-#pragma omp parallel for schedule(static,4)
+#pragma omp parallel for num_threads(Affinity::levelThreads(fine.flatSize())) schedule(static,4)
 	for (std::int64_t x = 0; x < fine.getXdim(); x++) {
 		for (std::size_t y = 0; y < fine.getYdim(); y++) {
 			for (std::size_t z = 0; z + 2 < fine.getZdim(); z += 2) {
@@ -1,16 +1,24 @@
 #pragma once
 #include "CpuGridData.h"
+#include "../SolveResult.h"
 
 class CpuSolver {
 public:
 
-	static void solve(CpuGridData& grid);
+	static SolveResult solve(CpuGridData& grid);
 	static void restrict(const Vector3& src, Vector3& dst);
 
 private:
 	static double compResidual(CpuGridData& grid, std::size_t level);
-	static double vcycle(CpuGridData& grid);
+	static double vcycle(CpuGridData& grid, const Vector3* restrictedF);
+	static void smooth(CpuGridData& grid, std::size_t level, std::size_t maxiter);
 	static void jacobi(CpuGridData& grid, std::size_t level, std::size_t maxiter);
-	static void applyStencil(CpuGridData& grid, std::size_t level, const Vector3& v);
+	static void activeJacobi(CpuGridData& grid, std::size_t level, std::size_t maxiter);
+	static void blockJacobi(CpuGridData& grid, std::size_t level, std::size_t maxiter);
+	// Blocks along z the block smoother corrects at once, one per SIMD lane
+	static constexpr std::size_t blockLanes = 8;
+	static void blockRun(CpuGridData::LevelData& level, double omega, const double* inverse, std::size_t x0, std::size_t y0, std::size_t z0, std::size_t count);
+	static void lineRelax(CpuGridData& grid, std::size_t level, std::size_t axis, std::size_t color);
+	static void fasTransfer(CpuGridData& grid, std::size_t level, const Vector3* restrictedF);
 	static void interpolate(CpuGridData& grid, std::size_t level);
 };
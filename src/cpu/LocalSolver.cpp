@@ -0,0 +1,281 @@
+#include "LocalSolver.h"
+#include "CpuSolver.h"
+#include "Affinity.h"
+#include "Operator.h"
+#include "../Timer.h"
+#include <assert.h>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+// A local cycle has to at least halve the residual, otherwise the change isn't local enough
+static constexpr double stallFactor = 0.5;
+
+SolveResult LocalSolver::resolve(CpuGridData& grid, const Box& changed, const SolveResult& previous)
+{
+	assert(grid.mode == GridParams::LINEAR);
+
+	const std::size_t finest = grid.finestLevel;
+	CpuGridData::LevelData& fine = grid.getLevel(finest);
+
+	// boxes[i] belongs to level finest + i
+	std::vector<Box> boxes;
+	boxes.push_back(grow(changed, margin, fine));
+	for (std::size_t i = finest + 1; i < grid.numLevels(); i++) {
+		const CpuGridData::LevelData& level = grid.getLevel(i);
+		boxes.push_back(grow(coarsen(boxes.back(), level), margin, level));
+	}
+
+	// f only changed inside the box, the rest of r is still the one of the previous solve
+	const Box residualBox = grow(boxes[0], 1, fine);
+	double oldSum = 0.0;
+	for (std::size_t x = residualBox.lo[0]; x < residualBox.hi[0]; x++) {
+		for (std::size_t y = residualBox.lo[1]; y < residualBox.hi[1]; y++) {
+			for (std::size_t z = residualBox.lo[2]; z < residualBox.hi[2]; z++) {
+				const double r = fine.r.get(x, y, z);
+				oldSum += r * r;
+			}
+		}
+	}
+	const double outsideSum = std::max(0.0, previous.residual * previous.residual - oldSum);
+
+	SolveResult result;
+	double lastRes = std::sqrt(outsideSum + residual(grid, finest, residualBox));
+	result.initialResidual = lastRes;
+	result.residual = lastRes;
+	if (grid.printProgress) {
+		std::cout << "Inital residual: " << lastRes << ", updated on " << residualBox.points() << " of " << fine.v.flatSize() << " points\n";
+	}
+
+	const double refResidual = grid.referenceResidual > 0.0 ? grid.referenceResidual : previous.initialResidual;
+	const double stopResidual = refResidual / (1.0 / grid.tol);
+	if (lastRes <= stopResidual) {
+		result.converged = true;
+		return result;
+	}
+
+	if (std::sqrt(outsideSum) > stopResidual) {
+		if (grid.printProgress) {
+			std::cout << "Residual outside of the changed region is above the tolerance, using full cycles\n";
+		}
+		return fullCycles(grid, result, refResidual);
+	}
+
+	// Sum of the corrections of the second finest level, only added to the finest level around the box
+	// during the cycles and everywhere else at the end
+	Vector3 deferred;
+	if (grid.numLevels() > finest + 1) {
+		deferred = grid.getLevel(finest + 1).v;
+		deferred.fill(0.0);
+	}
+
+	for (std::size_t i = 0; i < grid.maxiter; i++) {
+		if (grid.printProgress) {
+			Timer::start();
+		}
+
+		// estimate, the residual away from the box changes with the deferred correction
+		double res = std::sqrt(outsideSum + cycle(grid, boxes, deferred));
+		result.iterations = i + 1;
+
+		if (grid.printProgress) {
+			std::cout << "local iter: " << i << " residual: " << res << ' ';
+			Timer::stop();
+		}
+
+		if (res <= stopResidual || !std::isfinite(res)) {
+			break;
+		}
+		if (res > stallFactor * lastRes) {
+			if (grid.printProgress) {
+				std::cout << "Local cycles stalled\n";
+			}
+			break;
+		}
+		lastRes = res;
+	}
+
+	// Add the deferred correction everywhere else. The interpolated correction isn't smooth on the
+	// fine grid, so it gets one post-smoothing over the whole level before the only full residual.
+	const Box inner = grow(boxes[0], 1, fine);
+	if (grid.numLevels() > finest + 1) {
+#pragma omp parallel for num_threads(Affinity::levelThreads(fine.v.flatSize())) schedule(static,8)
+		for (std::int64_t x = 1; x < fine.levelDim[0] + 1; x++) {
+			for (std::size_t y = 1; y < fine.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < fine.levelDim[2] + 1; z++) {
+					if (!inner.contains(x, y, z)) {
+						fine.v.set(x, y, z, fine.v.get(x, y, z) + interpolateAt(deferred, x, y, z));
+					}
+				}
+			}
+		}
+	}
+
+	const Box whole = { { 1, 1, 1 }, { fine.levelDim[0] + 1, fine.levelDim[1] + 1, fine.levelDim[2] + 1 } };
+	jacobi(grid, finest, whole, grid.postSmoothing);
+	result.residual = std::sqrt(residual(grid, finest, whole));
+	if (grid.printProgress) {
+		std::cout << "residual after " << result.iterations << " local cycles: " << result.residual << '\n';
+	}
+
+	if (result.residual <= stopResidual) {
+		result.converged = true;
+		return result;
+	}
+	if (!std::isfinite(result.residual)) {
+		// diverged, further cycles can't recover
+		return result;
+	}
+	if (grid.printProgress) {
+		std::cout << "Local cycles didn't reach the tolerance, using full cycles\n";
+	}
+	return fullCycles(grid, result, refResidual);
+}
+
+// Full cycles from the current solution, still measured against the first solve
+SolveResult LocalSolver::fullCycles(CpuGridData& grid, const SolveResult& local, double refResidual)
+{
+	const double oldReference = grid.referenceResidual;
+	grid.referenceResidual = refResidual;
+	SolveResult full = CpuSolver::solve(grid);
+	grid.referenceResidual = oldReference;
+
+	full.initialResidual = local.initialResidual;
+	full.iterations += local.iterations;
+	return full;
+}
+
+LocalSolver::Box LocalSolver::grow(const Box& box, std::size_t points, const CpuGridData::LevelData& level)
+{
+	Box grown;
+	for (std::size_t axis = 0; axis < 3; axis++) {
+		grown.lo[axis] = box.lo[axis] > points ? box.lo[axis] - points : 1;
+		grown.hi[axis] = std::min(box.hi[axis] + points, level.levelDim[axis] + 1);
+	}
+	return grown;
+}
+
+LocalSolver::Box LocalSolver::coarsen(const Box& box, const CpuGridData::LevelData& coarse)
+{
+	// coarse point x restricts the fine points 2 * x - 1 to 2 * x + 1
+	Box coarsened;
+	for (std::size_t axis = 0; axis < 3; axis++) {
+		coarsened.lo[axis] = (box.lo[axis] + 2) / 2;
+		coarsened.hi[axis] = std::min(box.hi[axis] / 2, coarse.levelDim[axis] + 1);
+	}
+	return coarsened;
+}
+
+double LocalSolver::residual(CpuGridData& grid, std::size_t levelNum, const Box& box)
+{
+	CpuGridData::LevelData& level = grid.getLevel(levelNum);
+	const bool useGalerkin = grid.galerkin && levelNum > grid.finestLevel;
+
+	double res = 0.0;
+
+#pragma omp parallel for num_threads(Affinity::levelThreads(box.points())) schedule(static,4) reduction(+:res)
+	for (std::int64_t x = box.lo[0]; x < box.hi[0]; x++) {
+		for (std::size_t y = box.lo[1]; y < box.hi[1]; y++) {
+			for (std::size_t z = box.lo[2]; z < box.hi[2]; z++) {
+				double r = level.f.get(x, y, z) - applyOperator(grid, level, useGalerkin, level.v, x, y, z);
+				level.r.set(x, y, z, r);
+				res += r * r;
+			}
+		}
+	}
+
+	return res;
+}
+
+void LocalSolver::jacobi(CpuGridData& grid, std::size_t levelNum, const Box& box, std::size_t sweeps)
+{
+	CpuGridData::LevelData& level = grid.getLevel(levelNum);
+	const bool useGalerkin = grid.galerkin && levelNum > grid.finestLevel;
+	const double preFac = useGalerkin ? level.op.center() : grid.stencil.values[0] / (level.h * level.h);
+	const double alpha = 1.0 / preFac; // stencil center
+
+	for (std::size_t i = 0; i < sweeps; i++) {
+
+		residual(grid, levelNum, box);
+
+#pragma omp parallel for num_threads(Affinity::levelThreads(box.points())) schedule(static,4)
+		for (std::int64_t x = box.lo[0]; x < box.hi[0]; x++) {
+			for (std::size_t y = box.lo[1]; y < box.hi[1]; y++) {
+				for (std::size_t z = box.lo[2]; z < box.hi[2]; z++) {
+					level.v.set(x, y, z, level.v.get(x, y, z) + grid.omega * (alpha * level.r.get(x, y, z)));
+				}
+			}
+		}
+	}
+}
+
+double LocalSolver::cycle(CpuGridData& grid, const std::vector<Box>& boxes, Vector3& deferred)
+{
+	const std::size_t finest = grid.finestLevel;
+	const std::size_t coarsest = grid.numLevels() - 1;
+
+	for (std::size_t i = finest; i < coarsest; i++) {
+		const Box& box = boxes[i - finest];
+		jacobi(grid, i, box, grid.preSmoothing);
+
+		// the restriction reads the residual one point around the box
+		CpuGridData::LevelData& level = grid.getLevel(i);
+		residual(grid, i, box);
+
+		// error equation on the next level, its right hand side is zero away from the box
+		CpuGridData::LevelData& next = grid.getLevel(i + 1);
+		next.v.fill(0.0);
+		next.f.fill(0.0);
+
+		const Box restricted = coarsen(box, next);
+#pragma omp parallel for num_threads(Affinity::levelThreads(restricted.points())) schedule(static,4)
+		for (std::int64_t x = restricted.lo[0]; x < restricted.hi[0]; x++) {
+			for (std::size_t y = restricted.lo[1]; y < restricted.hi[1]; y++) {
+				for (std::size_t z = restricted.lo[2]; z < restricted.hi[2]; z++) {
+					next.f.set(x, y, z, restrictAt(level.r, x, y, z));
+				}
+			}
+		}
+	}
+
+	// reached coarsed level, solve now
+	jacobi(grid, coarsest, boxes.back(), grid.preSmoothing + grid.postSmoothing);
+
+	// The coarse levels are cheap enough to correct everywhere
+	for (std::size_t i = coarsest; i > finest + 1; i--) {
+		const CpuGridData::LevelData& coarse = grid.getLevel(i);
+		CpuGridData::LevelData& level = grid.getLevel(i - 1);
+
+#pragma omp parallel for num_threads(Affinity::levelThreads(level.v.flatSize())) schedule(static,8)
+		for (std::int64_t x = 1; x < level.levelDim[0] + 1; x++) {
+			for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+					level.v.set(x, y, z, level.v.get(x, y, z) + interpolateAt(coarse.v, x, y, z));
+				}
+			}
+		}
+
+		jacobi(grid, i - 1, boxes[i - 1 - finest], grid.postSmoothing);
+	}
+
+	// The finest level only around the box, the residual inside of it reads one more point
+	CpuGridData::LevelData& fine = grid.getLevel(finest);
+	if (coarsest > finest) {
+		const CpuGridData::LevelData& coarse = grid.getLevel(finest + 1);
+		deferred += coarse.v;
+
+		const Box inner = grow(boxes[0], 1, fine);
+#pragma omp parallel for num_threads(Affinity::levelThreads(inner.points())) schedule(static,4)
+		for (std::int64_t x = inner.lo[0]; x < inner.hi[0]; x++) {
+			for (std::size_t y = inner.lo[1]; y < inner.hi[1]; y++) {
+				for (std::size_t z = inner.lo[2]; z < inner.hi[2]; z++) {
+					fine.v.set(x, y, z, fine.v.get(x, y, z) + interpolateAt(coarse.v, x, y, z));
+				}
+			}
+		}
+
+		jacobi(grid, finest, boxes[0], grid.postSmoothing);
+	}
+
+	return residual(grid, finest, boxes[0]);
+}
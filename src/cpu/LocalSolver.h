@@ -0,0 +1,49 @@
+#pragma once
+#include "CpuGridData.h"
+#include "../SolveResult.h"
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Re-solves a converged linear problem after f changed in a small region. The residual is only updated
+// around the change and the correction cycles smooth a box around it on every level, the boxes grow by
+// a margin per level until they cover the whole level. Only the coarse levels are corrected everywhere,
+// the correction of the finest level is summed up and added outside of its box once after the cycles.
+// The whole fine grid is then smoothed and checked once, if the residual is still above the tolerance
+// full V-cycles continue from there. Linear mode, Jacobi smoother.
+class LocalSolver {
+public:
+	// Interior points [lo, hi) of a level, coordinates start at 1 like the grid
+	struct Box {
+		std::array<std::size_t, 3> lo;
+		std::array<std::size_t, 3> hi;
+
+		std::size_t points() const
+		{
+			return (hi[0] - lo[0]) * (hi[1] - lo[1]) * (hi[2] - lo[2]);
+		}
+		bool contains(std::size_t x, std::size_t y, std::size_t z) const
+		{
+			return x >= lo[0] && x < hi[0] && y >= lo[1] && y < hi[1] && z >= lo[2] && z < hi[2];
+		}
+	};
+
+	// Points each box grows by per level
+	static constexpr std::size_t margin = 8;
+
+	// grid holds the solution of the previous solve and its fine grid residual in r, f has been changed
+	// inside 'changed'. previous is the result of that solve, its residual is updated instead of recomputed.
+	static SolveResult resolve(CpuGridData& grid, const Box& changed, const SolveResult& previous);
+
+private:
+	static Box grow(const Box& box, std::size_t points, const CpuGridData::LevelData& level);
+	// Coarse points whose restriction only reads fine points inside the box
+	static Box coarsen(const Box& box, const CpuGridData::LevelData& coarse);
+
+	// r = f - A(v) inside the box, returns the sum of r^2
+	static double residual(CpuGridData& grid, std::size_t level, const Box& box);
+	static void jacobi(CpuGridData& grid, std::size_t level, const Box& box, std::size_t sweeps);
+	// Returns the new sum of r^2 inside the box of the finest level
+	static double cycle(CpuGridData& grid, const std::vector<Box>& boxes, Vector3& deferred);
+	static SolveResult fullCycles(CpuGridData& grid, const SolveResult& local, double refResidual);
+};
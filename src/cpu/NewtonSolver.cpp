@@ -1,29 +1,123 @@
 #include "NewtonSolver.h"
 #include "CpuSolver.h"
 #include "../Timer.h"
+#include "Anderson.h"
+#include "Affinity.h"
+#include "Operator.h"
+#include "../Nonlinearity.h"
+#include "../Watchdog.h"
+#include <algorithm>
+#include <memory>
 #include <iostream>
+#include <math.h>
+#include <cmath>
 #ifdef _WIN32
 	#include <windows.h>
 	#include <psapi.h>
 #endif
 
-void NewtonSolver::solve(CpuGridData& grid) {
-	// Stores the original right hand side, never gets changed
-	grid.newtonF = grid.getLevel(0).f;
+SolveResult NewtonSolver::solve(CpuGridData& grid) {
+	// Stores the original right hand side, never gets changed.
+	// Only done once, so repeated solves (continuation) keep the original f
+	if (grid.newtonF.flatSize() == 0) {
+		grid.newtonF = grid.getLevel(0).f;
+	}
+
+	double refResidual = grid.referenceResidual;
+	if (grid.gridSequencing > 0 && grid.numLevels() > 2) {
+		// the tolerance stays relative to the residual of the initial guess, not of the sequenced one
+		if (refResidual <= 0.0) {
+			refResidual = compF(grid, grid.newtonF);
+		}
+		sequence(grid);
+	}
+
+	return iterate(grid, grid.newtonF, grid.tol, refResidual);
+}
+
+// Solves on the coarser levels first, each solution interpolated up is the initial newtonV of the next finer level
+void NewtonSolver::sequence(CpuGridData& grid)
+{
+	// The coarse solutions only need to be more accurate than their discretization,
+	// the coarsest level stays below them for the multigrid solves
+	constexpr double sequenceTol = 1e-3;
+	const std::size_t coarsest = std::min(grid.gridSequencing, grid.numLevels() - 2);
+
+	// right hand sides of the coarse problems, restricted from the original one
+	std::vector<Vector3> rhs(coarsest + 1);
+	for (std::size_t i = 1; i <= coarsest; i++) {
+		rhs[i] = grid.getLevel(i).f;
+		CpuSolver::restrict(i == 1 ? grid.newtonF : rhs[i - 1], rhs[i]);
+	}
+
+	grid.getLevel(coarsest).newtonV.fill(0.0);
+	for (std::size_t i = coarsest; i > 0; i--) {
+		const CpuGridData::LevelData& level = grid.getLevel(i);
+		std::cout << "Grid sequencing, level " << i << " (" << level.levelDim[0] << 'x' << level.levelDim[1] << 'x' << level.levelDim[2] << ")\n";
+
+		grid.finestLevel = i;
+		iterate(grid, rhs[i], sequenceTol, 0.0);
+
+		// initial newtonV of the next finer level
+		CpuGridData::LevelData& fine = grid.getLevel(i - 1);
+#pragma omp parallel for num_threads(Affinity::levelThreads(fine.newtonV.flatSize())) schedule(static,8)
+		for (std::int64_t x = 1; x < fine.levelDim[0] + 1; x++) {
+			for (std::size_t y = 1; y < fine.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < fine.levelDim[2] + 1; z++) {
+					fine.newtonV.set(x, y, z, interpolateAt(level.newtonV, x, y, z));
+				}
+			}
+		}
+	}
+	grid.finestLevel = 0;
+}
+
+// Newton iterations on grid.finestLevel, starting from its newtonV.
+// The tolerance is relative to refResidual, or to the initial residual if that is 0
+SolveResult NewtonSolver::iterate(CpuGridData& grid, const Vector3& rhs, double tol, double refResidual)
+{
+	const std::size_t finest = grid.finestLevel;
+	SolveResult result;
 
 	// Compute inital residual
-	double initialResidual = compF(grid);
+	double initialResidual = compF(grid, rhs);
+	result.initialResidual = initialResidual;
+	result.residual = initialResidual;
 	std::cout << "Inital newton residual: " << initialResidual << '\n';
 
+	const double stopResidual = (refResidual > 0.0 ? refResidual : initialResidual) / (1.0 / tol);
+
+	std::unique_ptr<Anderson> anderson;
+	if (grid.andersonDepth > 0) {
+		anderson = std::make_unique<Anderson>(grid.andersonDepth, grid.getLevel(finest).newtonV);
+	}
+
+	// the iterate with the best residual so far, the watchdog rolls back to it
+	Watchdog watchdog(grid, Watchdog::NEWTON, initialResidual);
+	Vector3 lastGood;
+	if (watchdog.enabled()) {
+		lastGood = grid.getLevel(finest).newtonV;
+	}
+
 	for (std::size_t i = 0; i < grid.maxiter; i++) {
 		Timer::start();
 		
-		compF(grid);
-		grid.getLevel(0).v.fill(0.0);
+		compF(grid, rhs);
+		grid.getLevel(finest).v.fill(0.0);
+
+		if (anderson) {
+			anderson->saveIterate(grid.getLevel(finest).newtonV);
+		}
 
-		findError(grid);
+		findError(grid, watchdog.damping());
 
-		double res = compF(grid);
+		if (anderson) {
+			anderson->mix(grid.getLevel(finest).newtonV);
+		}
+
+		double res = compF(grid, rhs);
+		result.iterations = i + 1;
+		result.residual = res;
 		std::cout << "newton iter: " << i << " residual: " << res << ' ';
 		Timer::stop();
 
@@ -34,24 +128,46 @@ void NewtonSolver::solve(CpuGridData& grid) {
 		}
 #endif
 
-		if (res <= initialResidual / (1.0 / grid.tol)) {
-			return;
+		if (res <= stopResidual) {
+			result.converged = true;
+			return result;
+		}
+		if (watchdog.enabled()) {
+			const Watchdog::Verdict verdict = watchdog.check(res);
+			if (verdict == Watchdog::IMPROVED) {
+				lastGood = grid.getLevel(finest).newtonV;
+			}else if (verdict == Watchdog::DIVERGED) {
+				grid.getLevel(finest).newtonV = lastGood;
+				result.residual = watchdog.bestResidual();
+				if (!watchdog.backOff(res)) {
+					return result;
+				}
+				if (anderson) {
+					// the history belongs to the abandoned iterates
+					anderson = std::make_unique<Anderson>(grid.andersonDepth, grid.getLevel(finest).newtonV);
+				}
+				continue;
+			}
+		}
+		if (!std::isfinite(res)) {
+			return result;
 		}
 
 	}
 
-	// Result is stored in level_0.newtonV
+	// Result is stored in newtonV of the finest level
+	return result;
 }
 
-// computes the residual using newtonV and the original right hand side (newtonF)
-// stores the result in level_0.f
-double NewtonSolver::compF(CpuGridData& grid)
+// computes the residual using newtonV and the right hand side of the Newton problem (newtonF on level 0)
+// stores the result in f of the finest level
+double NewtonSolver::compF(CpuGridData& grid, const Vector3& rhs)
 {
-	CpuGridData::LevelData& level = grid.getLevel(0);
+	CpuGridData::LevelData& level = grid.getLevel(grid.finestLevel);
 
 	double Fnorm = 0.0;
 
-#pragma omp parallel for schedule(static,8) reduction(+:Fnorm)
+#pragma omp parallel for num_threads(Affinity::levelThreads(level.v.flatSize())) schedule(static,8) reduction(+:Fnorm)
 	for (std::int64_t x = 1; x < level.levelDim[0]+1; x++) {
 		for (std::size_t y = 1; y < level.levelDim[1]+1; y++) {
 			for (std::size_t z = 1; z < level.levelDim[2]+1; z++) {
@@ -64,12 +180,9 @@ double NewtonSolver::compF(CpuGridData& grid)
 
 				stencilsum /= level.h * level.h;
 
-				// See tutorial_multigrid.pdf, page 102, Formula 6.13
-				double ex = exp(level.newtonV.get(x, y, z));
-				double nonLinear = grid.gamma * level.newtonV.get(x, y, z) * ex;
-				stencilsum += nonLinear;
+				stencilsum += Nonlinearity::value(grid.gamma, level.newtonV.get(x, y, z));
 
-				double f = grid.newtonF.get(x, y, z) - stencilsum;
+				double f = rhs.get(x, y, z) - stencilsum;
 				level.f.set(x, y, z, f);
 
 				Fnorm += f * f;
@@ -80,12 +193,13 @@ double NewtonSolver::compF(CpuGridData& grid)
 	return sqrt(Fnorm);
 }
 
-void NewtonSolver::findError(CpuGridData& grid)
+// damping: fraction of the correction added to newtonV
+void NewtonSolver::findError(CpuGridData& grid, double damping)
 {
 	// Solve f = J(v)*e, where f is the residual r, computed from the current newtonV and the original right hand side
 
 	// restrict newtonV to all levels
-	for (std::size_t i = 1; i < grid.numLevels() - 1; i++) {
+	for (std::size_t i = grid.finestLevel + 1; i < grid.numLevels() - 1; i++) {
 		const Vector3& src = grid.getLevel(i - 1).newtonV;
 		Vector3& dst = grid.getLevel(i).newtonV;
 		CpuSolver::restrict(src, dst);
@@ -94,15 +208,18 @@ void NewtonSolver::findError(CpuGridData& grid)
 	grid.printProgress = false;
 	std::size_t origIter = grid.maxiter;
 	double origTol = grid.tol;
+	double origRefResidual = grid.referenceResidual;
 	grid.maxiter = 10;
 	grid.tol = 0.1;
+	grid.referenceResidual = 0.0;
 
 	CpuSolver::solve(grid);
 
 	grid.printProgress = true;
 	grid.maxiter = origIter;
 	grid.tol = origTol;
+	grid.referenceResidual = origRefResidual;
 
-	Vector3& newtonV = grid.getLevel(0).newtonV;
-	newtonV += grid.getLevel(0).v;
+	Vector3& newtonV = grid.getLevel(grid.finestLevel).newtonV;
+	newtonV.addScaled(grid.getLevel(grid.finestLevel).v, damping);
 }
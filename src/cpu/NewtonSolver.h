@@ -1,11 +1,14 @@
 #pragma once
 #include "CpuGridData.h"
+#include "../SolveResult.h"
 
 class NewtonSolver {
 public:
-	static void solve(CpuGridData& grid);
+	static SolveResult solve(CpuGridData& grid);
 
 private:
-	static void findError(CpuGridData& grid);
-	static double compF(CpuGridData& grid);
+	static void sequence(CpuGridData& grid);
+	static SolveResult iterate(CpuGridData& grid, const Vector3& rhs, double tol, double refResidual);
+	static void findError(CpuGridData& grid, double damping);
+	static double compF(CpuGridData& grid, const Vector3& rhs);
 };
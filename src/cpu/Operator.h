@@ -0,0 +1,61 @@
+#pragma once
+#include "CpuGridData.h"
+#include <cstdlib>
+
+// Point-wise building blocks of the CPU solvers
+
+// A*v at one point, without the non-linear part
+inline double applyOperator(const CpuGridData& grid, const CpuGridData::LevelData& level, bool useGalerkin, const Vector3& v, std::size_t x, std::size_t y, std::size_t z)
+{
+	double stencilsum = 0.0;
+	if (useGalerkin) {
+		for (std::size_t i = 0; i < level.op.values.size(); i++) {
+			if (level.op.values[i] != 0.0) {
+				stencilsum += level.op.values[i] * v.get(x + Stencil27::getXOffset(i), y + Stencil27::getYOffset(i), z + Stencil27::getZOffset(i));
+			}
+		}
+		return stencilsum;
+	}
+
+	for (std::size_t i = 0; i < grid.stencil.values.size(); i++) {
+		double vVal = v.get(x + grid.stencil.getXOffset(i), y + grid.stencil.getYOffset(i), z + grid.stencil.getZOffset(i));
+		stencilsum += grid.stencil.values[i] * vVal;
+	}
+	return stencilsum / (level.h * level.h);
+}
+
+// Full weighting of the fine values around the coarse point x, y, z
+inline double restrictAt(const Vector3& fine, std::size_t x, std::size_t y, std::size_t z)
+{
+	std::size_t xCenter = 2 * x;
+	std::size_t yCenter = 2 * y;
+	std::size_t zCenter = 2 * z;
+
+	double coarseValue = 0.0;
+
+	for (int ii = -2 + 1; ii < 2; ii++) {
+		for (int jj = -2 + 1; jj < 2; jj++) {
+			for (int kk = -2 + 1; kk < 2; kk++) {
+				double fac = 0.125 * ((2.0 - std::abs(ii)) / 2.0) * ((2.0 - std::abs(jj)) / 2.0) * ((2.0 - std::abs(kk)) / 2.0);
+				coarseValue += fac * fine.get(xCenter + ii, yCenter + jj, zCenter + kk);
+			}
+		}
+	}
+
+	return coarseValue;
+}
+
+// Trilinear interpolation of the coarse values at the fine point x, y, z.
+// Even coordinates lie on a coarse point, so both neighbours are the same there.
+inline double interpolateAt(const Vector3& coarse, std::size_t x, std::size_t y, std::size_t z)
+{
+	double sum = 0.0;
+	for (std::size_t xc : { x / 2, (x + 1) / 2 }) {
+		for (std::size_t yc : { y / 2, (y + 1) / 2 }) {
+			for (std::size_t zc : { z / 2, (z + 1) / 2 }) {
+				sum += coarse.get(xc, yc, zc);
+			}
+		}
+	}
+	return 0.125 * sum;
+}
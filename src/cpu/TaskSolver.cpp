@@ -0,0 +1,346 @@
+#include "TaskSolver.h"
+#include "CpuSolver.h"
+#include "Affinity.h"
+#include "Operator.h"
+#include "../Nonlinearity.h"
+#include "../Timer.h"
+#include <iostream>
+#include <cmath>
+
+// Task dependencies with iterators are OpenMP 5.0, GCC has them since 9 but still reports 4.5
+#if defined(_OPENMP) && (_OPENMP >= 201811 || (defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9))
+	#define TASK_GRAPH_SUPPORTED
+#endif
+
+namespace {
+	// r = f - A(v) on the planes [begin, end), returns the sum of r^2
+	double residualPlanes(CpuGridData& grid, std::size_t levelNum, std::int64_t begin, std::int64_t end)
+	{
+		CpuGridData::LevelData& level = grid.getLevel(levelNum);
+		const bool useGalerkin = grid.galerkin && levelNum > 0;
+
+		double res = 0.0;
+		for (std::int64_t x = begin; x < end; x++) {
+			for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+					double stencilsum = applyOperator(grid, level, useGalerkin, level.v, x, y, z);
+
+					if (grid.mode == GridParams::NONLINEAR) {
+						stencilsum += Nonlinearity::value(grid.gamma, level.v.get(x, y, z));
+					}
+
+					double r = level.f.get(x, y, z) - stencilsum;
+					level.r.set(x, y, z, r);
+					res += r * r;
+				}
+			}
+		}
+		return res;
+	}
+
+	void jacobiPlanes(CpuGridData& grid, std::size_t levelNum, std::int64_t begin, std::int64_t end)
+	{
+		CpuGridData::LevelData& level = grid.getLevel(levelNum);
+		const bool useGalerkin = grid.galerkin && levelNum > 0;
+		const double preFac = useGalerkin ? level.op.center() : grid.stencil.values[0] / (level.h * level.h);
+		const double alpha = 1.0 / preFac; // stencil center
+
+		for (std::int64_t x = begin; x < end; x++) {
+			for (std::size_t y = 1; y < level.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < level.levelDim[2] + 1; z++) {
+					double newV;
+					if (grid.mode == GridParams::LINEAR) {
+						newV = level.v.get(x, y, z) + grid.omega * (alpha * level.r.get(x, y, z));
+					}else {
+						// See tutorial_multigrid.pdf, page 103, Formula 6.14
+						double denuminator = preFac + Nonlinearity::derivative(grid.gamma, level.v.get(x, y, z));
+
+						newV = level.v.get(x, y, z) + grid.omega * (level.r.get(x, y, z) / denuminator);
+					}
+					level.v.set(x, y, z, newV);
+				}
+			}
+		}
+	}
+
+	// Restricts the residual into f of the coarse level, and v into v and restV for FAS
+	void restrictPlanes(CpuGridData& grid, std::size_t coarseNum, std::int64_t begin, std::int64_t end)
+	{
+		CpuGridData::LevelData& fine = grid.getLevel(coarseNum - 1);
+		CpuGridData::LevelData& coarse = grid.getLevel(coarseNum);
+
+		for (std::int64_t x = begin; x < end; x++) {
+			for (std::size_t y = 1; y < coarse.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < coarse.levelDim[2] + 1; z++) {
+					coarse.f.set(x, y, z, restrictAt(fine.r, x, y, z));
+
+					if (grid.mode == GridParams::LINEAR) {
+						coarse.v.set(x, y, z, 0.0);
+					}else {
+						const double restV = restrictAt(fine.v, x, y, z);
+						coarse.restV.set(x, y, z, restV);
+						coarse.v.set(x, y, z, restV);
+					}
+				}
+			}
+		}
+	}
+
+	// FAS right hand side, f^2h += A^2h (v^2h)
+	void coarseRhsPlanes(CpuGridData& grid, std::size_t coarseNum, std::int64_t begin, std::int64_t end)
+	{
+		CpuGridData::LevelData& coarse = grid.getLevel(coarseNum);
+		const bool useGalerkin = grid.galerkin && coarseNum > 0;
+
+		for (std::int64_t x = begin; x < end; x++) {
+			for (std::size_t y = 1; y < coarse.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < coarse.levelDim[2] + 1; z++) {
+					double stencilsum = applyOperator(grid, coarse, useGalerkin, coarse.restV, x, y, z);
+					stencilsum += Nonlinearity::value(grid.gamma, coarse.restV.get(x, y, z));
+					coarse.f.set(x, y, z, coarse.f.get(x, y, z) + stencilsum);
+				}
+			}
+		}
+	}
+
+	// v^h += P(v^2h), or P(v^2h - restricted v^h) for FAS
+	void correctPlanes(CpuGridData& grid, std::size_t fineNum, std::int64_t begin, std::int64_t end)
+	{
+		CpuGridData::LevelData& fine = grid.getLevel(fineNum);
+		const CpuGridData::LevelData& coarse = grid.getLevel(fineNum + 1);
+
+		for (std::int64_t x = begin; x < end; x++) {
+			for (std::size_t y = 1; y < fine.levelDim[1] + 1; y++) {
+				for (std::size_t z = 1; z < fine.levelDim[2] + 1; z++) {
+					double e = interpolateAt(coarse.v, x, y, z);
+					if (grid.mode == GridParams::NONLINEAR) {
+						e -= interpolateAt(coarse.restV, x, y, z);
+					}
+					fine.v.set(x, y, z, fine.v.get(x, y, z) + e);
+				}
+			}
+		}
+	}
+}
+
+bool TaskSolver::available()
+{
+#ifdef TASK_GRAPH_SUPPORTED
+	return true;
+#else
+	return false;
+#endif
+}
+
+SolveResult TaskSolver::solve(CpuGridData& grid)
+{
+	if (!available()) {
+		std::cerr << "The task graph needs OpenMP 5.0, using the parallel loops instead\n";
+		return CpuSolver::solve(grid);
+	}
+
+	SolveResult result;
+	std::vector<Tiling> tilings = makeTilings(grid);
+
+	double initialResidual = run(grid, tilings, false);
+	result.initialResidual = initialResidual;
+	result.residual = initialResidual;
+	if (grid.printProgress) {
+		std::cout << "Inital residual: " << initialResidual << '\n';
+	}
+
+	const double refResidual = grid.referenceResidual > 0.0 ? grid.referenceResidual : initialResidual;
+	const double stopResidual = refResidual / (1.0 / grid.tol);
+
+	for (std::size_t i = 0; i < grid.maxiter; i++) {
+		if (grid.printProgress) {
+			Timer::start();
+		}
+
+		double res = run(grid, tilings, true);
+		result.iterations = i + 1;
+		result.residual = res;
+
+		if (grid.printProgress) {
+			std::cout << "iter: " << i << " residual: " << res << ' ';
+			Timer::stop();
+		}
+
+		if (res <= stopResidual) {
+			result.converged = true;
+			return result;
+		}
+		if (!std::isfinite(res)) {
+			// diverged, further cycles can't recover
+			return result;
+		}
+	}
+
+	return result;
+}
+
+std::vector<TaskSolver::Tiling> TaskSolver::makeTilings(const CpuGridData& grid)
+{
+	std::vector<Tiling> tilings(grid.numLevels());
+	for (std::size_t i = 0; i < grid.numLevels(); i++) {
+		const CpuGridData::LevelData& level = grid.getLevel(i);
+		Tiling& tiles = tilings[i];
+
+		// A few slabs per thread, so the scheduler can even out slow threads
+		const std::int64_t target = 4 * Affinity::levelThreads(level.v.flatSize());
+		tiles.n = static_cast<std::int64_t>(level.levelDim[0]);
+		tiles.width = std::max<std::int64_t>(1, (tiles.n + target - 1) / target);
+		tiles.count = (tiles.n + tiles.width - 1) / tiles.width;
+		tiles.v.resize(tiles.count);
+		tiles.restV.resize(tiles.count);
+		tiles.f.resize(tiles.count);
+		tiles.r.resize(tiles.count);
+	}
+	return tilings;
+}
+
+double TaskSolver::run(CpuGridData& grid, std::vector<Tiling>& tilings, bool vcycle)
+{
+	std::vector<double> partialSums(tilings[0].count, 0.0);
+
+#ifdef TASK_GRAPH_SUPPORTED
+#pragma omp parallel
+#pragma omp single
+	{
+		if (vcycle) {
+			for (std::size_t i = 0; i < grid.numLevels() - 1; i++) {
+				smoothTasks(grid, tilings, i, grid.preSmoothing);
+				residualTasks(grid, tilings, i, nullptr);
+				restrictTasks(grid, tilings, i);
+			}
+
+			// reached coarsed level, solve now
+			smoothTasks(grid, tilings, grid.numLevels() - 1, grid.preSmoothing + grid.postSmoothing);
+
+			for (std::size_t i = grid.numLevels() - 1; i > 0; i--) {
+				correctTasks(grid, tilings, i - 1);
+				smoothTasks(grid, tilings, i - 1, grid.postSmoothing);
+			}
+		}
+
+		residualTasks(grid, tilings, 0, partialSums.data());
+	}
+#endif
+
+	double res = 0.0;
+	for (double sum : partialSums) {
+		res += sum;
+	}
+	return sqrt(res);
+}
+
+void TaskSolver::smoothTasks(CpuGridData& grid, std::vector<Tiling>& tilings, std::size_t level, std::size_t sweeps)
+{
+#ifdef TASK_GRAPH_SUPPORTED
+	const Tiling& tiles = tilings[level];
+	// The tokens only show up in depend clauses, which GCC doesn't count as a use
+	[[maybe_unused]] char* rTok = tilings[level].r.data();
+	[[maybe_unused]] char* vTok = tilings[level].v.data();
+
+	for (std::size_t i = 0; i < sweeps; i++) {
+		residualTasks(grid, tilings, level, nullptr);
+
+		for (std::int64_t t = 0; t < tiles.count; t++) {
+			const std::int64_t begin = tiles.begin(t);
+			const std::int64_t end = tiles.end(t);
+			// Reference parameters are firstprivate in orphaned tasks, grid would be copied without shared
+#pragma omp task shared(grid) depend(in: rTok[t]) depend(inout: vTok[t])
+			jacobiPlanes(grid, level, begin, end);
+		}
+	}
+#endif
+}
+
+// partialSums: sum of r^2 per slab, nullptr if not needed
+void TaskSolver::residualTasks(CpuGridData& grid, std::vector<Tiling>& tilings, std::size_t level, double* partialSums)
+{
+#ifdef TASK_GRAPH_SUPPORTED
+	const Tiling& tiles = tilings[level];
+	[[maybe_unused]] char* vTok = tilings[level].v.data();
+	[[maybe_unused]] char* fTok = tilings[level].f.data();
+	[[maybe_unused]] char* rTok = tilings[level].r.data();
+
+	for (std::int64_t t = 0; t < tiles.count; t++) {
+		const std::int64_t begin = tiles.begin(t);
+		const std::int64_t end = tiles.end(t);
+		// the stencil reaches one plane into the neighbouring slabs
+		const std::int64_t lo = tiles.tileOf(begin - 1);
+		const std::int64_t hi = tiles.tileOf(end) + 1;
+		double* partialSum = partialSums ? partialSums + t : nullptr;
+
+#pragma omp task shared(grid) depend(iterator(j = lo:hi), in: vTok[j]) depend(in: fTok[t]) depend(out: rTok[t])
+		{
+			const double res = residualPlanes(grid, level, begin, end);
+			if (partialSum) {
+				*partialSum = res;
+			}
+		}
+	}
+#endif
+}
+
+// level -> level + 1
+void TaskSolver::restrictTasks(CpuGridData& grid, std::vector<Tiling>& tilings, std::size_t level)
+{
+#ifdef TASK_GRAPH_SUPPORTED
+	const Tiling& fine = tilings[level];
+	const Tiling& coarse = tilings[level + 1];
+	[[maybe_unused]] char* fineR = tilings[level].r.data();
+	[[maybe_unused]] char* fineV = tilings[level].v.data();
+	[[maybe_unused]] char* coarseF = tilings[level + 1].f.data();
+	[[maybe_unused]] char* coarseV = tilings[level + 1].v.data();
+	[[maybe_unused]] char* coarseRestV = tilings[level + 1].restV.data();
+	const std::size_t coarseNum = level + 1;
+
+	for (std::int64_t c = 0; c < coarse.count; c++) {
+		const std::int64_t begin = coarse.begin(c);
+		const std::int64_t end = coarse.end(c);
+		// fine planes 2 * begin - 1 up to 2 * (end - 1) + 1
+		const std::int64_t lo = fine.tileOf(2 * begin - 1);
+		const std::int64_t hi = fine.tileOf(2 * end - 1) + 1;
+
+#pragma omp task shared(grid) depend(iterator(j = lo:hi), in: fineR[j], fineV[j]) depend(out: coarseF[c], coarseV[c], coarseRestV[c])
+		restrictPlanes(grid, coarseNum, begin, end);
+	}
+
+	if (grid.mode == GridParams::NONLINEAR) {
+		for (std::int64_t c = 0; c < coarse.count; c++) {
+			const std::int64_t begin = coarse.begin(c);
+			const std::int64_t end = coarse.end(c);
+			const std::int64_t lo = coarse.tileOf(begin - 1);
+			const std::int64_t hi = coarse.tileOf(end) + 1;
+
+#pragma omp task shared(grid) depend(iterator(j = lo:hi), in: coarseRestV[j]) depend(inout: coarseF[c])
+			coarseRhsPlanes(grid, coarseNum, begin, end);
+		}
+	}
+#endif
+}
+
+// level + 1 -> level
+void TaskSolver::correctTasks(CpuGridData& grid, std::vector<Tiling>& tilings, std::size_t level)
+{
+#ifdef TASK_GRAPH_SUPPORTED
+	const Tiling& fine = tilings[level];
+	const Tiling& coarse = tilings[level + 1];
+	[[maybe_unused]] char* fineV = tilings[level].v.data();
+	[[maybe_unused]] char* coarseV = tilings[level + 1].v.data();
+	[[maybe_unused]] char* coarseRestV = tilings[level + 1].restV.data();
+
+	for (std::int64_t t = 0; t < fine.count; t++) {
+		const std::int64_t begin = fine.begin(t);
+		const std::int64_t end = fine.end(t);
+		// coarse planes begin / 2 up to end / 2
+		const std::int64_t lo = coarse.tileOf(begin / 2);
+		const std::int64_t hi = coarse.tileOf(end / 2) + 1;
+
+#pragma omp task shared(grid) depend(iterator(j = lo:hi), in: coarseV[j], coarseRestV[j]) depend(inout: fineV[t])
+		correctPlanes(grid, level, begin, end);
+	}
+#endif
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "CpuGridData.h"
+#include "../SolveResult.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// V-cycles as a task graph. Every level is split into slabs of x-planes and each step of a slab runs
+// as an OpenMP task that only waits for the slabs it reads, e.g. a Jacobi sweep waits for the previous
+// sweep of the neighbouring slabs and a coarse slab is restricted as soon as the fine slabs below it are done.
+// Idle threads steal whatever is ready, so phases and levels overlap instead of meeting at a barrier after
+// every loop. The only barrier is the residual check at the end of each cycle.
+// Linear and non-linear (FAS) mode with the Jacobi smoother, needs OpenMP 5.0.
+class TaskSolver {
+public:
+	static SolveResult solve(CpuGridData& grid);
+	// false if the compiler has no OpenMP 5.0 task dependencies, solve() then runs the CpuSolver
+	static bool available();
+
+private:
+	// Slabs of one level and the dependency tokens of its buffers, only their addresses matter
+	struct Tiling {
+		std::int64_t n; // interior planes 1..n
+		std::int64_t width;
+		std::int64_t count;
+		std::vector<char> v;
+		std::vector<char> restV;
+		std::vector<char> f;
+		std::vector<char> r;
+
+		std::int64_t begin(std::int64_t tile) const
+		{
+			return 1 + tile * width;
+		}
+		std::int64_t end(std::int64_t tile) const
+		{
+			return std::min(n, (tile + 1) * width) + 1;
+		}
+		// Slab containing the plane, planes outside the interior belong to the first or last slab
+		std::int64_t tileOf(std::int64_t x) const
+		{
+			return (std::max<std::int64_t>(1, std::min(x, n)) - 1) / width;
+		}
+	};
+
+	static std::vector<Tiling> makeTilings(const CpuGridData& grid);
+	// Runs one V-cycle (or nothing) followed by the fine grid residual, returns the residual norm
+	static double run(CpuGridData& grid, std::vector<Tiling>& tilings, bool vcycle);
+
+	static void smoothTasks(CpuGridData& grid, std::vector<Tiling>& tilings, std::size_t level, std::size_t sweeps);
+	static void residualTasks(CpuGridData& grid, std::vector<Tiling>& tilings, std::size_t level, double* partialSums);
+	static void restrictTasks(CpuGridData& grid, std::vector<Tiling>& tilings, std::size_t level);
+	static void correctTasks(CpuGridData& grid, std::vector<Tiling>& tilings, std::size_t level);
+};
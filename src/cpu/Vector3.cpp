@@ -2,41 +2,122 @@
 #include <assert.h>
 #include <iostream>
 #include <fstream>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
 
-Vector3::Vector3(std::size_t x, std::size_t y, std::size_t z)
+Vector3::Vector3(std::size_t x, std::size_t y, std::size_t z, Layout::Order order)
+	: Vector3(Layout(x, y, z, order))
 {
-	dims[0] = x;
-	dims[1] = y;
-	dims[2] = z;
-	values.resize(x * y * z);
+}
+
+Vector3::Vector3(const Layout& layout)
+	: storage(std::make_shared<std::vector<double>>(layout.storageSize())), layout(layout)
+{
+	values = storage->data();
+}
+
+void Vector3::interleave(const Layout& layout, const std::vector<Vector3*>& fields)
+{
+	const std::size_t numFields = fields.size();
+	const Layout shared = layout.interleaved(numFields);
+	auto storage = std::make_shared<std::vector<double>>(shared.storageSize());
+
+	for (std::size_t i = 0; i < numFields; i++) {
+		fields[i]->storage = storage;
+		fields[i]->values = storage->data() + (numFields > 1 ? i * Layout::block : 0);
+		fields[i]->layout = shared;
+	}
+}
+
+Vector3::Vector3(const Vector3& rhs)
+	: Vector3(rhs.layout.interleaved(1))
+{
+	copyValues(rhs);
+}
+
+Vector3::Vector3(Vector3&& rhs)
+	: storage(std::move(rhs.storage)), values(rhs.values), layout(rhs.layout)
+{
+	rhs.values = nullptr;
+	rhs.layout = Layout();
+}
+
+Vector3& Vector3::operator=(const Vector3& rhs)
+{
+	if (this == &rhs) {
+		return *this;
+	}
+	if (isInterleaved()) {
+		// replacing the memory would detach the field from the others
+		if (layout != rhs.layout) {
+			throw std::invalid_argument("Can't assign a field with another layout to an interleaved field");
+		}
+	}else {
+		*this = Vector3(rhs.layout.interleaved(1));
+	}
+	copyValues(rhs);
+	return *this;
+}
+
+Vector3& Vector3::operator=(Vector3&& rhs)
+{
+	if (this == &rhs) {
+		return *this;
+	}
+	if (isInterleaved() || rhs.isInterleaved()) {
+		// keep the memory of an interleaved target shared with the other fields,
+		// and don't turn a plain target into a view of the fields of the source
+		return *this = static_cast<const Vector3&>(rhs);
+	}
+	storage = std::move(rhs.storage);
+	values = rhs.values;
+	layout = rhs.layout;
+	rhs.values = nullptr;
+	rhs.layout = Layout();
+	return *this;
+}
+
+void Vector3::copyValues(const Vector3& rhs)
+{
+	assert(layout == rhs.layout);
+
+	if (!isInterleaved() && !rhs.isInterleaved()) {
+		std::copy(rhs.values, rhs.values + flatSize(), values);
+		return;
+	}
+	for (std::size_t i = 0; i < flatSize(); i++) {
+		values[layout.element(i)] = rhs.values[rhs.layout.element(i)];
+	}
 }
 
 void Vector3::set(std::size_t x, std::size_t y, std::size_t z, double val)
 {
-	const std::size_t idx = z + y * dims[2] + x * dims[2] * dims[1];
-	assert(idx < values.size());
+	assert(x < layout.dims[0] && y < layout.dims[1] && z < layout.dims[2]);
+	const std::size_t idx = layout.index(x, y, z);
 	assert(!std::isnan(val) && !std::isinf(val));
 	values[idx] = val;
 }
 
 double Vector3::get(std::size_t x, std::size_t y, std::size_t z) const
 {
-	const std::size_t idx = z + y * dims[2] + x * dims[2] * dims[1];
-	assert(idx < values.size());
-	return values[idx];
+	assert(x < layout.dims[0] && y < layout.dims[1] && z < layout.dims[2]);
+	return values[layout.index(x, y, z)];
 }
 
 void Vector3::fill(double val)
 {
-	std::fill(values.begin(), values.end(), val);
+	for (std::size_t i = 0; i < flatSize(); i++) {
+		values[layout.element(i)] = val;
+	}
 }
 
 Vector3& Vector3::operator+=(const Vector3& rhs)
 {
-	assert(flatSize() == rhs.flatSize());
+	assert(layout == rhs.layout);
 
 	for (std::size_t i = 0; i < flatSize(); i++) {
-		values[i] += rhs.values[i];
+		values[layout.element(i)] += rhs.values[rhs.layout.element(i)];
 	}
 	
 	return *this;
@@ -44,15 +125,47 @@ Vector3& Vector3::operator+=(const Vector3& rhs)
 
 Vector3& Vector3::operator-=(const Vector3& rhs)
 {
-	assert(flatSize() == rhs.flatSize());
+	assert(layout == rhs.layout);
 
 	for (std::size_t i = 0; i < flatSize(); i++) {
-		values[i] -= rhs.values[i];
+		values[layout.element(i)] -= rhs.values[rhs.layout.element(i)];
 	}
 
 	return *this;
 }
 
+Vector3& Vector3::operator*=(double factor)
+{
+	for (std::size_t i = 0; i < flatSize(); i++) {
+		values[layout.element(i)] *= factor;
+	}
+
+	return *this;
+}
+
+void Vector3::addScaled(const Vector3& rhs, double factor)
+{
+	assert(layout == rhs.layout);
+
+#pragma omp parallel for schedule(static)
+	for (std::int64_t i = 0; i < static_cast<std::int64_t>(flatSize()); i++) {
+		values[layout.element(i)] += factor * rhs.values[rhs.layout.element(i)];
+	}
+}
+
+double Vector3::dot(const Vector3& rhs) const
+{
+	assert(layout == rhs.layout);
+
+	double sum = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:sum)
+	for (std::int64_t i = 0; i < static_cast<std::int64_t>(flatSize()); i++) {
+		sum += values[layout.element(i)] * rhs.values[rhs.layout.element(i)];
+	}
+
+	return sum;
+}
+
 void Vector3::dump(const std::string& file) const
 {
 	std::ofstream out;
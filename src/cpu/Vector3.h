@@ -1,12 +1,26 @@
 #pragma once
 #include <vector>
 #include <array>
+#include <memory>
 #include <string>
+#include "../Layout.h"
 
 class Vector3 {
 public:
 	Vector3() = default;
-	Vector3(std::size_t x, std::size_t y, std::size_t z);
+	Vector3(std::size_t x, std::size_t y, std::size_t z, Layout::Order order = Layout::defaultOrder);
+	explicit Vector3(const Layout& layout);
+
+	// Turns the fields into views of one interleaved allocation of the layout, in the given order
+	static void interleave(const Layout& layout, const std::vector<Vector3*>& fields);
+
+	// A copy is a plain field. Assigning to an interleaved field copies the values into its memory,
+	// so it stays interleaved with the others, the layouts have to match then.
+	// Moving an interleaved field into a plain one copies as well, the target doesn't become a view.
+	Vector3(const Vector3& rhs);
+	Vector3(Vector3&& rhs);
+	Vector3& operator=(const Vector3& rhs);
+	Vector3& operator=(Vector3&& rhs);
 
 	void set(std::size_t x, std::size_t y, std::size_t z, double val);
 	double get(std::size_t x, std::size_t y, std::size_t z) const;
@@ -14,27 +28,54 @@ public:
 
 	Vector3& operator+=(const Vector3& rhs);
 	Vector3& operator-=(const Vector3& rhs);
+	Vector3& operator*=(double factor);
+
+	// this += factor * rhs
+	void addScaled(const Vector3& rhs, double factor);
+	double dot(const Vector3& rhs) const;
 
 	std::size_t getXdim() const
 	{
-		return dims[0];
+		return layout.dims[0];
 	}
 	std::size_t getYdim() const
 	{
-		return dims[1];
+		return layout.dims[1];
 	}
 	std::size_t getZdim() const
 	{
-		return dims[2];
+		return layout.dims[2];
 	}
 	std::size_t flatSize() const
 	{
-		return values.size();
+		return layout.size();
+	}
+	const Layout& getLayout() const
+	{
+		return layout;
+	}
+
+	bool isInterleaved() const
+	{
+		return layout.fields > 1;
+	}
+
+	// Flat values in the order of the layout, contiguous only if the field isn't interleaved
+	double* data()
+	{
+		return values;
+	}
+	const double* data() const
+	{
+		return values;
 	}
 
 	void dump(const std::string& file) const;
 
 private:
-	std::vector<double> values;
-	std::array<std::size_t, 3> dims;
+	void copyValues(const Vector3& rhs);
+
+	std::shared_ptr<std::vector<double>> storage; // shared by interleaved fields
+	double* values = nullptr; // first value of this field in the storage
+	Layout layout;
 };
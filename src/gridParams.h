@@ -3,6 +3,12 @@
 #include <vector>
 #include <assert.h>
 #include <tuple>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include "Layout.h"
 
 struct Stencil {
     std::array<double, 7> values;
@@ -23,6 +29,30 @@ struct Stencil {
         assert(i < offsets.size());
         return std::get<2>(offsets[i]);
     }
+
+    // Value for the given offset, 0 if the stencil doesn't contain it
+    double valueAt(int x, int y, int z) const
+    {
+        for (std::size_t i = 0; i < values.size(); i++) {
+            if (getXOffset(i) == x && getYOffset(i) == y && getZOffset(i) == z) {
+                return values[i];
+            }
+        }
+        return 0.0;
+    }
+
+    // Sum of the absolute off-center values that only reach along the given axis
+    double axisCoupling(std::size_t axis) const
+    {
+        double coupling = 0.0;
+        for (std::size_t i = 1; i < values.size(); i++) {
+            const std::array<int, 3> offset{ getXOffset(i), getYOffset(i), getZOffset(i) };
+            if (offset[axis] != 0 && offset[(axis + 1) % 3] == 0 && offset[(axis + 2) % 3] == 0) {
+                coupling += std::abs(values[i]);
+            }
+        }
+        return coupling;
+    }
 };
 
 struct GridParams {
@@ -32,6 +62,28 @@ struct GridParams {
         NEWTON
     };
 
+    enum Smoother {
+        AUTO, // line relaxation if the stencil is anisotropic, Jacobi otherwise
+        JACOBI,
+        LINE,
+        BLOCK // block-Jacobi with exact solves on 2x2x2 blocks, linear mode only
+    };
+
+    // Kernels whose read-only operands are loaded through image views
+    enum ImageReads {
+        IMAGE_RESIDUAL = 1, // v, f and newtonV of the residual
+        IMAGE_RESTRICT = 2, // the fine residual of the V-cycle restriction
+        IMAGE_INTERPOLATE = 4 // the coarse v of the V-cycle interpolation
+    };
+
+    enum Placement {
+        OS, // threads are left to the OpenMP runtime
+        COMPACT, // fill the SMT threads of a core before the next core
+        SCATTER, // spread over NUMA domains and cores, SMT threads last
+        CORE, // one thread per physical core
+        NUMA // one thread per physical core, bound to its NUMA domain instead of a single CPU
+    };
+
     std::size_t maxiter;
     double tol;
     double omega; // Relaxation coefficient
@@ -43,5 +95,98 @@ struct GridParams {
     Stencil stencil{};
     Mode mode;
 
+    // Optional settings, see README
+    bool continuation = false; // ramp gamma from continuationStart up to gamma
+    double continuationStart = 0.0;
+    std::size_t continuationSteps = 4; // initial number of continuation steps
+    std::size_t andersonDepth = 0; // window of the Anderson acceleration, 0 disables it
+    Smoother smoother = AUTO;
+    bool galerkin = false; // coarse levels use R*A*P instead of the rescaled stencil
+    bool tauExtrapolation = false; // non-linear mode only, raises the order of the converged solution
+    std::size_t batchSize = 1; // number of independent problems solved together, SYCL only
+    Placement placement = OS; // CPU only
+    std::size_t threads = 0; // CPU only, 0 uses one thread per CPU of the placement
+    std::size_t gridSequencing = 0; // Newton mode only, number of coarser levels solved before the finest one
+    bool taskGraph = false; // CPU only, run the V-cycles as a task graph instead of parallel loops
+    double activeSet = 0.0; // CPU only, Jacobi skips tiles whose residual is below this fraction of the largest one
+    std::size_t activeSetPeriod = 4; // every n-th V-cycle sweeps all tiles
+    Layout::Order layout = Layout::defaultOrder; // memory layout of all fields
+    bool interleave = false; // CPU only, v, f and r of a level share one small-block interleaved allocation
+    unsigned imageReads = 0; // gtx only, ImageReads flags
+    bool additive = false; // linear mode only, additive cycles that smooth all levels at the same time
+    // CPU and linear mode only, after the solve f is changed by updateValue in a cube of updateSize points
+    // starting at updateOrigin and the problem is re-solved locally, 0 disables it
+    std::size_t updateSize = 0;
+    std::array<std::size_t, 3> updateOrigin{ 1, 1, 1 };
+    double updateValue = 0.0;
+
+    // Prefix of the compressed solution and right hand side written after the solve, empty disables it
+    std::string output;
+    bool outputRelative = true; // the error bound is relative to the value range of each field
+    double outputBound = 1e-6;
+    bool verifyOutput = false; // read the written fields back and check the error bound
+
+    std::string kernelArchive; // directory with kernels generated ahead of time, gtx only
+    std::string kernelExport; // write the generated kernels to this directory, gtx only
+
+    // Recoveries from a diverging solve before it gives up, 0 disables the watchdog, see Watchdog.h
+    std::size_t watchdog = 0;
+    double watchdogGrowth = 10.0; // a residual above this multiple of the best one so far diverges
+
+    // Set by the watchdog: false while Newton keeps the settings its inner solves backed off to,
+    // and the number of back-offs in effect, which tags the kernels generated with them
+    bool watchdogRestore = true;
+    std::size_t watchdogBackOffs = 0;
+
     bool printProgress = true;
+    // If set, convergence is measured relative to this residual instead of the initial one
+    double referenceResidual = 0.0;
+
+    // All settings that end up as literals in the generated kernels.
+    // Kernels generated ahead of time are only valid for the same fingerprint.
+    // maxiter and tol decide which kernels a run gets to, e.g. how far the Anderson history fills up.
+    // gridSequencing moves the finest level, which decides where the Galerkin operators start.
+    std::string kernelFingerprint() const
+    {
+        std::ostringstream out;
+        out << std::setprecision(17) << gridDim[0] << ' ' << gridDim[1] << ' ' << gridDim[2] << ' ' << mode
+            << ' ' << omega << ' ' << gamma << ' ' << maxiter << ' ' << tol;
+        for (std::size_t i = 0; i < stencil.values.size(); i++) {
+            out << ' ' << stencil.values[i] << ' ' << stencil.getXOffset(i) << ' ' << stencil.getYOffset(i) << ' ' << stencil.getZOffset(i);
+        }
+        out << ' ' << smoother << ' ' << galerkin << ' ' << tauExtrapolation << ' ' << andersonDepth << ' ' << batchSize << ' ' << layout << ' ' << imageReads
+            << ' ' << gridSequencing;
+        return out.str();
+    }
+
+    // Axes the line smoother runs along, empty if point or block Jacobi is used.
+    // An axis is strong if it couples at least twice as strong as the weakest one. With two strong axes
+    // both are relaxed in turn, which approximates plane relaxation.
+    std::vector<std::size_t> lineAxes() const
+    {
+        std::vector<std::size_t> axes;
+        if (smoother == JACOBI || smoother == BLOCK) {
+            return axes;
+        }
+
+        const std::array<double, 3> coupling{ stencil.axisCoupling(0), stencil.axisCoupling(1), stencil.axisCoupling(2) };
+        const double weakest = std::min(std::min(coupling[0], coupling[1]), coupling[2]);
+        for (std::size_t axis = 0; axis < 3; axis++) {
+            if (coupling[axis] >= 2.0 * weakest && coupling[axis] > weakest) {
+                axes.push_back(axis);
+            }
+        }
+
+        if (axes.empty() && smoother == LINE) {
+            // isotropic stencil, relax along the strongest axis
+            std::size_t strongest = 2;
+            for (std::size_t axis = 0; axis < 2; axis++) {
+                if (coupling[axis] > coupling[strongest]) {
+                    strongest = axis;
+                }
+            }
+            axes.push_back(strongest);
+        }
+        return axes;
+    }
 };
@@ -1,15 +1,97 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <string>
 #include "gridParams.h"
+#include "Compressor.h"
 #ifndef GPUSOLVE_CPU
     #include "sycl/ContextHandles.h"
     #include "sycl/SyclSolver.h"
     #include "sycl/NewtonSolver.h"
+    #include "sycl/ContinuationSolver.h"
+    #include "sycl/BatchSolver.h"
+    #include "sycl/AdditiveSolver.h"
 #else
     #include "cpu/CpuGridData.h"
     #include "cpu/CpuSolver.h"
     #include "cpu/NewtonSolver.h"
+    #include "cpu/ContinuationSolver.h"
+    #include "cpu/Affinity.h"
+    #include "cpu/TaskSolver.h"
+    #include "cpu/LocalSolver.h"
+    #include "cpu/AdditiveSolver.h"
+#endif
+
+// Writes the field compressed to <output>_<name>.gsz
+static bool writeOutput(const GridParams& gridParams, const Vector3& field, const std::string& name)
+{
+    Compressor::Bound bound;
+    bound.mode = gridParams.outputRelative ? Compressor::Bound::RELATIVE : Compressor::Bound::ABSOLUTE;
+    bound.value = gridParams.outputBound;
+
+    const std::string file = gridParams.output + '_' + name + ".gsz";
+    Compressor::Stats stats;
+    if (!Compressor::write(field, bound, file, stats)) {
+        std::cerr << "Could not write " << file << '\n';
+        return false;
+    }
+    std::cout << "Wrote " << file << ": " << stats.rawBytes << " -> " << stats.compressedBytes << " bytes, ratio " << stats.ratio()
+        << ", error bound " << stats.errorBound << ", max error " << stats.maxError << '\n';
+
+    if (gridParams.verifyOutput) {
+        Vector3 decoded;
+        if (!Compressor::read(file, decoded) || decoded.getLayout().dims != field.getLayout().dims) {
+            std::cerr << "Could not read back " << file << '\n';
+            return false;
+        }
+        double maxError = 0.0;
+        for (std::size_t x = 0; x < field.getXdim(); x++) {
+            for (std::size_t y = 0; y < field.getYdim(); y++) {
+                for (std::size_t z = 0; z < field.getZdim(); z++) {
+                    maxError = std::max(maxError, std::abs(decoded.get(x, y, z) - field.get(x, y, z)));
+                }
+            }
+        }
+        std::cout << "Read back " << file << ": max error " << maxError << '\n';
+        if (!(maxError <= stats.errorBound)) {
+            std::cerr << "The error of " << file << " exceeds the error bound\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifndef GPUSOLVE_CPU
+// Reads a field back from the device. The host field gets the same layout and a buffer that uses its memory,
+// the device copies into that buffer, which hands the values to the field when it goes away.
+static Vector3 readBack(cl::sycl::queue& queue, SyclBuffer& buffer)
+{
+    Vector3 host(buffer.getLayout());
+    {
+        SyclBuffer hostView(host);
+        SyclSolver::copyBuffer(queue, buffer, hostView);
+    }
+    return host;
+}
+#endif
+
+#ifdef SYCL_GTX
+// Loads the kernels generated for this config from the directory or one of its subdirectories
+static bool loadKernelArchive(const std::filesystem::path& directory, const std::string& fingerprint)
+{
+    if (cl::sycl::kernel_archive::load(directory.string(), fingerprint)) {
+        return true;
+    }
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        if (entry.is_directory() && cl::sycl::kernel_archive::load(entry.path().string(), fingerprint)) {
+            return true;
+        }
+    }
+    return false;
+}
 #endif
 
 int main(int argc, char* argv[]) {
@@ -81,28 +163,433 @@ int main(int argc, char* argv[]) {
             std::get<2>(gridParams.stencil.offsets[i]) = val;
         }
 
+        // optional settings, one "key value" pair per line
+        std::string key;
+        while (configFile >> key) {
+            if (key == "continuation") {
+                gridParams.continuation = true;
+                configFile >> gridParams.continuationStart;
+            }
+            else if (key == "continuationSteps") {
+                configFile >> gridParams.continuationSteps;
+            }
+            else if (key == "anderson") {
+                configFile >> gridParams.andersonDepth;
+            }
+            else if (key == "tauExtrapolation") {
+                configFile >> gridParams.tauExtrapolation;
+            }
+            else if (key == "galerkin") {
+                configFile >> gridParams.galerkin;
+            }
+            else if (key == "batch") {
+                configFile >> gridParams.batchSize;
+            }
+            else if (key == "threads") {
+                configFile >> gridParams.threads;
+            }
+            else if (key == "taskGraph") {
+                configFile >> gridParams.taskGraph;
+            }
+            else if (key == "activeSet") {
+                configFile >> gridParams.activeSet;
+            }
+            else if (key == "activeSetPeriod") {
+                configFile >> gridParams.activeSetPeriod;
+            }
+            else if (key == "additive") {
+                configFile >> gridParams.additive;
+            }
+            else if (key == "localUpdate") {
+                configFile >> gridParams.updateOrigin[0] >> gridParams.updateOrigin[1] >> gridParams.updateOrigin[2];
+                configFile >> gridParams.updateSize >> gridParams.updateValue;
+            }
+            else if (key == "watchdog") {
+                configFile >> gridParams.watchdog;
+            }
+            else if (key == "watchdogGrowth") {
+                configFile >> gridParams.watchdogGrowth;
+            }
+            else if (key == "gridSequencing") {
+                configFile >> gridParams.gridSequencing;
+            }
+            else if (key == "affinity") {
+                std::string value;
+                configFile >> value;
+                if (value == "none") {
+                    gridParams.placement = GridParams::OS;
+                }
+                else if (value == "compact") {
+                    gridParams.placement = GridParams::COMPACT;
+                }
+                else if (value == "scatter") {
+                    gridParams.placement = GridParams::SCATTER;
+                }
+                else if (value == "core") {
+                    gridParams.placement = GridParams::CORE;
+                }
+                else if (value == "numa") {
+                    gridParams.placement = GridParams::NUMA;
+                }
+                else {
+                    std::cerr << "Invalid affinity " << value << '\n';
+                    return 1;
+                }
+            }
+            else if (key == "layout") {
+                std::string value;
+                configFile >> value;
+                if (value == "x") {
+                    gridParams.layout = Layout::X_FASTEST;
+                }
+                else if (value == "z") {
+                    gridParams.layout = Layout::Z_FASTEST;
+                }
+                else {
+                    std::cerr << "Invalid layout " << value << '\n';
+                    return 1;
+                }
+            }
+            else if (key == "imageReads") {
+                std::string value;
+                configFile >> value;
+                if (value == "residual") {
+                    gridParams.imageReads |= GridParams::IMAGE_RESIDUAL;
+                }
+                else if (value == "restrict") {
+                    gridParams.imageReads |= GridParams::IMAGE_RESTRICT;
+                }
+                else if (value == "interpolate") {
+                    gridParams.imageReads |= GridParams::IMAGE_INTERPOLATE;
+                }
+                else if (value == "all") {
+                    gridParams.imageReads |= GridParams::IMAGE_RESIDUAL | GridParams::IMAGE_RESTRICT | GridParams::IMAGE_INTERPOLATE;
+                }
+                else {
+                    std::cerr << "Invalid imageReads kernel " << value << '\n';
+                    return 1;
+                }
+            }
+            else if (key == "interleave") {
+                configFile >> gridParams.interleave;
+            }
+            else if (key == "output") {
+                configFile >> gridParams.output;
+            }
+            else if (key == "outputBound") {
+                std::string boundMode;
+                configFile >> boundMode >> gridParams.outputBound;
+                if (boundMode == "abs") {
+                    gridParams.outputRelative = false;
+                }
+                else if (boundMode == "rel") {
+                    gridParams.outputRelative = true;
+                }
+                else {
+                    std::cerr << "Invalid outputBound mode " << boundMode << '\n';
+                    return 1;
+                }
+                if (!(gridParams.outputBound > 0.0)) {
+                    std::cerr << "outputBound has to be positive\n";
+                    return 1;
+                }
+            }
+            else if (key == "verifyOutput") {
+                configFile >> gridParams.verifyOutput;
+            }
+            else if (key == "kernels") {
+                configFile >> gridParams.kernelArchive;
+            }
+            else if (key == "exportKernels") {
+                configFile >> gridParams.kernelExport;
+            }
+            else if (key == "smoother") {
+                std::string value;
+                configFile >> value;
+                if (value == "auto") {
+                    gridParams.smoother = GridParams::AUTO;
+                }
+                else if (value == "jacobi") {
+                    gridParams.smoother = GridParams::JACOBI;
+                }
+                else if (value == "line") {
+                    gridParams.smoother = GridParams::LINE;
+                }
+                else if (value == "block") {
+                    gridParams.smoother = GridParams::BLOCK;
+                }
+                else {
+                    std::cerr << "Invalid smoother " << value << '\n';
+                    return 1;
+                }
+            }
+            else {
+                std::cerr << "Unknown config option " << key << '\n';
+                return 1;
+            }
+        }
+
         gridParams.h = 1.0 / (gridParams.gridDim[1] + 1);
     }
 
+    const std::vector<std::size_t> lineAxes = gridParams.lineAxes();
+    if (!lineAxes.empty()) {
+        std::cout << "Using line smoother along axis";
+        for (std::size_t axis : lineAxes) {
+            std::cout << ' ' << "xyz"[axis];
+        }
+        std::cout << '\n';
+    }
+
+    const bool useContinuation = gridParams.continuation && gridParams.mode != GridParams::LINEAR;
 
+    const bool useBatch = gridParams.batchSize > 1;
+    if (useBatch) {
+        if (gridParams.mode == GridParams::NEWTON || useContinuation || !lineAxes.empty() || gridParams.galerkin
+            || gridParams.tauExtrapolation || gridParams.andersonDepth > 0) {
+            std::cerr << "batch only supports the linear and non-linear mode with the Jacobi smoother\n";
+            return 1;
+        }
+        if (!gridParams.output.empty()) {
+            std::cerr << "output is not supported with batch\n";
+            return 1;
+        }
+        if (gridParams.layout != Layout::X_FASTEST) {
+            // the problems are stacked along z and each one has to be contiguous
+            std::cerr << "batch only supports the x layout\n";
+            return 1;
+        }
 #ifdef GPUSOLVE_CPU
+        std::cerr << "batch is only supported by the SYCL solvers\n";
+        return 1;
+#endif
+        std::cout << "Solving a batch of " << gridParams.batchSize << " problems\n";
+    }
+
+    if (gridParams.taskGraph) {
+        if (gridParams.mode == GridParams::NEWTON || useContinuation || !lineAxes.empty()
+            || gridParams.tauExtrapolation || gridParams.andersonDepth > 0) {
+            std::cerr << "taskGraph only supports the linear and non-linear mode with the Jacobi smoother\n";
+            return 1;
+        }
+#ifndef GPUSOLVE_CPU
+        std::cerr << "taskGraph is only supported by the CPU solver\n";
+        return 1;
+#endif
+    }
+
+    if (gridParams.imageReads != 0) {
+#ifndef SYCL_GTX
+        std::cerr << "imageReads is only supported by the sycl-gtx solver\n";
+        return 1;
+#endif
+        if (useBatch) {
+            std::cerr << "imageReads is not supported with batch\n";
+            return 1;
+        }
+    }
+
+#ifndef GPUSOLVE_CPU
+    if (gridParams.interleave) {
+        // every kernel indexes its buffers on its own, the separate buffers are already coalesced
+        std::cerr << "interleave is only supported by the CPU solver\n";
+        return 1;
+    }
+#endif
+
+    if (gridParams.activeSet > 0.0) {
+#ifndef GPUSOLVE_CPU
+        std::cerr << "activeSet is only supported by the CPU solver\n";
+        return 1;
+#endif
+        if (!lineAxes.empty() || gridParams.taskGraph || gridParams.additive || gridParams.updateSize > 0) {
+            std::cerr << "activeSet only supports the V-cycles with the Jacobi smoother, not taskGraph, additive or localUpdate\n";
+            return 1;
+        }
+        if (gridParams.activeSetPeriod == 0) {
+            std::cerr << "activeSetPeriod has to be at least 1\n";
+            return 1;
+        }
+    }
+
+    if (gridParams.additive) {
+        if (gridParams.mode != GridParams::LINEAR || !lineAxes.empty() || useBatch || gridParams.taskGraph
+            || gridParams.andersonDepth > 0) {
+            std::cerr << "additive only supports the linear mode with the Jacobi smoother\n";
+            return 1;
+        }
+        // the nested team threads inherit the CPU mask of their master, so a team would share one CPU
+        if (gridParams.placement != GridParams::OS) {
+            std::cerr << "additive doesn't support affinity, the thread teams would share the CPU of their master\n";
+            return 1;
+        }
+        std::cout << "Using additive cycles\n";
+    }
+
+    if (gridParams.updateSize > 0) {
+        if (gridParams.mode != GridParams::LINEAR) {
+            std::cerr << "localUpdate only supports the linear mode\n";
+            return 1;
+        }
+#ifndef GPUSOLVE_CPU
+        std::cerr << "localUpdate is only supported by the CPU solver\n";
+        return 1;
+#endif
+        for (std::size_t axis = 0; axis < 3; axis++) {
+            if (gridParams.updateOrigin[axis] < 1 || gridParams.updateOrigin[axis] + gridParams.updateSize > gridParams.gridDim[axis] + 1) {
+                std::cerr << "localUpdate region is outside of the grid\n";
+                return 1;
+            }
+        }
+    }
+
+    if (gridParams.watchdog > 0) {
+        if (useBatch || gridParams.taskGraph || gridParams.additive) {
+            std::cerr << "watchdog is not supported with batch, taskGraph and additive\n";
+            return 1;
+        }
+        if (!(gridParams.watchdogGrowth > 1.0)) {
+            std::cerr << "watchdogGrowth has to be larger than 1\n";
+            return 1;
+        }
+    }
+
+    if (gridParams.smoother == GridParams::BLOCK) {
+        // the inverses are computed once, the diagonal of the non-linear modes changes with v
+        if (gridParams.mode != GridParams::LINEAR || useBatch || gridParams.taskGraph || gridParams.additive
+            || gridParams.updateSize > 0 || gridParams.activeSet > 0.0) {
+            std::cerr << "the block smoother only supports the linear mode without batch, taskGraph, additive, localUpdate and activeSet\n";
+            return 1;
+        }
+        std::cout << "Using block smoother\n";
+    }
+
+    if (gridParams.gridSequencing > 0 && (gridParams.mode != GridParams::NEWTON || useContinuation)) {
+        std::cerr << "gridSequencing is only supported in newton mode without continuation\n";
+        return 1;
+    }
+
+#ifdef GPUSOLVE_CPU
+    Affinity::apply(gridParams.placement, gridParams.threads);
+
     CpuGridData cpuGridData(gridParams);
-    if (gridParams.mode == GridParams::Mode::NEWTON) {
+    if (useContinuation) {
+        ContinuationSolver::solve(cpuGridData);
+    }else if (gridParams.mode == GridParams::Mode::NEWTON) {
         NewtonSolver::solve(cpuGridData);
     }else {
-        CpuSolver::solve(cpuGridData);
+        SolveResult solved;
+        if (gridParams.additive) {
+            solved = AdditiveSolver::solve(cpuGridData);
+        }else if (gridParams.taskGraph) {
+            solved = TaskSolver::solve(cpuGridData);
+        }else {
+            solved = CpuSolver::solve(cpuGridData);
+        }
+
+        if (gridParams.updateSize > 0) {
+            // change f in a small region and solve again, starting from the solution
+            LocalSolver::Box changed;
+            for (std::size_t axis = 0; axis < 3; axis++) {
+                changed.lo[axis] = gridParams.updateOrigin[axis];
+                changed.hi[axis] = gridParams.updateOrigin[axis] + gridParams.updateSize;
+            }
+            Vector3& f = cpuGridData.getLevel(cpuGridData.finestLevel).f;
+            for (std::size_t x = changed.lo[0]; x < changed.hi[0]; x++) {
+                for (std::size_t y = changed.lo[1]; y < changed.hi[1]; y++) {
+                    for (std::size_t z = changed.lo[2]; z < changed.hi[2]; z++) {
+                        f.set(x, y, z, f.get(x, y, z) + gridParams.updateValue);
+                    }
+                }
+            }
+
+            std::cout << "Re-solving after changing f on " << changed.points() << " points\n";
+            const SolveResult updated = LocalSolver::resolve(cpuGridData, changed, solved);
+            std::cout << "Re-solve " << (updated.converged ? "converged" : "did not converge") << " after " << updated.iterations
+                << " cycles, residual: " << updated.residual << '\n';
+        }
+    }
+
+    if (!gridParams.output.empty()) {
+        // Newton keeps the solution in newtonV and the original right hand side in newtonF
+        const bool newton = gridParams.mode == GridParams::NEWTON;
+        const CpuGridData::LevelData& fine = cpuGridData.getLevel(0);
+        if (!writeOutput(gridParams, newton ? fine.newtonV : fine.v, "solution")
+            || !writeOutput(gridParams, newton ? cpuGridData.newtonF : fine.f, "rhs")) {
+            return 1;
+        }
     }
 #else
     try {
+#ifdef SYCL_GTX
+        if (!gridParams.kernelExport.empty()) {
+            std::filesystem::create_directories(gridParams.kernelExport);
+            cl::sycl::kernel_archive::record(gridParams.kernelExport, gridParams.kernelFingerprint());
+        }
+        else if (!gridParams.kernelArchive.empty()) {
+            if (loadKernelArchive(gridParams.kernelArchive, gridParams.kernelFingerprint())) {
+                std::cout << "Using kernels from " << gridParams.kernelArchive << '\n';
+            }else {
+                std::cerr << "No kernels for this config in " << gridParams.kernelArchive << ", generating them\n";
+            }
+        }
+#endif
         ContextHandles contextHandles = ContextHandles::init();
-        SyclGridData syclGridData(gridParams);
-        syclGridData.initBuffers(contextHandles.queue);
 
-        if (gridParams.mode == GridParams::Mode::NEWTON) {
-            NewtonSolver::solve(contextHandles.queue, syclGridData);
+#ifdef SYCL_GTX
+        if (gridParams.imageReads != 0) {
+            // the image views span whole buffers, the finest level is the largest one
+            const std::size_t points = (gridParams.gridDim[0] + 2) * (gridParams.gridDim[1] + 2) * (gridParams.gridDim[2] + 2);
+            if (!contextHandles.device.get_info<cl::sycl::info::device::image_support>()
+                || contextHandles.device.get_info<cl::sycl::info::device::image_max_buffer_size>() < points) {
+                std::cerr << "imageReads needs image buffers of " << points << " pixels, which the device doesn't support\n";
+                return 1;
+            }
+        }
+#endif
+
+        if (useBatch) {
+            BatchGridData batchGridData(gridParams);
+            batchGridData.initBuffers(contextHandles.queue);
+
+            const std::vector<SolveResult> results = BatchSolver::solve(contextHandles.queue, batchGridData);
+            for (std::size_t p = 0; p < results.size(); p++) {
+                std::cout << "problem: " << p << " iterations: " << results[p].iterations << " residual: " << results[p].residual
+                    << (results[p].converged ? " converged" : " not converged") << '\n';
+            }
         }else {
-            SyclSolver::solve(contextHandles.queue, syclGridData);
+            SyclGridData syclGridData(gridParams);
+            syclGridData.initBuffers(contextHandles.queue);
+
+            if (useContinuation) {
+                ContinuationSolver::solve(contextHandles.queue, syclGridData);
+            }else if (gridParams.mode == GridParams::Mode::NEWTON) {
+                NewtonSolver::solve(contextHandles.queue, syclGridData);
+            }else if (gridParams.additive) {
+                AdditiveSolver::solve(contextHandles.queue, syclGridData);
+            }else {
+                SyclSolver::solve(contextHandles.queue, syclGridData);
+            }
+
+            if (!gridParams.output.empty()) {
+                const bool newton = gridParams.mode == GridParams::NEWTON;
+                SyclGridData::LevelData& fine = syclGridData.getLevel(0);
+                if (!writeOutput(gridParams, readBack(contextHandles.queue, newton ? fine.newtonV : fine.v), "solution")
+                    || !writeOutput(gridParams, readBack(contextHandles.queue, newton ? syclGridData.newtonF : fine.f), "rhs")) {
+                    return 1;
+                }
+            }
         }
+
+#ifdef SYCL_GTX
+        if (cl::sycl::kernel_archive::is_recording()) {
+            if (!cl::sycl::kernel_archive::save()) {
+                std::cerr << "Could not write kernels to " << gridParams.kernelExport << '\n';
+                return 1;
+            }
+            std::cout << "Wrote kernels to " << gridParams.kernelExport << '\n';
+        }
+#endif
     }
     catch (std::exception& e) {
         std::cerr << "Exception: " << e.what() << '\n';
@@ -0,0 +1,196 @@
+#include "AdditiveSolver.h"
+#include "SyclSolver.h"
+#include "../Timer.h"
+#include <iostream>
+#include <cmath>
+
+using namespace cl::sycl;
+
+SolveResult AdditiveSolver::solve(cl::sycl::queue& queue, SyclGridData& grid)
+{
+    assert(grid.mode == GridParams::LINEAR);
+
+    SolveResult result;
+
+    SyclGridData::LevelData& fine = grid.getLevel(0);
+    residual(queue, grid, 0, fine.v, fine.f, fine.r);
+    double initialResidual = SyclSolver::sumBuffer(queue, fine.r);
+    result.initialResidual = initialResidual;
+    result.residual = initialResidual;
+
+    if (grid.printProgress) {
+        std::cout << "Inital residual: " << initialResidual << '\n';
+    }
+
+    const double refResidual = grid.referenceResidual > 0.0 ? grid.referenceResidual : initialResidual;
+    const double stopResidual = refResidual / (1.0 / grid.tol);
+
+    for (std::size_t i = 0; i < grid.maxiter; i++) {
+        if (grid.printProgress) {
+            Timer::start();
+        }
+
+        double res = cycle(queue, grid);
+        result.iterations = i + 1;
+        result.residual = res;
+
+        if (grid.printProgress) {
+            std::cout << "iter: " << i << " residual: " << res << ' ';
+            Timer::stop();
+        }
+
+        if (res <= stopResidual) {
+            result.converged = true;
+            return result;
+        }
+        if (!std::isfinite(res)) {
+            // diverged, further cycles can't recover
+            return result;
+        }
+    }
+
+    return result;
+}
+
+double AdditiveSolver::cycle(queue& queue, SyclGridData& grid)
+{
+    const std::size_t coarsest = grid.numLevels() - 1;
+
+    // rhs, correction and scratch of a level, the finest level keeps its rhs in r
+    auto rhs = [&](std::size_t i) -> SyclBuffer& { return i == 0 ? grid.getLevel(i).r : grid.getLevel(i).f; };
+    auto x = [&](std::size_t i) -> SyclBuffer& { return i == 0 ? grid.getLevel(i).restV : grid.getLevel(i).v; };
+    auto res = [&](std::size_t i) -> SyclBuffer& { return i == 0 ? grid.getLevel(i).newtonV : grid.getLevel(i).r; };
+
+    for (std::size_t i = 0; i < coarsest; i++) {
+        SyclSolver::restrict(queue, rhs(i), grid.getLevel(i + 1).f);
+    }
+
+    // the guess y of level i is in restV of level i + 1
+    for (std::size_t i = 0; i < coarsest; i++) {
+        reset(queue, grid.getLevel(i + 1).restV);
+    }
+    reset(queue, x(coarsest));
+
+    // Sweeps of all levels interleaved, first the guesses, then the levels themselves starting from P(y).
+    // The coarsest level only smooths.
+    const std::size_t sweeps = grid.preSmoothing + grid.postSmoothing;
+    for (std::size_t s = 0; s < sweeps; s++) {
+        if (s == grid.preSmoothing) {
+            for (std::size_t i = 0; i < coarsest; i++) {
+                SyclSolver::interpolate(queue, x(i), grid.getLevel(i + 1).restV);
+            }
+        }
+
+        for (std::size_t i = 0; i < coarsest; i++) {
+            if (s < grid.preSmoothing) {
+                SyclGridData::LevelData& next = grid.getLevel(i + 1);
+                residual(queue, grid, i + 1, next.restV, next.f, next.newtonV);
+                update(queue, grid, i + 1, next.restV, next.newtonV);
+            }else {
+                residual(queue, grid, i, x(i), rhs(i), res(i));
+                update(queue, grid, i, x(i), res(i));
+            }
+        }
+        residual(queue, grid, coarsest, x(coarsest), rhs(coarsest), res(coarsest));
+        update(queue, grid, coarsest, x(coarsest), res(coarsest));
+    }
+    if (sweeps == grid.preSmoothing) {
+        for (std::size_t i = 0; i < coarsest; i++) {
+            SyclSolver::interpolate(queue, x(i), grid.getLevel(i + 1).restV);
+        }
+    }
+
+    // only keep what the coarser levels don't see
+    for (std::size_t i = 0; i < coarsest; i++) {
+        SyclSolver::interpolate(queue, res(i), grid.getLevel(i + 1).restV);
+        axpy(queue, x(i), res(i), -1.0);
+    }
+
+    // sum up the corrections from the coarsest level to the finest
+    for (std::size_t i = coarsest; i > 0; i--) {
+        SyclSolver::interpolate(queue, res(i - 1), x(i));
+        axpy(queue, x(i - 1), res(i - 1), 1.0);
+    }
+
+    SyclGridData::LevelData& fine = grid.getLevel(0);
+    axpy(queue, fine.v, x(0), 1.0);
+
+    residual(queue, grid, 0, fine.v, fine.f, fine.r);
+    return SyclSolver::sumBuffer(queue, fine.r);
+}
+
+void AdditiveSolver::residual(queue& queue, SyclGridData& grid, std::size_t levelNum, SyclBuffer& x, SyclBuffer& rhs, SyclBuffer& res)
+{
+    SyclGridData::LevelData& level = grid.getLevel(levelNum);
+    const bool useGalerkin = grid.galerkin && levelNum > 0;
+
+    range<3> range(level.levelDim[0], level.levelDim[1], level.levelDim[2]);
+
+    queue.submit([&](handler& cgh) {
+
+        auto fAcc = rhs.get_access<access::mode::read>(cgh);
+        auto vAcc = x.get_access<access::mode::read>(cgh);
+        auto rAcc = res.get_access<access::mode::write>(cgh);
+
+        cgh.parallel_for<class addResidual>(range, [=, h=level.h, layout=level.v.getLayout(), stencil=grid.stencil, op=level.op](id<3> index) {
+            double1 stencilsum = 0.0;
+            if (useGalerkin) {
+                for (std::size_t i = 0; i < op.values.size(); i++) {
+                    if (op.values[i] != 0.0) {
+                        const int1 flatIdx = Sycl3dAccesor::flatIndex(layout, index[0] + (Stencil27::getXOffset(i) + 1), index[1] + (Stencil27::getYOffset(i) + 1), index[2] + (Stencil27::getZOffset(i) + 1));
+                        auto vVal = vAcc[flatIdx];
+                        stencilsum += op.values[i] * vVal;
+                    }
+                }
+            }else {
+                for (std::size_t i = 0; i < stencil.values.size(); i++) {
+                    const int1 flatIdx = Sycl3dAccesor::flatIndex(layout, index[0] + (stencil.getXOffset(i) + 1), index[1] + (stencil.getYOffset(i) + 1), index[2] + (stencil.getZOffset(i) + 1));
+                    auto vVal = vAcc[flatIdx];
+                    stencilsum += stencil.values[i] * vVal;
+                }
+                stencilsum /= h * h;
+            }
+
+            int1 centerIdx = Sycl3dAccesor::shift1Index(layout, index);
+            rAcc[centerIdx] = fAcc[centerIdx] - stencilsum;
+        });
+    });
+}
+
+void AdditiveSolver::update(queue& queue, SyclGridData& grid, std::size_t levelNum, SyclBuffer& x, SyclBuffer& res)
+{
+    SyclGridData::LevelData& level = grid.getLevel(levelNum);
+    const bool useGalerkin = grid.galerkin && levelNum > 0;
+    const double preFac = useGalerkin ? level.op.center() : grid.stencil.values[0] / (level.h * level.h);
+    const double alpha = 1.0 / preFac; // stencil center
+
+    queue.submit([&](handler& cgh) {
+        auto vAcc = x.get_access<access::mode::read_write>(cgh);
+        auto rAcc = res.get_access<access::mode::read>(cgh);
+
+        cgh.parallel_for<class addUpdate>(range<1>(x.flatSize()), [=, omega=grid.omega](id<1> idx) {
+            vAcc[idx[0]] = vAcc[idx[0]] + omega * (alpha * rAcc[idx[0]]);
+        });
+    });
+}
+
+void AdditiveSolver::axpy(queue& queue, SyclBuffer& x, SyclBuffer& add, double sign)
+{
+    queue.submit([&](handler& cgh) {
+        auto xAcc = x.get_access<access::mode::read_write>(cgh);
+        auto addAcc = add.get_access<access::mode::read>(cgh);
+        cgh.parallel_for<class addAxpy>(range<1>(x.flatSize()), [=](id<1> index) {
+            xAcc[index] += sign * addAcc[index];
+        });
+    });
+}
+
+void AdditiveSolver::reset(queue& queue, SyclBuffer& x)
+{
+    queue.submit([&](handler& cgh) {
+        auto xAcc = x.get_access<access::mode::discard_write>(cgh);
+        cgh.parallel_for<class addReset>(range<1>(x.flatSize()), [=](id<1> index) {
+            xAcc[index] = 0.0;
+        });
+    });
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "SyclGridData.h"
+#include "../SolveResult.h"
+
+// Additive multigrid (AFACx), see the CPU version for the cycle and how the buffers are used.
+// The sweeps of all levels are submitted interleaved and don't depend on each other, so a queue that
+// runs independent kernels concurrently keeps the device busy on the small coarse levels.
+class AdditiveSolver {
+public:
+	static SolveResult solve(cl::sycl::queue& queue, SyclGridData& grid);
+
+private:
+	static double cycle(cl::sycl::queue& queue, SyclGridData& grid);
+	// res = rhs - A(x)
+	static void residual(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum, SyclBuffer& x, SyclBuffer& rhs, SyclBuffer& res);
+	// x += omega * res / diagonal
+	static void update(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum, SyclBuffer& x, SyclBuffer& res);
+	// x = x + sign * add
+	static void axpy(cl::sycl::queue& queue, SyclBuffer& x, SyclBuffer& add, double sign);
+	static void reset(cl::sycl::queue& queue, SyclBuffer& x);
+};
@@ -0,0 +1,107 @@
+#include "Anderson.h"
+#include "SyclSolver.h"
+#include <string>
+
+using namespace cl::sycl;
+
+Anderson::Anderson(std::size_t depth, const SyclBuffer& shape)
+	: history(depth),
+	f(shape.getLayout()),
+	fPrev(shape.getLayout()),
+	gPrev(shape.getLayout()),
+	coeffBuf(range<1>(depth))
+{
+	deltaF.reserve(depth);
+	deltaG.reserve(depth);
+	for (std::size_t i = 0; i < depth; i++) {
+		deltaF.emplace_back(shape.getLayout());
+		deltaG.emplace_back(shape.getLayout());
+	}
+}
+
+void Anderson::saveIterate(queue& queue, SyclBuffer& x)
+{
+	SyclSolver::copyBuffer(queue, x, f);
+}
+
+void Anderson::mix(queue& queue, SyclBuffer& g)
+{
+	// f = x - g
+	queue.submit([&](handler& cgh) {
+		auto fAcc = f.get_access<access::mode::read_write>(cgh);
+		auto gAcc = g.get_access<access::mode::read>(cgh);
+		cgh.parallel_for<class andersonF>(range<1>(f.flatSize()), [fAcc, gAcc](id<1> index) {
+			fAcc[index] -= gAcc[index];
+		});
+	});
+
+	if (havePrev) {
+		const std::size_t slot = history.nextSlot();
+		SyclBuffer& dF = deltaF[slot];
+		SyclBuffer& dG = deltaG[slot];
+
+		// store the differences to the previous iteration and move the current one into its place
+		queue.submit([&](handler& cgh) {
+			auto fAcc = f.get_access<access::mode::read>(cgh);
+			auto gAcc = g.get_access<access::mode::read>(cgh);
+			auto fPrevAcc = fPrev.get_access<access::mode::read_write>(cgh);
+			auto gPrevAcc = gPrev.get_access<access::mode::read_write>(cgh);
+			auto dFAcc = dF.get_access<access::mode::discard_write>(cgh);
+			auto dGAcc = dG.get_access<access::mode::discard_write>(cgh);
+			cgh.parallel_for<class andersonPush>(range<1>(f.flatSize()), [fAcc, gAcc, fPrevAcc, gPrevAcc, dFAcc, dGAcc](id<1> index) {
+				double1 fVal = fAcc[index];
+				double1 gVal = gAcc[index];
+				dFAcc[index] = fVal - fPrevAcc[index];
+				dGAcc[index] = gVal - gPrevAcc[index];
+				fPrevAcc[index] = fVal;
+				gPrevAcc[index] = gVal;
+			});
+		});
+
+		std::vector<double> gramRow(history.sizeAfterPush());
+		for (std::size_t j = 0; j < gramRow.size(); j++) {
+			gramRow[j] = SyclSolver::dotBuffer(queue, dF, deltaF[j]);
+		}
+		history.push(gramRow);
+	}else {
+		SyclSolver::copyBuffer(queue, f, fPrev);
+		SyclSolver::copyBuffer(queue, g, gPrev);
+		havePrev = true;
+	}
+
+	if (history.size() == 0) {
+		return;
+	}
+
+	std::vector<double> rhs(history.size());
+	for (std::size_t j = 0; j < rhs.size(); j++) {
+		rhs[j] = SyclSolver::dotBuffer(queue, deltaF[j], f);
+	}
+
+	const std::vector<double> coeff = history.coefficients(rhs);
+	{
+#ifdef SYCL_GTX
+		auto coeffAcc = coeffBuf.get_access<access::mode::discard_write, access::target::host_buffer>();
+#else
+		sycl::host_accessor coeffAcc{ coeffBuf, sycl::write_only, sycl::no_init };
+#endif
+		for (std::size_t j = 0; j < coeff.size(); j++) {
+			coeffAcc[static_cast<int>(j)] = coeff[j];
+		}
+	}
+
+	// x_{k+1} = G(x_k) - sum_j c_j dG_j
+	for (std::size_t j = 0; j < coeff.size(); j++) {
+		SyclBuffer& dG = deltaG[j];
+		// j is a literal in the kernel and its range is the same for all j
+		KernelVariant variant("mix" + std::to_string(j));
+		queue.submit([&](handler& cgh) {
+			auto gAcc = g.get_access<access::mode::read_write>(cgh);
+			auto dGAcc = dG.get_access<access::mode::read>(cgh);
+			auto coeffAcc = coeffBuf.get_access<access::mode::read>(cgh);
+			cgh.parallel_for<class andersonMix>(range<1>(g.flatSize()), [=](id<1> index) {
+				gAcc[index] -= coeffAcc[static_cast<int>(j)] * dGAcc[index];
+			});
+		});
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "SyclBuffer.h"
+#include "../AndersonHistory.h"
+#include <vector>
+
+// Anderson acceleration of a fixed point iteration x_{k+1} = G(x_k) on the finest level.
+// Usage per outer iteration: saveIterate(x_k), run the step, then mix(G(x_k)).
+class Anderson {
+public:
+	Anderson(std::size_t depth, const SyclBuffer& shape);
+
+	void saveIterate(cl::sycl::queue& queue, SyclBuffer& x);
+	// Replaces g = G(x_k) with the accelerated iterate x_{k+1}
+	void mix(cl::sycl::queue& queue, SyclBuffer& g);
+
+private:
+	AndersonHistory history;
+	std::vector<SyclBuffer> deltaF;
+	std::vector<SyclBuffer> deltaG;
+	// The fixed point residuals are stored negated, f = x - G(x), which doesn't change the mixing coefficients
+	SyclBuffer f;
+	SyclBuffer fPrev;
+	SyclBuffer gPrev;
+	// Mixing coefficients, passed in a buffer so the kernels don't get recompiled every iteration
+	cl::sycl::buffer<double, 1> coeffBuf;
+	bool havePrev = false;
+};
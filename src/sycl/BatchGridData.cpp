@@ -0,0 +1,144 @@
+#include "BatchGridData.h"
+#include "../Nonlinearity.h"
+
+namespace {
+	template<class Float>
+	Float f0(const Float& x) {
+		return (100 * x * (x - 1.0) * x * (x - 1.0) * x * (x - 1.0) * x * (x - 1.0));
+	}
+	template<class Float>
+	Float f2(const Float& x) {
+		return (100.0 * 4.0 * (x - 1.0) * (x - 1.0) * x * x * (14.0 * x * x - 14.0 * x + 3));
+	}
+}
+
+BatchGridData::BatchGridData(const GridParams& grid)
+	: GridParams(grid), active(cl::sycl::range<1>(grid.batchSize))
+{
+	// magic 2.0 at the end is the coarsening ratio
+	int maxlevel = (int)floor(log((double)std::min(std::min(gridDim[0], gridDim[1]), gridDim[2])) / log(2.0)) + 1;
+	levels.reserve(maxlevel);
+
+	for (std::size_t i = 0; i < maxlevel; i++) {
+		std::array<std::size_t, 3> levelDim;
+		if (i == 0) {
+			levelDim = gridDim;
+		}else {
+			levelDim[0] = levels[i - 1].levelDim[0] / 2;
+			levelDim[1] = levels[i - 1].levelDim[1] / 2;
+			levelDim[2] = levels[i - 1].levelDim[2] / 2;
+		}
+
+		double h = 1.0 / (levelDim[1] + 1);
+		const std::size_t zSize = (levelDim[2] + 2) * batchSize;
+
+		levels.push_back(LevelData{
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, zSize, Layout::X_FASTEST),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, zSize, Layout::X_FASTEST),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, zSize, Layout::X_FASTEST),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, zSize, Layout::X_FASTEST),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, zSize, Layout::X_FASTEST),
+			levelDim,
+			h
+		});
+	}
+}
+
+void BatchGridData::initBuffers(cl::sycl::queue& queue)
+{
+	queue.submit([&](cl::sycl::handler& cgh) {
+		auto wAccessor = levels[0].f.get_access<cl::sycl::access::mode::discard_write>(cgh);
+		cl::sycl::range<3> range(levels[0].f.getXdim(), levels[0].f.getYdim(), levels[0].f.getZdim());
+
+		const auto xRightSide = levels[0].levelDim[0] + 1;
+		const auto yRightSide = levels[0].levelDim[1] + 1;
+		const auto zRightSide = levels[0].levelDim[2] + 1;
+		const auto slab = levels[0].levelDim[2] + 2;
+		const double scale = 1.0 / batchSize;
+
+		if (this->mode == GridParams::LINEAR) {
+
+			cgh.parallel_for<class batch_init_f_lin>(range, [=, h = this->h, layout = levels[0].f.getLayout()](cl::sycl::id<3> index) {
+				int1 flatIndex = Sycl3dAccesor::flatIndex(layout, index);
+				int1 p = index[2] / slab;
+				int1 z = index[2] % slab;
+				SYCL_IF(index[0] == 0 || index[1] == 0 || z == 0) {
+					wAccessor[flatIndex] = 0.0;
+				}
+				SYCL_ELSE_IF(index[0] == xRightSide || index[1] == yRightSide || z == zRightSide) {
+					wAccessor[flatIndex] = 0.0;
+				}
+				SYCL_ELSE
+				{
+					double1 x = (index[0] - 1) * h;
+					double1 y = (index[1] - 1) * h;
+					double1 zz = (z - 1) * h;
+
+					double1 val = -1.0 * (f2(x) * f0(y) * f0(zz) + f0(x) * f2(y) * f0(zz) + f0(x) * f0(y) * f2(zz));
+
+					wAccessor[flatIndex] = (p + 1) * scale * val;
+				}
+				SYCL_END;
+			});
+		}else {
+			cgh.parallel_for<class batch_init_f>(range, [=, h=this->h, ga=gamma, layout=levels[0].f.getLayout()](cl::sycl::id<3> index) {
+				int1 flatIndex = Sycl3dAccesor::flatIndex(layout, index);
+				int1 p = index[2] / slab;
+				int1 z = index[2] % slab;
+
+				SYCL_IF(index[0] == 0 || index[1] == 0 || z == 0) {
+					wAccessor[flatIndex] = 0.0;
+				}
+				SYCL_ELSE_IF(index[0] == xRightSide || index[1] == yRightSide || z == zRightSide) {
+					wAccessor[flatIndex] = 0.0;
+				}
+				SYCL_ELSE
+				{
+					double1 x = index[0] * h;
+					double1 y = index[1] * h;
+					double1 zz = z * h;
+
+					double1 u = (x - x * x) * (y - y * y) * (zz - zz * zz);
+					double1 val = 2.0 * ((y - y * y) * (zz - zz * zz) + (x - x * x) * (zz - zz * zz) + (x - x * x) * (y - y * y))
+						+ Nonlinearity::value(ga, u);
+
+					wAccessor[flatIndex] = (p + 1) * scale * val;
+				}
+				SYCL_END;
+			});
+		}
+	});
+
+	queue.submit([&](cl::sycl::handler& cgh) {
+		auto activeAcc = active.get_access<cl::sycl::access::mode::discard_write>(cgh);
+		cgh.parallel_for<class batch_init_active>(cl::sycl::range<1>(batchSize), [activeAcc](cl::sycl::id<1> index) {
+			activeAcc[index] = 1.0;
+		});
+	});
+
+	for (std::size_t i = 0; i < levels.size(); i++) {
+		auto& level = levels[i];
+
+		if (i > 0) {
+			queue.submit([&](cl::sycl::handler& cgh) {
+				auto fAcc = level.f.get_access<cl::sycl::access::mode::discard_write>(cgh);
+				cgh.parallel_for<class batch_clear>(cl::sycl::range<1>(level.f.flatSize()), [=](cl::sycl::id<1> index) {
+					fAcc[index] = 0.0;
+				});
+			});
+		}
+
+		queue.submit([&](cl::sycl::handler& cgh) {
+			auto vAcc = level.v.get_access<cl::sycl::access::mode::discard_write>(cgh);
+			auto restvAcc = level.restV.get_access<cl::sycl::access::mode::discard_write>(cgh);
+			auto rAcc = level.r.get_access<cl::sycl::access::mode::discard_write>(cgh);
+			auto eAcc = level.e.get_access<cl::sycl::access::mode::discard_write>(cgh);
+			cgh.parallel_for<class batch_clearAll>(cl::sycl::range<1>(level.v.flatSize()), [vAcc, restvAcc, rAcc, eAcc](cl::sycl::id<1> index) {
+				vAcc[index] = 0.0;
+				restvAcc[index] = 0.0;
+				rAcc[index] = 0.0;
+				eAcc[index] = 0.0;
+			});
+		});
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "../gridParams.h"
+#include "SyclBuffer.h"
+#include <CL/sycl.hpp>
+#include <vector>
+#include "sycl_compat.h"
+
+// Independent problems of the same size, stacked along z into one set of buffers.
+// Problem p owns the z-slab [p * (z + 2), (p + 1) * (z + 2)) of every buffer, boundary planes included,
+// and is solved with the right hand side scaled by (p + 1) / batchSize.
+class BatchGridData final : public GridParams
+{
+public:
+
+	struct LevelData {
+		SyclBuffer v;
+		SyclBuffer restV;
+		SyclBuffer f;
+		SyclBuffer r;
+		SyclBuffer e;
+		std::array<std::size_t, 3> levelDim; // size of a single problem
+		double h;
+	};
+
+	BatchGridData(const GridParams& grid);
+
+	void initBuffers(cl::sycl::queue& queue);
+
+	const LevelData& getLevel(std::size_t level) const
+	{
+		return levels[level];
+	}
+	LevelData& getLevel(std::size_t level)
+	{
+		return levels[level];
+	}
+
+	std::size_t numLevels() const
+	{
+		return levels.size();
+	}
+
+	// 1.0 while a problem is iterated, 0.0 once it converged. Kept in a buffer, so masking
+	// problems doesn't recompile the kernels.
+	cl::sycl::buffer<double, 1> active;
+
+private:
+	std::vector<LevelData> levels; // levels[0] is the finest level and levels[-1] is the coarsed level
+};
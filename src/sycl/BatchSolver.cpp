@@ -0,0 +1,424 @@
+#include "BatchSolver.h"
+#include "../Nonlinearity.h"
+#include "../Timer.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+using namespace cl::sycl;
+
+#ifndef SYCL_GTX
+// Mark Stencil as device copyable
+template<>
+struct sycl::is_device_copyable<Stencil> : std::true_type {};
+#endif
+
+// The kernels fold the problem index into the z dimension of their range:
+// global z = problem * slab + local z, with a slab of z + 2 planes per problem.
+
+std::vector<SolveResult> BatchSolver::solve(queue& queue, BatchGridData& grid)
+{
+    const std::size_t numProblems = grid.batchSize;
+    std::vector<SolveResult> results(numProblems);
+    std::vector<double> stopResidual(numProblems);
+    std::vector<bool> active(numProblems, true);
+
+    compResidual(queue, grid, 0);
+    std::vector<double> norms = problemNorms(queue, grid.getLevel(0).r, numProblems);
+    for (std::size_t p = 0; p < numProblems; p++) {
+        results[p].initialResidual = norms[p];
+        results[p].residual = norms[p];
+        const double refResidual = grid.referenceResidual > 0.0 ? grid.referenceResidual : norms[p];
+        stopResidual[p] = refResidual / (1.0 / grid.tol);
+    }
+
+    if (grid.printProgress) {
+        std::cout << "Inital residual: " << *std::max_element(norms.begin(), norms.end()) << " (largest of " << numProblems << " problems)\n";
+    }
+
+    std::size_t numActive = numProblems;
+    for (std::size_t i = 0; i < grid.maxiter && numActive > 0; i++) {
+        if (grid.printProgress) {
+            Timer::start();
+        }
+
+        vcycle(queue, grid);
+
+        compResidual(queue, grid, 0);
+        norms = problemNorms(queue, grid.getLevel(0).r, numProblems);
+
+        double largest = 0.0;
+        for (std::size_t p = 0; p < numProblems; p++) {
+            if (!active[p]) {
+                continue;
+            }
+            results[p].iterations = i + 1;
+            results[p].residual = norms[p];
+            largest = std::max(largest, norms[p]);
+
+            if (norms[p] <= stopResidual[p]) {
+                results[p].converged = true;
+                active[p] = false;
+            }else if (!std::isfinite(norms[p])) {
+                // diverged, further cycles can't recover
+                active[p] = false;
+            }
+        }
+
+        const std::size_t stillActive = static_cast<std::size_t>(std::count(active.begin(), active.end(), true));
+        if (stillActive != numActive) {
+#ifdef SYCL_GTX
+            auto activeAcc = grid.active.get_access<access::mode::discard_write, access::target::host_buffer>();
+#else
+            sycl::host_accessor activeAcc{ grid.active, sycl::write_only, sycl::no_init };
+#endif
+            for (std::size_t p = 0; p < numProblems; p++) {
+                activeAcc[static_cast<int>(p)] = active[p] ? 1.0 : 0.0;
+            }
+            numActive = stillActive;
+        }
+
+        if (grid.printProgress) {
+            std::cout << "iter: " << i << " residual: " << largest << " active: " << numActive << ' ';
+            Timer::stop();
+        }
+    }
+
+    return results;
+}
+
+void BatchSolver::vcycle(queue& queue, BatchGridData& grid)
+{
+    const std::size_t numProblems = grid.batchSize;
+
+    for (std::size_t i = 0; i < grid.numLevels() - 1; i++) {
+
+        BatchGridData::LevelData& nextLevel = grid.getLevel(i + 1);
+
+        jacobi(queue, grid, i, grid.preSmoothing);
+
+        compResidual(queue, grid, i);
+
+        // restrict residual to next level f
+        restrict(queue, grid.getLevel(i).r, nextLevel.f, numProblems);
+
+        if (grid.mode == GridParams::LINEAR) {
+
+            // clear v for next level
+            queue.submit([&](handler& cgh) {
+                auto vAcc = nextLevel.v.get_access<access::mode::discard_write>(cgh);
+                cgh.parallel_for<class batchReset>(range<1>(nextLevel.v.flatSize()), [=](id<1> index) {
+                    vAcc[index] = 0.0;
+                });
+            });
+
+        }else {
+            restrict(queue, grid.getLevel(i).v, nextLevel.restV, numProblems);
+            restrict(queue, grid.getLevel(i).v, nextLevel.v, numProblems);
+
+            // Compute A^2h (v^2h), and save it in r, so we don't need a new buffer for it
+            applyStencil(queue, grid, i + 1, nextLevel.restV);
+
+            // Add A^2h (v^2h) to r^2h
+            queue.submit([&](handler& cgh) {
+                auto fAcc = nextLevel.f.get_access<access::mode::read_write>(cgh);
+                auto rAcc = nextLevel.r.get_access<access::mode::read>(cgh);
+                cgh.parallel_for<class batchSum>(range<1>(nextLevel.f.flatSize()), [=](id<1> index) {
+                    fAcc[index] += rAcc[index];
+                });
+            });
+        }
+    }
+
+    jacobi(queue, grid, grid.numLevels() - 1, grid.preSmoothing + grid.postSmoothing);
+
+    for (std::size_t i = grid.numLevels() - 1; i > 0; i--) {
+        BatchGridData::LevelData& thisLevel = grid.getLevel(i);
+        BatchGridData::LevelData& prevLevel = grid.getLevel(i - 1);
+
+        if (grid.mode == GridParams::NONLINEAR) {
+            // compute u^2h = u^2h - v^2h
+            queue.submit([&](handler& cgh) {
+                auto vAcc = thisLevel.v.get_access<access::mode::read_write>(cgh);
+                auto restvAcc = thisLevel.restV.get_access<access::mode::read>(cgh);
+                cgh.parallel_for<class batchSum1>(range<1>(thisLevel.v.flatSize()), [=](id<1> index) {
+                    vAcc[index] -= restvAcc[index];
+                });
+            });
+        }
+
+        // interpolate v to previous level e
+        interpolate(queue, prevLevel.e, thisLevel.v, numProblems);
+
+        // v = v + e, converged problems keep their solution
+        queue.submit([&](handler& cgh) {
+            auto vAcc = prevLevel.v.get_access<access::mode::read_write>(cgh);
+            auto eAcc = prevLevel.e.get_access<access::mode::read>(cgh);
+            auto activeAcc = grid.active.get_access<access::mode::read>(cgh);
+            cgh.parallel_for<class batchSum2>(range<1>(prevLevel.v.flatSize()), [=, slab = prevLevel.v.flatSize() / numProblems](id<1> index) {
+                int1 p = index[0] / slab;
+                vAcc[index] += activeAcc[p] * eAcc[index];
+            });
+        });
+
+        jacobi(queue, grid, i - 1, grid.postSmoothing);
+    }
+}
+
+void BatchSolver::jacobi(queue& queue, BatchGridData& grid, std::size_t levelNum, std::size_t maxiter)
+{
+    BatchGridData::LevelData& level = grid.getLevel(levelNum);
+    const double preFac = grid.stencil.values[0] / (level.h * level.h);
+    const double alpha = 1.0 / preFac; // stencil center
+
+    for (std::size_t i = 0; i < maxiter; i++) {
+        compResidual(queue, grid, levelNum);
+
+        queue.submit([&](handler& cgh) {
+            auto vAcc = level.v.get_access<access::mode::read_write>(cgh);
+            auto rAcc = level.r.get_access<access::mode::read>(cgh);
+            auto activeAcc = grid.active.get_access<access::mode::read>(cgh);
+
+            cgh.parallel_for<class batchJacobiK>(range<1>(level.v.flatSize()), [=, omega=grid.omega, gamma=grid.gamma, mode=grid.mode, slab=level.v.flatSize() / grid.batchSize](id<1> idx) {
+                double1 vVal = vAcc[idx[0]];
+                int1 p = idx[0] / slab;
+                double1 step = omega * activeAcc[p];
+
+                double1 newV;
+                if (mode == GridParams::LINEAR) {
+                    newV = vVal + step * (alpha * rAcc[idx[0]]);
+                }else {
+                    double1 denuminator = preFac + Nonlinearity::derivative(gamma, vVal);
+
+                    newV = vVal + step * (rAcc[idx[0]] / denuminator);
+                }
+
+                vAcc[idx[0]] = newV;
+            });
+        });
+    }
+}
+
+void BatchSolver::compResidual(queue& queue, BatchGridData& grid, std::size_t levelNum)
+{
+    BatchGridData::LevelData& level = grid.getLevel(levelNum);
+
+    range<3> range(level.levelDim[0], level.levelDim[1], level.levelDim[2] * grid.batchSize);
+
+    queue.submit([&](handler& cgh) {
+
+        auto fAcc = level.f.get_access<access::mode::read>(cgh);
+        auto vAcc = level.v.get_access<access::mode::read>(cgh);
+        auto rAcc = level.r.get_access<access::mode::write>(cgh);
+
+        cgh.parallel_for<class batchResidual>(range, [=, h=level.h, gamma=grid.gamma, mode=grid.mode, layout=level.v.getLayout(), stencil=grid.stencil, nz=level.levelDim[2], slab=level.levelDim[2] + 2](id<3> index) {
+            int1 p = index[2] / nz;
+            int1 z = p * slab + index[2] % nz;
+
+            double1 stencilsum = 0.0;
+            for (std::size_t i = 0; i < stencil.values.size(); i++) {
+                const int1 flatIdx = Sycl3dAccesor::flatIndex(layout, index[0] + (stencil.getXOffset(i) + 1), index[1] + (stencil.getYOffset(i) + 1), z + (stencil.getZOffset(i) + 1));
+                auto vVal = vAcc[flatIdx];
+                stencilsum += stencil.values[i] * vVal;
+            }
+            stencilsum /= h * h;
+
+            int1 centerIdx = Sycl3dAccesor::shift1Index(layout, index[0], index[1], z);
+
+            if (mode == GridParams::NONLINEAR) {
+                double1 vVal = vAcc[centerIdx];
+                double1 nonLinear = Nonlinearity::value(gamma, vVal);
+                stencilsum += nonLinear;
+            }
+
+            rAcc[centerIdx] = fAcc[centerIdx] - stencilsum;
+        });
+    });
+}
+
+// save result in 'r'. Only needed for non-linear
+void BatchSolver::applyStencil(queue& queue, BatchGridData& grid, std::size_t levelNum, SyclBuffer& v)
+{
+    assert(grid.mode == GridParams::NONLINEAR);
+    BatchGridData::LevelData& level = grid.getLevel(levelNum);
+    assert(level.v.flatSize() == v.flatSize());
+    SyclBuffer& result = level.r;
+
+    range<3> range(level.levelDim[0], level.levelDim[1], level.levelDim[2] * grid.batchSize);
+
+    queue.submit([&](handler& cgh) {
+
+        auto vAcc = v.get_access<access::mode::read>(cgh);
+        auto resultAcc = result.get_access<access::mode::write>(cgh);
+
+        cgh.parallel_for<class batchApply>(range, [=, h=level.h, layout=v.getLayout(), stencil=grid.stencil, gamma=grid.gamma, nz=level.levelDim[2], slab=level.levelDim[2] + 2](id<3> index) {
+            int1 p = index[2] / nz;
+            int1 z = p * slab + index[2] % nz;
+
+            double1 stencilsum = 0.0;
+            for (std::size_t i = 0; i < stencil.values.size(); i++) {
+                const int1 flatIdx = Sycl3dAccesor::flatIndex(layout, index[0] + (stencil.getXOffset(i) + 1), index[1] + (stencil.getYOffset(i) + 1), z + (stencil.getZOffset(i) + 1));
+                auto vVal = vAcc[flatIdx];
+                stencilsum += stencil.values[i] * vVal;
+            }
+            stencilsum /= h * h;
+
+            int1 centerIdx = Sycl3dAccesor::shift1Index(layout, index[0], index[1], z);
+
+            double1 vVal = vAcc[centerIdx];
+            double1 nonLinear = Nonlinearity::value(gamma, vVal);
+            stencilsum += nonLinear;
+
+            resultAcc[centerIdx] = stencilsum;
+        });
+    });
+}
+
+std::vector<double> BatchSolver::problemNorms(queue& queue, SyclBuffer& buffer, std::size_t numProblems)
+{
+    Timer::push("problemNorms");
+
+    // A few work items per problem, each sums up a strided part of its problem's slab
+    const std::size_t slab = buffer.flatSize() / numProblems;
+    const std::size_t itemsPerProblem = std::min<std::size_t>(64, slab);
+
+    cl::sycl::buffer<double> accumBuf(numProblems * itemsPerProblem);
+
+    queue.submit([&](handler& cgh) {
+        auto accumAcc = accumBuf.get_access<access::mode::discard_write>(cgh);
+        auto accR = buffer.get_access<access::mode::read>(cgh);
+
+        cgh.parallel_for<class batchNormK>(range<1>(numProblems * itemsPerProblem), [=](id<1> index) {
+            int1 p = index[0] / itemsPerProblem;
+            int1 end = (p + 1) * slab;
+            double1 sum = 0;
+            SYCL_FOR(int1 i = p * slab + index[0] % itemsPerProblem, i < end, i) { // can't used i += itemsPerProblem here, breaks kernel generation
+                double1 val = accR[i];
+                sum += val * val;
+
+                i += itemsPerProblem;
+            }
+            SYCL_END;
+
+            accumAcc[index[0]] = sum;
+        });
+    });
+
+#ifdef SYCL_GTX
+    auto accumAcc = accumBuf.get_access<access::mode::read, access::target::host_buffer>();
+#else
+    sycl::host_accessor accumAcc{ accumBuf, sycl::read_only };
+#endif
+
+    std::vector<double> norms(numProblems);
+    for (std::size_t p = 0; p < numProblems; p++) {
+        double sum = 0;
+        for (std::size_t i = 0; i < itemsPerProblem; i++) {
+            sum += accumAcc[static_cast<int>(p * itemsPerProblem + i)];
+        }
+        norms[p] = ::sqrt(sum);
+    }
+
+    Timer::pop("problemNorms");
+    return norms;
+}
+
+void BatchSolver::restrict(queue& queue, SyclBuffer& fine, SyclBuffer& coarse, std::size_t numProblems)
+{
+    const std::size_t fineSlab = fine.getZdim() / numProblems;
+    const std::size_t coarseSlab = coarse.getZdim() / numProblems;
+
+    queue.submit([&](handler& cgh) {
+        auto fineAcc = fine.get_access<access::mode::read>(cgh);
+        auto coraseAcc = coarse.get_access<access::mode::write>(cgh);
+
+        range<3> range(coarse.getXdim() - 2, coarse.getYdim() - 2, (coarseSlab - 2) * numProblems);
+
+        cgh.parallel_for<class batchRest>(range, [=, fineLayout = fine.getLayout(), coarseLayout = coarse.getLayout(), nz = coarseSlab - 2](id<3> index) {
+            int1 p = index[2] / nz;
+            int1 z = index[2] % nz;
+            int1 xCenter = 2 * (index[0] + 1);
+            int1 yCenter = 2 * (index[1] + 1);
+            int1 zCenter = p * fineSlab + 2 * (z + 1);
+
+            double1 coarseValue = 0.0;
+
+            for (int ii = -2 + 1; ii < 2; ii++) {
+                for (int jj = -2 + 1; jj < 2; jj++) {
+                    for (int kk = -2 + 1; kk < 2; kk++) {
+                        double fac = 0.125 * ((2.0 - abs(ii)) / 2.0) * ((2.0 - abs(jj)) / 2.0) * ((2.0 - abs(kk)) / 2.0);
+                        double1 fineVal = fineAcc[Sycl3dAccesor::flatIndex(fineLayout, xCenter + ii, yCenter + jj, zCenter + kk)];
+                        coarseValue += fac * fineVal;
+                    }
+                }
+            }
+
+            int1 centerIdxCoarse = Sycl3dAccesor::shift1Index(coarseLayout, index[0], index[1], p * coarseSlab + z);
+            coraseAcc[centerIdxCoarse] = coarseValue;
+        });
+    });
+}
+
+void BatchSolver::interpolate(queue& queue, SyclBuffer& fine, SyclBuffer& coarse, std::size_t numProblems)
+{
+    const std::size_t fineSlab = fine.getZdim() / numProblems;
+    const std::size_t coarseSlab = coarse.getZdim() / numProblems;
+
+    // prepare
+    queue.submit([&](handler& cgh) {
+        auto coarseAcc = coarse.get_access<access::mode::read>(cgh);
+        auto fineAcc = fine.get_access<access::mode::write>(cgh);
+
+        range<3> rangePrep(fine.getXdim() / 2, fine.getYdim() / 2, fineSlab / 2 * numProblems);
+        cgh.parallel_for<class batchPrep>(rangePrep, [=, fineLayout=fine.getLayout(), coarseLayout=coarse.getLayout(), nz=fineSlab / 2](id<3> index) {
+            int1 p = index[2] / nz;
+            int1 zc = index[2] % nz;
+            int1 x = index[0] * 2;
+            int1 y = index[1] * 2;
+            int1 z = p * fineSlab + zc * 2;
+            fineAcc[Sycl3dAccesor::flatIndex(fineLayout, x, y, z)] = coarseAcc[Sycl3dAccesor::flatIndex(coarseLayout, index[0], index[1], p * coarseSlab + zc)];
+        });
+    });
+
+    // Interpolate in x-direction
+    queue.submit([&](handler& cgh) {
+        auto fineAcc = fine.get_access<access::mode::read_write>(cgh);
+
+        range<3> rangeX(fine.getXdim() / 2, fine.getYdim() / 2 + 1, (fineSlab / 2 + 1) * numProblems);
+        cgh.parallel_for<class batchInteX>(rangeX, [=, layout=fine.getLayout(), nz=fineSlab / 2 + 1](id<3> index) {
+            int1 x = index[0] * 2;
+            int1 y = index[1] * 2;
+            int1 z = (index[2] / nz) * fineSlab + (index[2] % nz) * 2;
+            double1 val = 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z)] + 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x + 2, y, z)];
+            fineAcc[Sycl3dAccesor::flatIndex(layout, x + 1, y, z)] = val;
+        });
+    });
+
+    // Interpolate in y-direction
+    queue.submit([&](handler& cgh) {
+        auto fineAcc = fine.get_access<access::mode::read_write>(cgh);
+
+        range<3> rangeY(fine.getXdim(), fine.getYdim() / 2, (fineSlab / 2 + 1) * numProblems);
+        cgh.parallel_for<class batchInteY>(rangeY, [=, layout = fine.getLayout(), nz=fineSlab / 2 + 1](id<3> index) {
+            int1 x = index[0];
+            int1 y = index[1] * 2;
+            int1 z = (index[2] / nz) * fineSlab + (index[2] % nz) * 2;
+            double1 val = 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z)] + 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y + 2, z)];
+            fineAcc[Sycl3dAccesor::flatIndex(layout, x, y + 1, z)] = val;
+        });
+    });
+
+    // Interpolate in z-direction, stays inside the slab of each problem
+    queue.submit([&](handler& cgh) {
+        auto fineAcc = fine.get_access<access::mode::read_write>(cgh);
+
+        range<3> rangeZ(fine.getXdim(), fine.getYdim(), fineSlab / 2 * numProblems);
+        cgh.parallel_for<class batchInteZ>(rangeZ, [=, layout = fine.getLayout(), nz=fineSlab / 2](id<3> index) {
+            int1 x = index[0];
+            int1 y = index[1];
+            int1 z = (index[2] / nz) * fineSlab + (index[2] % nz) * 2;
+            double1 val = 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z)] + 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z + 2)];
+            fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z + 1)] = val;
+        });
+    });
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "BatchGridData.h"
+#include "../SolveResult.h"
+#include <vector>
+
+// Multigrid for a batch of small problems. Every kernel covers the whole batch, converged
+// problems are masked out of the updates while the others keep iterating.
+// Linear and non-linear (FAS) mode with the Jacobi smoother.
+class BatchSolver {
+public:
+	// One result per problem
+	static std::vector<SolveResult> solve(cl::sycl::queue& queue, BatchGridData& grid);
+
+private:
+	static void vcycle(cl::sycl::queue& queue, BatchGridData& grid);
+	static void jacobi(cl::sycl::queue& queue, BatchGridData& grid, std::size_t levelNum, std::size_t maxiter);
+	static void compResidual(cl::sycl::queue& queue, BatchGridData& grid, std::size_t levelNum);
+	static void applyStencil(cl::sycl::queue& queue, BatchGridData& grid, std::size_t levelNum, SyclBuffer& v);
+	static void restrict(cl::sycl::queue& queue, SyclBuffer& fine, SyclBuffer& coarse, std::size_t numProblems);
+	static void interpolate(cl::sycl::queue& queue, SyclBuffer& fine, SyclBuffer& coarse, std::size_t numProblems);
+	// Euclidean norm of every problem's slab
+	static std::vector<double> problemNorms(cl::sycl::queue& queue, SyclBuffer& buffer, std::size_t numProblems);
+};
@@ -0,0 +1,123 @@
+#include "ContinuationSolver.h"
+#include "SyclSolver.h"
+#include "NewtonSolver.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+
+SolveResult ContinuationSolver::solve(cl::sycl::queue& queue, SyclGridData& grid)
+{
+    const double targetGamma = grid.gamma;
+    const double targetTol = grid.tol;
+    const bool printProgress = grid.printProgress;
+
+    // Intermediate stages only need to provide a good starting point for the next one
+    const double stageTol = std::max(std::sqrt(targetTol), targetTol);
+    double distance = targetGamma - grid.continuationStart;
+    const double minStep = std::fabs(distance) * 1e-3;
+    double step = distance / std::max<std::size_t>(grid.continuationSteps, 1);
+
+    // Last accepted solution, used to roll back a failed stage, the initial guess until the first stage converged.
+    // Gamma is a literal in the generated kernels, so every stage compiles its own set of kernels
+    SyclBuffer& sol = solution(grid);
+    SyclBuffer snapshot(sol.getLayout());
+    SyclSolver::copyBuffer(queue, sol, snapshot);
+    bool haveSnapshot = false;
+    double acceptedGamma = grid.continuationStart;
+    double gamma = grid.continuationStart;
+
+    SolveResult total;
+
+    while (true) {
+        const bool lastStage = gamma == targetGamma;
+        grid.gamma = gamma;
+        grid.tol = lastStage ? targetTol : stageTol;
+        grid.printProgress = lastStage && printProgress;
+        // The final stage has to reach the same residual as a solve from zero would,
+        // and starting from zero the residual is f, independent of gamma
+        grid.referenceResidual = lastStage ? total.initialResidual : 0.0;
+
+        std::ostringstream gammaTag;
+        gammaTag << "gamma" << std::setprecision(17) << gamma;
+        KernelVariant variant(gammaTag.str());
+        SolveResult stage = solveStage(queue, grid);
+        if (!haveSnapshot) {
+            total.initialResidual = stage.initialResidual;
+        }
+        total.iterations += stage.iterations;
+        total.residual = stage.residual;
+
+        if (printProgress) {
+            std::cout << "continuation gamma: " << gamma << " iterations: " << stage.iterations
+                << " residual: " << stage.residual << (stage.converged ? "\n" : " (failed)\n");
+        }
+
+        if (stage.converged) {
+            if (lastStage) {
+                total.converged = true;
+                break;
+            }
+
+            SyclSolver::copyBuffer(queue, sol, snapshot);
+            haveSnapshot = true;
+            acceptedGamma = gamma;
+
+            // adapt the step to the convergence speed of this stage
+            if (stage.iterations * 4 <= grid.maxiter) {
+                step *= 2.0;
+            }else if (stage.iterations * 4 > grid.maxiter * 3) {
+                step *= 0.5;
+            }
+        }else if (!haveSnapshot) {
+            // Already the start is too hard, retry halfway to the linear problem at gamma 0 from the initial guess
+            if (gamma == 0.0) {
+                std::cerr << "Continuation failed at gamma " << gamma << '\n';
+                break;
+            }
+            SyclSolver::copyBuffer(queue, snapshot, sol);
+            gamma = std::fabs(gamma) * 0.5 < minStep ? 0.0 : gamma * 0.5;
+            distance = targetGamma - gamma;
+            step = distance / std::max<std::size_t>(grid.continuationSteps, 1);
+            continue;
+        }else {
+            if (std::fabs(step) * 0.5 < minStep) {
+                std::cerr << "Continuation failed at gamma " << gamma << '\n';
+                break;
+            }
+
+            // roll back to the last accepted solution and retry with a smaller step
+            SyclSolver::copyBuffer(queue, snapshot, sol);
+            step *= 0.5;
+        }
+
+        gamma = distance > 0.0 ? std::min(acceptedGamma + step, targetGamma) : std::max(acceptedGamma + step, targetGamma);
+    }
+
+    grid.gamma = targetGamma;
+    grid.tol = targetTol;
+    grid.printProgress = printProgress;
+    grid.referenceResidual = 0.0;
+
+    return total;
+}
+
+SolveResult ContinuationSolver::solveStage(cl::sycl::queue& queue, SyclGridData& grid)
+{
+    if (grid.mode == GridParams::NEWTON) {
+        return NewtonSolver::solve(queue, grid);
+    }else {
+        return SyclSolver::solve(queue, grid);
+    }
+}
+
+// The iterate that carries over between stages
+SyclBuffer& ContinuationSolver::solution(SyclGridData& grid)
+{
+    if (grid.mode == GridParams::NEWTON) {
+        return grid.getLevel(0).newtonV;
+    }else {
+        return grid.getLevel(0).v;
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "SyclGridData.h"
+#include "../SolveResult.h"
+
+// Solves the nonlinear (FAS or Newton) problem by ramping gamma from
+// grid.continuationStart up to grid.gamma, warm starting every stage from the previous solution
+class ContinuationSolver {
+public:
+	static SolveResult solve(cl::sycl::queue& queue, SyclGridData& grid);
+
+private:
+	static SolveResult solveStage(cl::sycl::queue& queue, SyclGridData& grid);
+	static SyclBuffer& solution(SyclGridData& grid);
+};
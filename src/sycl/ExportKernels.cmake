@@ -0,0 +1,60 @@
+# Generates the OpenCL kernels of GpuSolve-gtx ahead of time, run by the GpuSolve-kernels target.
+# Solves every config in each mode with "exportKernels" set, then compiles the kernels to SPIR-V
+# if clang and llvm-spirv are available.
+#
+# SOLVER: path to GpuSolve-gtx
+# CONFIGS: config files, separated by '|'
+# OUTPUT_DIR: one subdirectory per config and mode is created here
+# CLANG, LLVM_SPIRV: optional compilers for SPIR-V
+
+string(REPLACE "|" ";" CONFIGS "${CONFIGS}")
+
+foreach(config ${CONFIGS})
+    get_filename_component(name "${config}" NAME_WE)
+    file(STRINGS "${config}" lines)
+
+    foreach(mode 0 1 2)
+        set(dir "${OUTPUT_DIR}/${name}-mode${mode}")
+        file(REMOVE_RECURSE "${dir}")
+        file(MAKE_DIRECTORY "${dir}")
+
+        # line 6 of the config selects the mode
+        set(content "")
+        set(lineNum 1)
+        foreach(line IN LISTS lines)
+            if(lineNum EQUAL 6)
+                set(line ${mode})
+            endif()
+            string(APPEND content "${line}\n")
+            math(EXPR lineNum "${lineNum} + 1")
+        endforeach()
+        string(APPEND content "exportKernels ${dir}\n")
+        file(WRITE "${dir}/export.conf" "${content}")
+
+        message(STATUS "Generating kernels for ${name} in mode ${mode}")
+        execute_process(COMMAND "${SOLVER}" "${dir}/export.conf" RESULT_VARIABLE result OUTPUT_QUIET)
+        file(REMOVE "${dir}/export.conf")
+        if(NOT result EQUAL 0)
+            message(FATAL_ERROR "Generating kernels for ${config} failed: ${result}")
+        endif()
+
+        if(CLANG AND LLVM_SPIRV)
+            file(GLOB sources "${dir}/*.cl")
+            foreach(source ${sources})
+                get_filename_component(stem "${source}" NAME_WE)
+                execute_process(
+                    COMMAND "${CLANG}" -cl-std=CL1.2 -target spir64 -O2 -emit-llvm -c
+                        -Xclang -finclude-default-header "${source}" -o "${dir}/${stem}.bc"
+                    RESULT_VARIABLE result)
+                if(result EQUAL 0)
+                    execute_process(COMMAND "${LLVM_SPIRV}" "${dir}/${stem}.bc" -o "${dir}/${stem}.spv" RESULT_VARIABLE result)
+                endif()
+                if(NOT result EQUAL 0)
+                    # the runtime falls back to the OpenCL C source
+                    message(WARNING "Could not compile ${source} to SPIR-V")
+                endif()
+                file(REMOVE "${dir}/${stem}.bc")
+            endforeach()
+        endif()
+    endforeach()
+endforeach()
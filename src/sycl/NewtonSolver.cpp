@@ -1,7 +1,14 @@
 #include "NewtonSolver.h"
 #include "SyclSolver.h"
+#include "../Nonlinearity.h"
+#include "../Watchdog.h"
 #include "../Timer.h"
+#include "Anderson.h"
+#include <algorithm>
 #include <fstream>
+#include <cmath>
+#include <memory>
+#include <vector>
 #ifdef _WIN32
     #include <windows.h>
     #include <psapi.h>
@@ -15,29 +22,113 @@ template<>
 struct sycl::is_device_copyable<Stencil> : std::true_type {};
 #endif
 
-void NewtonSolver::solve(cl::sycl::queue& queue, SyclGridData& grid) {
+SolveResult NewtonSolver::solve(cl::sycl::queue& queue, SyclGridData& grid) {
     // newtonF already filled at this point
+    double refResidual = grid.referenceResidual;
+    if (grid.gridSequencing > 0 && grid.numLevels() > 2) {
+        // the tolerance stays relative to the residual of the initial guess, not of the sequenced one
+        if (refResidual <= 0.0) {
+            refResidual = compF(queue, grid, grid.newtonF, true);
+        }
+        sequence(queue, grid);
+    }
+
+    return iterate(queue, grid, grid.newtonF, grid.tol, refResidual);
+}
+
+// Solves on the coarser levels first, each solution interpolated up is the initial newtonV of the next finer level
+void NewtonSolver::sequence(cl::sycl::queue& queue, SyclGridData& grid)
+{
+    // The coarse solutions only need to be more accurate than their discretization,
+    // the coarsest level stays below them for the multigrid solves
+    constexpr double sequenceTol = 1e-3;
+    const std::size_t coarsest = std::min(grid.gridSequencing, grid.numLevels() - 2);
+
+    // right hand sides of the coarse problems, restricted from the original one
+    std::vector<std::unique_ptr<SyclBuffer>> rhs(coarsest + 1);
+    for (std::size_t i = 1; i <= coarsest; i++) {
+        const SyclBuffer& f = grid.getLevel(i).f;
+        rhs[i] = std::make_unique<SyclBuffer>(f.getLayout());
+        SyclSolver::restrict(queue, i == 1 ? grid.newtonF : *rhs[i - 1], *rhs[i]);
+    }
+
+    queue.submit([&](handler& cgh) {
+        SyclBuffer& v = grid.getLevel(coarsest).newtonV;
+        auto vAcc = v.get_access<access::mode::discard_write>(cgh);
+        cgh.parallel_for<class resetSeq>(range<1>(v.flatSize()), [=](id<1> index) {
+            vAcc[index] = 0.0;
+        });
+    });
+
+    for (std::size_t i = coarsest; i > 0; i--) {
+        SyclGridData::LevelData& level = grid.getLevel(i);
+        std::cout << "Grid sequencing, level " << i << " (" << level.levelDim[0] << 'x' << level.levelDim[1] << 'x' << level.levelDim[2] << ")\n";
+
+        grid.finestLevel = i;
+        iterate(queue, grid, *rhs[i], sequenceTol, 0.0);
+
+        // initial newtonV of the next finer level
+        SyclSolver::interpolate(queue, grid.getLevel(i - 1).newtonV, level.newtonV);
+    }
+    grid.finestLevel = 0;
+}
+
+// Newton iterations on grid.finestLevel, starting from its newtonV.
+// The tolerance is relative to refResidual, or to the initial residual if that is 0
+SolveResult NewtonSolver::iterate(cl::sycl::queue& queue, SyclGridData& grid, SyclBuffer& rhs, double tol, double refResidual)
+{
+    SyclGridData::LevelData& finest = grid.getLevel(grid.finestLevel);
+    SolveResult result;
  
 	// Compute inital residual
-    double initialResidual = compF(queue, grid, true);
+    double initialResidual = compF(queue, grid, rhs, true);
+    result.initialResidual = initialResidual;
+    result.residual = initialResidual;
 	std::cout << "Inital newton residual: " << initialResidual << '\n';
 
+    const double stopResidual = (refResidual > 0.0 ? refResidual : initialResidual) / (1.0 / tol);
+
+    std::unique_ptr<Anderson> anderson;
+    if (grid.andersonDepth > 0) {
+        anderson = std::make_unique<Anderson>(grid.andersonDepth, finest.newtonV);
+    }
+
+    // the iterate with the best residual so far, the watchdog rolls back to it
+    Watchdog watchdog(grid, Watchdog::NEWTON, initialResidual);
+    std::unique_ptr<SyclBuffer> lastGood;
+    if (watchdog.enabled()) {
+        lastGood = std::make_unique<SyclBuffer>(finest.newtonV.getLayout());
+        SyclSolver::copyBuffer(queue, finest.newtonV, *lastGood);
+    }
+    // the damping is a literal in the kernel, so the retries can't use the archived one
+    std::unique_ptr<KernelVariant> retryVariant;
+
 	for (std::size_t i = 0; i < grid.maxiter; i++) {
 		Timer::start();
 
-        compF(queue, grid, false);
+        compF(queue, grid, rhs, false);
         // clear v
         queue.submit([&](handler& cgh) {
-            SyclBuffer& v = grid.getLevel(0).v;
+            SyclBuffer& v = finest.v;
             auto vAcc = v.get_access<access::mode::discard_write>(cgh);
             cgh.parallel_for<class resetN>(range<1>(v.flatSize()), [=](id<1> index) {
                 vAcc[index] = 0.0;
             });
         });
 
-        findError(queue, grid);
+        if (anderson) {
+            anderson->saveIterate(queue, finest.newtonV);
+        }
+
+        findError(queue, grid, watchdog.damping());
+
+        if (anderson) {
+            anderson->mix(queue, finest.newtonV);
+        }
 
-        double res = compF(queue, grid, true);
+        double res = compF(queue, grid, rhs, true);
+        result.iterations = i + 1;
+        result.residual = res;
 
         std::cout << "Newton iter: " << i << " residual: " << res << ' ';
 		Timer::stop();
@@ -49,41 +140,64 @@ void NewtonSolver::solve(cl::sycl::queue& queue, SyclGridData& grid) {
         }
 #endif
 
-        if (res <= initialResidual / (1.0 / grid.tol)) {
-            return;
+        if (res <= stopResidual) {
+            result.converged = true;
+            return result;
+        }
+        if (watchdog.enabled()) {
+            const Watchdog::Verdict verdict = watchdog.check(res);
+            if (verdict == Watchdog::IMPROVED) {
+                SyclSolver::copyBuffer(queue, finest.newtonV, *lastGood);
+            }else if (verdict == Watchdog::DIVERGED) {
+                SyclSolver::copyBuffer(queue, *lastGood, finest.newtonV);
+                result.residual = watchdog.bestResidual();
+                if (!watchdog.backOff(res)) {
+                    return result;
+                }
+                retryVariant.reset();
+                retryVariant = std::make_unique<KernelVariant>("damping" + std::to_string(watchdog.retries()));
+                if (anderson) {
+                    // the history belongs to the abandoned iterates
+                    anderson = std::make_unique<Anderson>(grid.andersonDepth, finest.newtonV);
+                }
+                continue;
+            }
+        }
+        if (!std::isfinite(res)) {
+            return result;
         }
 
 	}
 
+    return result;
 }
 
-double NewtonSolver::compF(cl::sycl::queue& queue, SyclGridData& grid, bool calcSum)
+// residual of newtonV on the finest level for the given right hand side, stored in f of that level
+double NewtonSolver::compF(cl::sycl::queue& queue, SyclGridData& grid, SyclBuffer& rhs, bool calcSum)
 {
-    SyclGridData::LevelData& level = grid.getLevel(0);
+    SyclGridData::LevelData& level = grid.getLevel(grid.finestLevel);
 
     queue.submit([&](handler& cgh) {
 
         range<3> range(level.levelDim[0], level.levelDim[1], level.levelDim[2]);
 
-        auto newtonfAcc = grid.newtonF.get_access<access::mode::read>(cgh);
+        auto newtonfAcc = rhs.get_access<access::mode::read>(cgh);
         auto vAcc = level.newtonV.get_access<access::mode::read>(cgh);
         auto fAcc = level.f.get_access<access::mode::write>(cgh);
 
-        cgh.parallel_for<class newtonF>(range, [=, h=level.h, gamma=grid.gamma, dims=level.f.getDims(), stencil=grid.stencil](id<3> index) {
+        cgh.parallel_for<class newtonF>(range, [=, h=level.h, gamma=grid.gamma, layout=level.f.getLayout(), stencil=grid.stencil](id<3> index) {
             double1 stencilsum = 0.0;
             for (std::size_t i = 0; i < stencil.values.size(); i++) {
-                const int1 flatIdx = Sycl3dAccesor::flatIndex(dims, index[0] + (stencil.getXOffset(i) + 1), index[1] + (stencil.getYOffset(i) + 1), index[2] + (stencil.getZOffset(i) + 1));
+                const int1 flatIdx = Sycl3dAccesor::flatIndex(layout, index[0] + (stencil.getXOffset(i) + 1), index[1] + (stencil.getYOffset(i) + 1), index[2] + (stencil.getZOffset(i) + 1));
                 auto vVal = vAcc[flatIdx];
                 stencilsum += stencil.values[i] * vVal;
             }
 
-            int1 centerIdx = Sycl3dAccesor::shift1Index(dims, index);
+            int1 centerIdx = Sycl3dAccesor::shift1Index(layout, index);
             stencilsum /= h * h;
 
-            // See tutorial_multigrid.pdf, page 102, Formula 6.13
             double1 vVal = vAcc[centerIdx];
-            double1 ex = cl::sycl::exp(vVal);
-            double1 nonLinear = gamma * vVal * ex;
+            double1 nonLinear = Nonlinearity::value(gamma, vVal);
             stencilsum += nonLinear;
 
             // Can't combine them, generates false results
@@ -99,27 +213,38 @@ double NewtonSolver::compF(cl::sycl::queue& queue, SyclGridData& grid, bool calc
     }
 }
 
-void NewtonSolver::findError(cl::sycl::queue& queue, SyclGridData& grid)
+// damping: fraction of the correction added to newtonV
+void NewtonSolver::findError(cl::sycl::queue& queue, SyclGridData& grid, double damping)
 {
     SyclGridData mgGrid = grid;
     mgGrid.printProgress = false;
     mgGrid.maxiter = 10;
     mgGrid.tol = 0.1;
+    mgGrid.referenceResidual = 0.0;
 
-    for (std::size_t i = 1; i < grid.numLevels() - 1; i++) {
+    for (std::size_t i = grid.finestLevel + 1; i < grid.numLevels() - 1; i++) {
         SyclBuffer& src = mgGrid.getLevel(i - 1).newtonV;
         SyclBuffer& dst = mgGrid.getLevel(i).newtonV;
         SyclSolver::restrict(queue, src, dst);
     }
 
     SyclSolver::solve(queue, mgGrid);
+    // settings the watchdog of the inner solve backed off to, kept until the Newton iterations end
+    grid.omega = mgGrid.omega;
+    grid.preSmoothing = mgGrid.preSmoothing;
+    grid.postSmoothing = mgGrid.postSmoothing;
+    grid.watchdogBackOffs = mgGrid.watchdogBackOffs;
 
     queue.submit([&](handler& cgh) {
-        auto newtonvAcc = grid.getLevel(0).newtonV.get_access<access::mode::read_write>(cgh);
-        auto vAcc = mgGrid.getLevel(0).v.get_access<access::mode::read>(cgh);
-
-        cgh.parallel_for<class sumN>(range<1>(grid.getLevel(0).newtonV.flatSize()), [newtonvAcc, vAcc](id<1> index) {
-            newtonvAcc[index] += vAcc[index];
+        auto newtonvAcc = grid.getLevel(grid.finestLevel).newtonV.get_access<access::mode::read_write>(cgh);
+        auto vAcc = mgGrid.getLevel(grid.finestLevel).v.get_access<access::mode::read>(cgh);
+
+        cgh.parallel_for<class sumN>(range<1>(grid.getLevel(grid.finestLevel).newtonV.flatSize()), [newtonvAcc, vAcc, damping](id<1> index) {
+            if (damping == 1.0) {
+                newtonvAcc[index] += vAcc[index];
+            }else {
+                newtonvAcc[index] += damping * vAcc[index];
+            }
         });
     });
 
@@ -1,11 +1,14 @@
 #pragma once
 #include "SyclGridData.h"
+#include "../SolveResult.h"
 
 class NewtonSolver {
 public:
-	static void solve(cl::sycl::queue& queue, SyclGridData& grid);
+	static SolveResult solve(cl::sycl::queue& queue, SyclGridData& grid);
 
 private:
-	static double compF(cl::sycl::queue& queue, SyclGridData& grid, bool calcSum);
-	static void findError(cl::sycl::queue& queue, SyclGridData& grid);
+	static void sequence(cl::sycl::queue& queue, SyclGridData& grid);
+	static SolveResult iterate(cl::sycl::queue& queue, SyclGridData& grid, SyclBuffer& rhs, double tol, double refResidual);
+	static double compF(cl::sycl::queue& queue, SyclGridData& grid, SyclBuffer& rhs, bool calcSum);
+	static void findError(cl::sycl::queue& queue, SyclGridData& grid, double damping);
 };
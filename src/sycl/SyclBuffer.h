@@ -1,7 +1,10 @@
 #pragma once
 #include <CL/sycl.hpp>
 #include <array>
+#include <cassert>
 #include "sycl_compat.h"
+#include "../Layout.h"
+#include "../cpu/Vector3.h"
 
 class SyclBuffer; // Forward declaration
 using BufferDim = std::array<std::size_t, 3>;
@@ -13,34 +16,34 @@ class Sycl3dAccesor
 public:
 	Sycl3dAccesor() = delete;
 
-	static int1 flatIndex(const BufferDim& dims, cl::sycl::id<3>& idx3)
+	static int1 flatIndex(const Layout& layout, cl::sycl::id<3>& idx3)
 	{
-		return idx3[2] * (dims[1] * dims[0]) + idx3[1] * dims[0] + idx3[0];
+		return idx3[0] * layout.strides[0] + idx3[1] * layout.strides[1] + idx3[2] * layout.strides[2];
 	}
 
 #ifdef SYCL_GTX
 	template<class point_ref_x, class point_ref_y, class point_ref_z>
-	static int1 flatIndex(const BufferDim& dims, const point_ref_x& x, const point_ref_y& y, const point_ref_z& z)
+	static int1 flatIndex(const Layout& layout, const point_ref_x& x, const point_ref_y& y, const point_ref_z& z)
 #else
-	static int flatIndex(const BufferDim& dims, const int x, const int y, const int z)
+	static int flatIndex(const Layout& layout, const int x, const int y, const int z)
 #endif
 	{
-		return z * (dims[1] * dims[0]) + y * dims[0] + x;
+		return x * layout.strides[0] + y * layout.strides[1] + z * layout.strides[2];
 	}
 
-	static int1 shift1Index(const BufferDim& dims, cl::sycl::id<3>& idx3)
+	static int1 shift1Index(const Layout& layout, cl::sycl::id<3>& idx3)
 	{
-		return (idx3[2]+1) * (dims[1] * dims[0]) + (idx3[1]+1) * dims[0] + (idx3[0]+1);
+		return (idx3[0]+1) * layout.strides[0] + (idx3[1]+1) * layout.strides[1] + (idx3[2]+1) * layout.strides[2];
 	}
 
 #ifdef SYCL_GTX
 	template<class point_ref_x, class point_ref_y, class point_ref_z>
-	static cl::sycl::detail::data_ref shift1Index(const BufferDim& dims, const point_ref_x& x, const point_ref_y& y, const point_ref_z& z)
+	static cl::sycl::detail::data_ref shift1Index(const Layout& layout, const point_ref_x& x, const point_ref_y& y, const point_ref_z& z)
 #else
-	static int shift1Index(const BufferDim& dims, const int x, const int y, const int z)
+	static int shift1Index(const Layout& layout, const int x, const int y, const int z)
 #endif
 	{
-		return (z + 1) * (dims[1] * dims[0]) + (y + 1) * dims[0] + (x + 1);
+		return (x + 1) * layout.strides[0] + (y + 1) * layout.strides[1] + (z + 1) * layout.strides[2];
 	}
 
 };
@@ -49,12 +52,34 @@ class SyclBuffer
 {
 public:
 
-	SyclBuffer(std::size_t x, std::size_t y, std::size_t z)
-		: buffer(cl::sycl::range<1>(x* y* z))
+	// Box of grid points, begin inclusive and end exclusive
+	struct Region {
+		BufferDim begin;
+		BufferDim end;
+
+		static Region point(std::size_t x, std::size_t y, std::size_t z)
+		{
+			return Region{ { x, y, z }, { x + 1, y + 1, z + 1 } };
+		}
+	};
+
+	SyclBuffer(std::size_t x, std::size_t y, std::size_t z, Layout::Order order)
+		: SyclBuffer(Layout(x, y, z, order))
+	{
+	}
+
+	explicit SyclBuffer(const Layout& fieldLayout)
+		: buffer(cl::sycl::range<1>(fieldLayout.size())), layout(fieldLayout)
+	{
+	}
+
+	// Uses the memory of the host field instead of a copy, host must outlive the buffer.
+	// The kernels write their results back to it when the buffer is destroyed.
+	// The host field must not be interleaved with others.
+	explicit SyclBuffer(Vector3& host)
+		: buffer(host.data(), cl::sycl::range<1>(host.flatSize())), layout(host.getLayout())
 	{
-		dims[0] = x;
-		dims[1] = y;
-		dims[2] = z;
+		assert(!host.isInterleaved());
 	}
 
 	template<cl::sycl::access::mode mode, cl::sycl::access::target target = cl::sycl::access::target::global_buffer>
@@ -63,6 +88,26 @@ public:
 		return buffer.get_access<mode, target>(cgh);
 	}
 
+	// The kernel may only use the points inside the region, sycl-gtx then only transfers those between host and device.
+	// Other implementations manage the transfers themselves and get an accessor to the whole buffer.
+	template<cl::sycl::access::mode mode, cl::sycl::access::target target = cl::sycl::access::target::global_buffer>
+	cl::sycl::accessor<double, 1, mode, target> get_access(cl::sycl::handler& cgh, const Region& region)
+	{
+#ifdef SYCL_GTX
+		// the region is given from the contiguous axis to the slowest one
+		const std::array<std::size_t, 3> axes = layout.axisOrder();
+		const cl::sycl::buffer_region bufferRegion{
+			{ region.begin[axes[0]], region.begin[axes[1]], region.begin[axes[2]] },
+			{ region.end[axes[0]] - region.begin[axes[0]], region.end[axes[1]] - region.begin[axes[1]], region.end[axes[2]] - region.begin[axes[2]] },
+			layout.strides[axes[1]], layout.strides[axes[2]]
+		};
+		return buffer.get_access<mode, target>(cgh, bufferRegion);
+#else
+		(void)region;
+		return buffer.get_access<mode, target>(cgh);
+#endif
+	}
+
 	template<cl::sycl::access::mode mode>
 	cl::sycl::accessor<double, 1, mode, cl::sycl::access::target::host_buffer> get_host_access()
 	{
@@ -71,29 +116,29 @@ public:
 
 	std::size_t getXdim() const
 	{
-		return dims[0];
+		return layout.dims[0];
 	}
 	std::size_t getYdim() const
 	{
-		return dims[1];
+		return layout.dims[1];
 	}
 	std::size_t getZdim() const
 	{
-		return dims[2];
+		return layout.dims[2];
 	}
 	std::size_t flatSize() const
 	{
-		return dims[0] * dims[1] * dims[2];
+		return layout.size();
 	}
 
 	cl::sycl::range<3> getRange() const
 	{
-		return cl::sycl::range<3>(dims[0], dims[1], dims[2]);
+		return cl::sycl::range<3>(layout.dims[0], layout.dims[1], layout.dims[2]);
 	}
 
-	const BufferDim& getDims() const
+	const Layout& getLayout() const
 	{
-		return dims;
+		return layout;
 	}
 
 	cl::sycl::buffer<double, 1>& nativeBuffer()
@@ -108,5 +153,5 @@ public:
 
 private:
 	cl::sycl::buffer<double, 1> buffer;
-	BufferDim dims;
+	Layout layout;
 };
\ No newline at end of file
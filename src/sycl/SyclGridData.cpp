@@ -1,4 +1,6 @@
 #include "SyclGridData.h"
+#include "../Nonlinearity.h"
+#include "../BlockInverse.h"
 
 namespace {
 	template<class Float>
@@ -12,7 +14,7 @@ namespace {
 }
 
 SyclGridData::SyclGridData(const GridParams& grid)
-	: GridParams(grid), newtonF(gridDim[0] + 2, gridDim[1] + 2, gridDim[2] + 2)
+	: GridParams(grid), newtonF(gridDim[0] + 2, gridDim[1] + 2, gridDim[2] + 2, layout)
 {
 	// magic 2.0 at the end is the coarsening ratio
 	int maxlevel = (int)floor(log((double)std::min(std::min(gridDim[0], gridDim[1]), gridDim[2])) / log(2.0)) + 1;
@@ -31,17 +33,26 @@ SyclGridData::SyclGridData(const GridParams& grid)
 		double h = 1.0 / (levelDim[1] + 1);
 
 		levels.push_back(LevelData{
-			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2),
-			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2),
-			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2),
-			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2),
-			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2),
-			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2, layout),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2, layout),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2, layout),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2, layout),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2, layout),
+			SyclBuffer(levelDim[0] + 2, levelDim[1] + 2, levelDim[2] + 2, layout),
 			levelDim,
-			h
+			h,
+			Stencil27{},
+			cl::sycl::buffer<double, 1>(cl::sycl::range<1>(smoother == BLOCK ? BlockInverse::tableSize : 1))
 		});
 
 	}
+
+	if (galerkin) {
+		const std::vector<Stencil27> ops = Galerkin::buildOperators(stencil, levels[0].h, levels.size());
+		for (std::size_t i = 0; i < levels.size(); i++) {
+			levels[i].op = ops[i];
+		}
+	}
 }
 
 void SyclGridData::initBuffers(cl::sycl::queue& queue)
@@ -56,8 +67,8 @@ void SyclGridData::initBuffers(cl::sycl::queue& queue)
 
 		if (this->mode == GridParams::LINEAR) {
 
-			cgh.parallel_for<class init_f_lin>(range, [=, h = this->h, dims = levels[0].f.getDims()](cl::sycl::id<3> index) {
-				int1 flatIndex = Sycl3dAccesor::flatIndex(dims, index);
+			cgh.parallel_for<class init_f_lin>(range, [=, h = this->h, layout = levels[0].f.getLayout()](cl::sycl::id<3> index) {
+				int1 flatIndex = Sycl3dAccesor::flatIndex(layout, index);
 				SYCL_IF(index[0] == 0 || index[1] == 0 || index[2] == 0) {
 					wAccessor[flatIndex] = 0.0;
 				}
@@ -77,8 +88,8 @@ void SyclGridData::initBuffers(cl::sycl::queue& queue)
 				SYCL_END;
 			});
 		}else {
-			cgh.parallel_for<class init_f>(range, [=, h=this->h, ga=gamma, dims=levels[0].f.getDims()](cl::sycl::id<3> index) {
-				int1 flatIndex = Sycl3dAccesor::flatIndex(dims, index);
+			cgh.parallel_for<class init_f>(range, [=, h=this->h, ga=gamma, layout=levels[0].f.getLayout()](cl::sycl::id<3> index) {
+				int1 flatIndex = Sycl3dAccesor::flatIndex(layout, index);
 
 				SYCL_IF(index[0] == 0 || index[1] == 0 || index[2] == 0) {
 					wAccessor[flatIndex] = 0.0;
@@ -92,9 +103,10 @@ void SyclGridData::initBuffers(cl::sycl::queue& queue)
 					double1 y = index[1] * h;
 					double1 z = index[2] * h;
 
+					// f = -Laplace(u) + N(u) for the solution u = (x - x^2)(y - y^2)(z - z^2)
+					double1 u = (x - x * x) * (y - y * y) * (z - z * z);
 					double1 val = 2.0 * ((y - y * y) * (z - z * z) + (x - x * x) * (z - z * z) + (x - x * x) * (y - y * y))
-						+ ga * (x - x * x) * (y - y * y) * (z - z * z)
-						* cl::sycl::exp((x - x * x) * (y - y * y) * (z - z * z));
+						+ Nonlinearity::value(ga, u);
 
 					wAccessor[flatIndex] = val;
 				}
@@ -114,6 +126,21 @@ void SyclGridData::initBuffers(cl::sycl::queue& queue)
 		});
 	}
 
+	if (smoother == BLOCK) {
+		for (std::size_t i = 0; i < levels.size(); i++) {
+			const bool useGalerkin = galerkin && i > 0;
+			const std::vector<double> inverse = BlockInverse::build(useGalerkin ? levels[i].op : Galerkin::scaledStencil(stencil, levels[i].h));
+#ifdef SYCL_GTX
+			auto inverseAcc = levels[i].blockInverse.get_access<cl::sycl::access::mode::discard_write, cl::sycl::access::target::host_buffer>();
+#else
+			sycl::host_accessor inverseAcc{ levels[i].blockInverse, sycl::write_only, sycl::no_init };
+#endif
+			for (std::size_t j = 0; j < inverse.size(); j++) {
+				inverseAcc[static_cast<int>(j)] = inverse[j];
+			}
+		}
+	}
+
 	// Init other buffers to 0
 	// TODO: Do I need to init all buffers? Can't I skip e and r?
 	for (std::size_t i = 0; i < levels.size(); i++) {
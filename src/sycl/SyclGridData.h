@@ -1,5 +1,6 @@
 #pragma once
 #include "../gridParams.h"
+#include "../Galerkin.h"
 #include "SyclBuffer.h"
 #include <CL/sycl.hpp>
 #include <vector>
@@ -18,6 +19,8 @@ public:
 		SyclBuffer e;
 		std::array<std::size_t, 3> levelDim;
 		double h;
+		Stencil27 op; // Galerkin operator, only used on coarse levels if enabled
+		cl::sycl::buffer<double, 1> blockInverse; // BlockInverse table of the level, only filled for the block smoother
 	};
 
 	SyclGridData(const GridParams& grid);
@@ -40,6 +43,9 @@ public:
 
 	SyclBuffer newtonF;
 
+	// Level the solvers treat as the finest one, grid sequencing solves on coarser levels first
+	std::size_t finestLevel = 0;
+
 private:
 	std::vector<LevelData> levels; // levels[0] is the finest level and levels[-1] is the coarsed level
 };
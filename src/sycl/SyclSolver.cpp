@@ -1,9 +1,15 @@
 #include "SyclSolver.h"
+#include "../Nonlinearity.h"
+#include "../BlockInverse.h"
+#include "../Watchdog.h"
 #include "../Timer.h"
+#include "Anderson.h"
 #include <iostream>
 #include <chrono>
 #include <string>
 #include <fstream>
+#include <cmath>
+#include <memory>
 #ifdef _WIN32
     #include <windows.h>
     #include <psapi.h>
@@ -22,7 +28,7 @@ struct sycl::is_device_copyable<Stencil> : std::true_type {};
 namespace {
 double getGpuVal(accessor<double, 1, access::mode::read, access::target::host_buffer>& acc, const SyclBuffer& buf, std::size_t x, std::size_t y, std::size_t z)
 {
-    const std::size_t idx1 = z * (buf.getYdim() * buf.getXdim()) + y * buf.getXdim() + x;
+    const std::size_t idx1 = buf.getLayout().index(x, y, z);
     return acc[static_cast<int>(idx1)];
 }
 void dumpGpuBuf(SyclBuffer& buf, const std::string& file)
@@ -48,21 +54,96 @@ void dumpGpuBuf(SyclBuffer& buf, const std::string& file)
 }
 #endif
 
-void SyclSolver::solve(cl::sycl::queue& queue, SyclGridData& grid)
+namespace {
+// Number of work items used by the reductions in sumBuffer and dotBuffer
+std::size_t reductionWorkItems(std::size_t& flatSize, bool& skipFirst)
+{
+    std::size_t num_work_items = 1;
+    if (flatSize % 2 != 0) {
+        // Ignore the first element, so we get an even number of items in the buffer
+        flatSize--;
+
+        while (true) {
+            std::size_t next = num_work_items * 2;
+            if (flatSize % next != 0) {
+                break;
+            }
+            if (next > 512) {
+                break;
+            }
+            num_work_items = next;
+        }
+
+        skipFirst = true;
+    }
+    else {
+        // Not all dimensions are odd
+        assert(false); // TODO: Implement and set num_work_items
+        skipFirst = false;
+    }
+
+    return num_work_items;
+}
+}
+
+SolveResult SyclSolver::solve(cl::sycl::queue& queue, SyclGridData& grid)
 {
-    compResidual(queue, grid, 0);
-    double initialResidual = sumBuffer(queue, grid.getLevel(0).r);
+    SolveResult result;
+
+    const std::size_t finest = grid.finestLevel;
+    compResidual(queue, grid, finest);
+    double initialResidual = sumBuffer(queue, grid.getLevel(finest).r);
+    result.initialResidual = initialResidual;
+    result.residual = initialResidual;
 
     if (grid.printProgress) {
         std::cout << "Inital residual: " << initialResidual << '\n';
     }
 
+    const double refResidual = grid.referenceResidual > 0.0 ? grid.referenceResidual : initialResidual;
+    const double stopResidual = refResidual / (1.0 / grid.tol);
+
+    // tau-extrapolation needs the restricted right hand side of the finest level in every cycle
+    const bool tauExtrapolation = grid.tauExtrapolation && grid.mode == GridParams::NONLINEAR && grid.numLevels() > finest + 1;
+    std::unique_ptr<SyclBuffer> restrictedF;
+    if (tauExtrapolation) {
+        const SyclBuffer& f1 = grid.getLevel(finest + 1).f;
+        restrictedF = std::make_unique<SyclBuffer>(f1.getLayout());
+        restrict(queue, grid.getLevel(finest).f, *restrictedF);
+    }
+    double lastRes = initialResidual;
+
+    // Accelerates the FAS cycles, the linear inner solves of Newton are left alone
+    std::unique_ptr<Anderson> anderson;
+    if (grid.andersonDepth > 0 && grid.mode == GridParams::NONLINEAR) {
+        anderson = std::make_unique<Anderson>(grid.andersonDepth, grid.getLevel(finest).v);
+    }
+
+    // the iterate with the best residual so far, the watchdog rolls back to it
+    Watchdog watchdog(grid, Watchdog::CYCLES, initialResidual);
+    std::unique_ptr<SyclBuffer> lastGood;
+    if (watchdog.enabled()) {
+        lastGood = std::make_unique<SyclBuffer>(grid.getLevel(finest).v.getLayout());
+        copyBuffer(queue, grid.getLevel(finest).v, *lastGood);
+    }
+    // omega is a literal in the kernels, so backed-off settings can't use the archived ones
+    std::unique_ptr<KernelVariant> retryVariant;
+    if (grid.watchdogBackOffs > 0) {
+        retryVariant = std::make_unique<KernelVariant>("omega" + std::to_string(grid.watchdogBackOffs));
+    }
+
     for (std::size_t i = 0; i < grid.maxiter; i++) {
         if (grid.printProgress) {
             Timer::start();
         }
 
-        double res = vcycle(queue, grid);
+        if (anderson) {
+            anderson->saveIterate(queue, grid.getLevel(finest).v);
+        }
+
+        double res = vcycle(queue, grid, restrictedF.get());
+        result.iterations = i + 1;
+        result.residual = res;
 
         if (grid.printProgress) {
             std::cout << "iter: " << i << " residual: " << res << ' ';
@@ -76,27 +157,63 @@ void SyclSolver::solve(cl::sycl::queue& queue, SyclGridData& grid)
         }
 #endif
 
-        if (res <= initialResidual / (1.0 / grid.tol)) {
-            return;
+        if (res <= stopResidual) {
+            result.converged = true;
+            return result;
+        }
+        if (watchdog.enabled()) {
+            const Watchdog::Verdict verdict = watchdog.check(res);
+            if (verdict == Watchdog::IMPROVED) {
+                copyBuffer(queue, grid.getLevel(finest).v, *lastGood);
+            }else if (verdict == Watchdog::DIVERGED) {
+                copyBuffer(queue, *lastGood, grid.getLevel(finest).v);
+                result.residual = watchdog.bestResidual();
+                if (!watchdog.backOff(res)) {
+                    return result;
+                }
+                retryVariant.reset();
+                retryVariant = std::make_unique<KernelVariant>("omega" + std::to_string(grid.watchdogBackOffs));
+                lastRes = result.residual;
+                if (anderson) {
+                    // the history belongs to the abandoned iterates
+                    anderson = std::make_unique<Anderson>(grid.andersonDepth, grid.getLevel(finest).v);
+                }
+                continue;
+            }
+        }
+        if (!std::isfinite(res)) {
+            // diverged, further cycles can't recover
+            return result;
+        }
+        // With tau-extrapolation the fine grid residual doesn't vanish, it converges to a non-zero value
+        if (tauExtrapolation && std::fabs(res - lastRes) <= grid.tol * lastRes) {
+            result.converged = true;
+            return result;
+        }
+        lastRes = res;
+
+        if (anderson) {
+            anderson->mix(queue, grid.getLevel(finest).v);
         }
     }
 
+    return result;
 }
 
-double SyclSolver::vcycle(queue& queue, SyclGridData& grid)
+// restrictedF: restricted right hand side of the finest level if tau-extrapolation is used, nullptr otherwise
+double SyclSolver::vcycle(queue& queue, SyclGridData& grid, SyclBuffer* restrictedF)
 {
-    for (std::size_t i = 0; i < grid.numLevels() - 1; i++) {
+    for (std::size_t i = grid.finestLevel; i < grid.numLevels() - 1; i++) {
 
         SyclGridData::LevelData& nextLevel = grid.getLevel(i + 1);
 
-        jacobi(queue, grid, i, grid.preSmoothing);
+        smooth(queue, grid, i, grid.preSmoothing);
 
         compResidual(queue, grid, i);
 
-        // restrict residual to next level f
-        restrict(queue, grid.getLevel(i).r, nextLevel.f);
-
         if (grid.mode != GridParams::NONLINEAR) {
+            // restrict residual to next level f
+            restrict(queue, grid.getLevel(i).r, nextLevel.f, grid.imageReads & GridParams::IMAGE_RESTRICT);
 
             // clear v for next level
             queue.submit([&](handler& cgh) {
@@ -107,26 +224,13 @@ double SyclSolver::vcycle(queue& queue, SyclGridData& grid)
             });
 
         }else {
-            restrict(queue, grid.getLevel(i).v, nextLevel.restV);
-            restrict(queue, grid.getLevel(i).v, nextLevel.v);
-
-            // Compute A^2h (v^2h), and save it in r, so we don't need a new buffer for it
-            applyStencil(queue, grid, i + 1, nextLevel.restV);
-
-            // Add A^2h (v^2h) to r^2h
-            queue.submit([&](handler& cgh) {
-                auto fAcc = nextLevel.f.get_access<access::mode::read_write>(cgh);
-                auto rAcc = nextLevel.r.get_access<access::mode::read>(cgh);
-                cgh.parallel_for<class sum>(range<1>(nextLevel.f.flatSize()), [=](id<1> index) {
-                    fAcc[index] += rAcc[index];
-                });
-            });
+            fasTransfer(queue, grid, i, i == grid.finestLevel ? restrictedF : nullptr);
         }
     }
 
-    jacobi(queue, grid, grid.numLevels() - 1, grid.preSmoothing + grid.postSmoothing);
+    smooth(queue, grid, grid.numLevels() - 1, grid.preSmoothing + grid.postSmoothing);
 
-    for (std::size_t i = grid.numLevels() - 1; i > 0; i--) {
+    for (std::size_t i = grid.numLevels() - 1; i > grid.finestLevel; i--) {
         SyclGridData::LevelData& thisLevel = grid.getLevel(i);
         SyclGridData::LevelData& prevLevel = grid.getLevel(i - 1);
 
@@ -142,7 +246,7 @@ double SyclSolver::vcycle(queue& queue, SyclGridData& grid)
         }
 
         // interpolate v to previous level e
-        interpolate(queue, prevLevel.e, thisLevel.v);
+        interpolate(queue, prevLevel.e, thisLevel.v, grid.imageReads & GridParams::IMAGE_INTERPOLATE);
 
         // v = v + e
         queue.submit([&](handler& cgh) {
@@ -153,19 +257,44 @@ double SyclSolver::vcycle(queue& queue, SyclGridData& grid)
             });
         });
 
-        jacobi(queue, grid, i - 1, grid.postSmoothing);
+        smooth(queue, grid, i - 1, grid.postSmoothing);
     }
 
-    compResidual(queue, grid, 0);
-    double res = sumBuffer(queue, grid.getLevel(0).r);
+    compResidual(queue, grid, grid.finestLevel);
+    double res = sumBuffer(queue, grid.getLevel(grid.finestLevel).r);
     return res;
 }
 
+void SyclSolver::smooth(queue& queue, SyclGridData& grid, std::size_t levelNum, std::size_t maxiter)
+{
+    if (grid.smoother == GridParams::BLOCK) {
+        blockJacobi(queue, grid, levelNum, maxiter);
+        return;
+    }
+
+    const std::vector<std::size_t> lineAxes = grid.lineAxes();
+    if (lineAxes.empty()) {
+        jacobi(queue, grid, levelNum, maxiter);
+        return;
+    }
+
+    // zebra line relaxation, the lines of one color don't couple with each other
+    for (std::size_t i = 0; i < maxiter; i++) {
+        for (std::size_t axis : lineAxes) {
+            for (std::size_t color = 0; color < 2; color++) {
+                compResidual(queue, grid, levelNum);
+                lineRelax(queue, grid, levelNum, axis, color);
+            }
+        }
+    }
+}
+
 void SyclSolver::jacobi(queue& queue, SyclGridData& grid, std::size_t levelNum, std::size_t maxiter)
 {
     SyclGridData::LevelData& level = grid.getLevel(levelNum);
-    const double preFac = grid.stencil.values[0] / (level.h * level.h);
-    const double alpha = (level.h * level.h) / grid.stencil.values[0]; // stencil center
+    const bool useGalerkin = grid.galerkin && levelNum > grid.finestLevel;
+    const double preFac = useGalerkin ? level.op.center() : grid.stencil.values[0] / (level.h * level.h);
+    const double alpha = 1.0 / preFac; // stencil center
 
     for (std::size_t i = 0; i < maxiter; i++) {
         compResidual(queue, grid, levelNum);
@@ -182,15 +311,13 @@ void SyclSolver::jacobi(queue& queue, SyclGridData& grid, std::size_t levelNum,
                 if (mode == GridParams::LINEAR) {
                     newV = vVal + omega * (alpha * rAcc[idx[0]]);
                 }else if(mode == GridParams::NONLINEAR) {
-                    double1 ex = cl::sycl::exp(vVal);
-                    double1 denuminator = preFac + gamma * (1 + vVal) * ex;
+                    double1 denuminator = preFac + Nonlinearity::derivative(gamma, vVal);
 
                     newV = vVal + omega * (rAcc[idx[0]] / denuminator);
                 }else {
                     // Newton
                     double1 newtonV = newtonvAcc[idx[0]];
-                    double1 ex = cl::sycl::exp(newtonV);
-                    double1 denuminator = preFac + gamma * (1 + newtonV) * ex;
+                    double1 denuminator = preFac + Nonlinearity::derivative(gamma, newtonV);
 
                     newV = vVal + omega * (rAcc[idx[0]] / denuminator);
                 }
@@ -201,41 +328,117 @@ void SyclSolver::jacobi(queue& queue, SyclGridData& grid, std::size_t levelNum,
     }
 }
 
+// Damped block-Jacobi sweeps, one work item solves one 2x2x2 block exactly for the residual in r.
+// Linear mode only.
+void SyclSolver::blockJacobi(queue& queue, SyclGridData& grid, std::size_t levelNum, std::size_t maxiter)
+{
+    SyclGridData::LevelData& level = grid.getLevel(levelNum);
+    assert(grid.mode == GridParams::LINEAR);
+    const std::array<std::size_t, 3>& dim = level.levelDim;
+    range<3> blocks((dim[0] + 1) / 2, (dim[1] + 1) / 2, (dim[2] + 1) / 2);
+
+    // with an odd number of points the last block along an axis is thin, -1 if there is none
+    const int lastX = dim[0] % 2 == 1 ? static_cast<int>(blocks[0]) - 1 : -1;
+    const int lastY = dim[1] % 2 == 1 ? static_cast<int>(blocks[1]) - 1 : -1;
+    const int lastZ = dim[2] % 2 == 1 ? static_cast<int>(blocks[2]) - 1 : -1;
+
+    for (std::size_t i = 0; i < maxiter; i++) {
+        compResidual(queue, grid, levelNum);
+
+        queue.submit([&](handler& cgh) {
+            auto vAcc = level.v.get_access<access::mode::read_write>(cgh);
+            auto rAcc = level.r.get_access<access::mode::read>(cgh);
+            auto inverseAcc = level.blockInverse.get_access<access::mode::read>(cgh);
+
+            cgh.parallel_for<class blockK>(blocks, [=, omega=grid.omega, layout=level.v.getLayout()](id<3> index) {
+                int1 shape = 0;
+                SYCL_IF(index[0] == lastX) {
+                    shape = shape + static_cast<int>(BlockInverse::shape(true, false, false));
+                }
+                SYCL_END;
+                SYCL_IF(index[1] == lastY) {
+                    shape = shape + static_cast<int>(BlockInverse::shape(false, true, false));
+                }
+                SYCL_END;
+                SYCL_IF(index[2] == lastZ) {
+                    shape = shape + static_cast<int>(BlockInverse::shape(false, false, true));
+                }
+                SYCL_END;
+
+                // r is 0 on the boundary, which the thin blocks reach into, so the correction is 0 there as well
+                std::array<int1, BlockInverse::points> idx;
+                std::array<double1, BlockInverse::points> res;
+                for (std::size_t j = 0; j < BlockInverse::points; j++) {
+                    idx[j] = Sycl3dAccesor::flatIndex(layout, 2 * index[0] + (j / 4 + 1), 2 * index[1] + ((j / 2) % 2 + 1), 2 * index[2] + (j % 2 + 1));
+                    res[j] = rAcc[idx[j]];
+                }
+
+                int1 base = shape * static_cast<int>(BlockInverse::points * BlockInverse::points);
+                for (std::size_t p = 0; p < BlockInverse::points; p++) {
+                    double1 delta = 0.0;
+                    for (std::size_t j = 0; j < BlockInverse::points; j++) {
+                        delta += inverseAcc[base + static_cast<int>(p * BlockInverse::points + j)] * res[j];
+                    }
+                    vAcc[idx[p]] += omega * delta;
+                }
+            });
+        });
+    }
+}
+
 void SyclSolver::compResidual(queue& queue, SyclGridData& grid, std::size_t levelNum)
+{
+    if (grid.imageReads & GridParams::IMAGE_RESIDUAL) {
+        residual<imageTarget>(queue, grid, levelNum);
+    }else {
+        residual<access::target::global_buffer>(queue, grid, levelNum);
+    }
+}
+
+template<access::target readTarget>
+void SyclSolver::residual(queue& queue, SyclGridData& grid, std::size_t levelNum)
 {
     SyclGridData::LevelData& level = grid.getLevel(levelNum);
+    const bool useGalerkin = grid.galerkin && levelNum > grid.finestLevel;
 
     range<3> range(level.levelDim[0], level.levelDim[1], level.levelDim[2]);
 
     queue.submit([&](handler& cgh) {
 
-        auto fAcc = level.f.get_access<access::mode::read>(cgh);
-        auto vAcc = level.v.get_access<access::mode::read>(cgh);
-        auto newtonvAcc = level.newtonV.get_access<access::mode::read>(cgh);
+        auto fAcc = level.f.get_access<access::mode::read, readTarget>(cgh);
+        auto vAcc = level.v.get_access<access::mode::read, readTarget>(cgh);
+        auto newtonvAcc = level.newtonV.get_access<access::mode::read, readTarget>(cgh);
         auto rAcc = level.r.get_access<access::mode::write>(cgh);
 
-        cgh.parallel_for<class residual>(range, [=, h=level.h, gamma=grid.gamma, mode=grid.mode, dims=level.v.getDims(), stencil=grid.stencil](id<3> index) {
+        cgh.parallel_for<class residual>(range, [=, h=level.h, gamma=grid.gamma, mode=grid.mode, layout=level.v.getLayout(), stencil=grid.stencil, op=level.op](id<3> index) {
             double1 stencilsum = 0.0;
-            for (std::size_t i = 0; i < stencil.values.size(); i++) {
-                const int1 flatIdx = Sycl3dAccesor::flatIndex(dims, index[0] + (stencil.getXOffset(i) + 1), index[1] + (stencil.getYOffset(i) + 1), index[2] + (stencil.getZOffset(i) + 1));
-                auto vVal = vAcc[flatIdx];
-                stencilsum += stencil.values[i] * vVal;
+            if (useGalerkin) {
+                for (std::size_t i = 0; i < op.values.size(); i++) {
+                    if (op.values[i] != 0.0) {
+                        const int1 flatIdx = Sycl3dAccesor::flatIndex(layout, index[0] + (Stencil27::getXOffset(i) + 1), index[1] + (Stencil27::getYOffset(i) + 1), index[2] + (Stencil27::getZOffset(i) + 1));
+                        auto vVal = vAcc[flatIdx];
+                        stencilsum += op.values[i] * vVal;
+                    }
+                }
+            }else {
+                for (std::size_t i = 0; i < stencil.values.size(); i++) {
+                    const int1 flatIdx = Sycl3dAccesor::flatIndex(layout, index[0] + (stencil.getXOffset(i) + 1), index[1] + (stencil.getYOffset(i) + 1), index[2] + (stencil.getZOffset(i) + 1));
+                    auto vVal = vAcc[flatIdx];
+                    stencilsum += stencil.values[i] * vVal;
+                }
+                stencilsum /= h * h;
             }
 
-            int1 centerIdx = Sycl3dAccesor::shift1Index(dims, index);
-            stencilsum /= h * h;
+            int1 centerIdx = Sycl3dAccesor::shift1Index(layout, index);
 
             if (mode == GridParams::NEWTON) {
                 double1 newtonV = newtonvAcc[centerIdx];
-                double1 ex = cl::sycl::exp(newtonV);
-                double1 nonLinear = gamma * (1 + newtonV) * vAcc[centerIdx] * ex;
+                double1 nonLinear = Nonlinearity::derivative(gamma, newtonV) * vAcc[centerIdx];
                 stencilsum += nonLinear;
             }
             else if (mode == GridParams::NONLINEAR) {
-                // See tutorial_multigrid.pdf, page 102, Formula 6.13
                 double1 vVal = vAcc[centerIdx];
-                double1 ex = cl::sycl::exp(vVal);
-                double1 nonLinear = gamma * vVal * ex;
+                double1 nonLinear = Nonlinearity::value(gamma, vVal);
                 stencilsum += nonLinear;
             }
 
@@ -244,40 +447,168 @@ void SyclSolver::compResidual(queue& queue, SyclGridData& grid, std::size_t leve
     });
 }
 
-// save result in 'r'. Only needed for non-linear
-void SyclSolver::applyStencil(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum, SyclBuffer& v)
+// Solves the linearized equations exactly along all lines in direction 'axis' whose other two
+// coordinates sum up to the given parity. One work item per line, the Thomas algorithm keeps
+// its modified upper diagonal in 'e' and the modified right hand side in 'r'.
+void SyclSolver::lineRelax(queue& queue, SyclGridData& grid, std::size_t levelNum, std::size_t axis, std::size_t color)
 {
-    assert(grid.mode == GridParams::NONLINEAR);
     SyclGridData::LevelData& level = grid.getLevel(levelNum);
-    assert(level.v.flatSize() == v.flatSize());
-    SyclBuffer& result = level.r;
+    const double invH2 = 1.0 / (level.h * level.h);
+    const bool useGalerkin = grid.galerkin && levelNum > grid.finestLevel;
+    std::array<int, 3> offset{ 0, 0, 0 };
+    const double center = useGalerkin ? level.op.center() : grid.stencil.values[0] * invH2;
+    offset[axis] = -1;
+    const double lower = useGalerkin ? level.op.values[Stencil27::index(offset[0], offset[1], offset[2])] : grid.stencil.valueAt(offset[0], offset[1], offset[2]) * invH2;
+    offset[axis] = 1;
+    const double upper = useGalerkin ? level.op.values[Stencil27::index(offset[0], offset[1], offset[2])] : grid.stencil.valueAt(offset[0], offset[1], offset[2]) * invH2;
+
+    const std::size_t axisB = (axis + 1) % 3;
+    const std::size_t axisC = (axis + 2) % 3;
+    const std::array<std::size_t, 3>& strides = level.v.getLayout().strides;
+    const int n = static_cast<int>(level.levelDim[axis]);
+
+    range<2> lines(level.levelDim[axisB], level.levelDim[axisC]);
+    // axis and color are literals in the kernel, but don't always change its range
+    KernelVariant variant("line" + std::to_string(axis) + std::to_string(color));
 
-    range<3> range(level.levelDim[0], level.levelDim[1], level.levelDim[2]);
+    queue.submit([&](handler& cgh) {
+        auto vAcc = level.v.get_access<access::mode::read_write>(cgh);
+        auto newtonvAcc = level.newtonV.get_access<access::mode::read>(cgh);
+        auto rAcc = level.r.get_access<access::mode::read_write>(cgh);
+        auto eAcc = level.e.get_access<access::mode::discard_write>(cgh);
+
+        cgh.parallel_for<class lineK>(lines, [=, gamma=grid.gamma, mode=grid.mode, color=static_cast<int>(color),
+            stride=static_cast<int>(strides[axis]), strideB=static_cast<int>(strides[axisB]), strideC=static_cast<int>(strides[axisC])](id<2> index) {
+            int1 p = index[0] + 1;
+            int1 q = index[1] + 1;
+
+            SYCL_IF((p + q) % 2 == color) {
+                int1 base = p * strideB + q * strideC;
+
+                // Thomas algorithm, forward sweep
+                double1 cPrev = 0.0;
+                double1 dPrev = 0.0;
+                SYCL_FOR(int1 t = 1, t < n + 1, t++) {
+                    int1 idx = base + t * stride;
+
+                    double1 diag = center;
+                    if (mode == GridParams::NONLINEAR) {
+                        double1 vVal = vAcc[idx];
+                        diag += Nonlinearity::derivative(gamma, vVal);
+                    }
+                    else if (mode == GridParams::NEWTON) {
+                        double1 newtonV = newtonvAcc[idx];
+                        diag += Nonlinearity::derivative(gamma, newtonV);
+                    }
+
+                    double1 denom = diag - lower * cPrev;
+                    cPrev = upper / denom;
+                    dPrev = (rAcc[idx] - lower * dPrev) / denom;
+                    eAcc[idx] = cPrev;
+                    rAcc[idx] = dPrev;
+                }
+                SYCL_END;
+
+                // backward substitution, adds the correction to v
+                double1 delta = 0.0;
+                SYCL_FOR(int1 tBack = n, tBack > 0, tBack--) {
+                    int1 idx = base + tBack * stride;
+                    delta = rAcc[idx] - eAcc[idx] * delta;
+                    vAcc[idx] += delta;
+                }
+                SYCL_END;
+            }
+            SYCL_END;
+        });
+    });
+}
+
+// FAS transfer to the next level in two passes like on the CPU, reads the fine r and v only once:
+// v^2h = restV^2h = R v^h and f^2h = R r^h + A^2h(restV^2h).
+// A^2h needs restV at the neighbours, so the second pass applies it after the first one has written all of restV.
+// restrictedF: restricted right hand side of the finest level for tau-extrapolation, nullptr otherwise
+void SyclSolver::fasTransfer(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum, SyclBuffer* restrictedF)
+{
+    assert(grid.mode == GridParams::NONLINEAR);
+    SyclGridData::LevelData& fine = grid.getLevel(levelNum);
+    SyclGridData::LevelData& coarse = grid.getLevel(levelNum + 1);
+    const bool useGalerkin = grid.galerkin && levelNum + 1 > grid.finestLevel;
+    const bool tauExtrapolation = restrictedF != nullptr;
+    // Only read by the second kernel with tau-extrapolation
+    SyclBuffer& rf = tauExtrapolation ? *restrictedF : coarse.restV;
+
+    range<3> range(coarse.levelDim[0], coarse.levelDim[1], coarse.levelDim[2]);
 
     queue.submit([&](handler& cgh) {
+        auto fineVAcc = fine.v.get_access<access::mode::read>(cgh);
+        auto fineRAcc = fine.r.get_access<access::mode::read>(cgh);
+        auto fAcc = coarse.f.get_access<access::mode::write>(cgh);
+        auto vAcc = coarse.v.get_access<access::mode::write>(cgh);
+        auto restvAcc = coarse.restV.get_access<access::mode::write>(cgh);
+
+        cgh.parallel_for<class fasRestrictK>(range, [=, fineLayout=fine.v.getLayout(), coarseLayout=coarse.v.getLayout()](id<3> index) {
+            int1 x = index[0] + 1;
+            int1 y = index[1] + 1;
+            int1 z = index[2] + 1;
+
+            // Full weighting of fine v and r around the coarse point, both at once
+            double1 restV = 0.0;
+            double1 restR = 0.0;
+            for (int ii = -2 + 1; ii < 2; ii++) {
+                for (int jj = -2 + 1; jj < 2; jj++) {
+                    for (int kk = -2 + 1; kk < 2; kk++) {
+                        double fac = 0.125 * ((2.0 - abs(ii)) / 2.0) * ((2.0 - abs(jj)) / 2.0) * ((2.0 - abs(kk)) / 2.0);
+                        int1 fineIdx = Sycl3dAccesor::flatIndex(fineLayout, 2 * x + ii, 2 * y + jj, 2 * z + kk);
+                        double1 fineV = fineVAcc[fineIdx];
+                        double1 fineR = fineRAcc[fineIdx];
+                        restV += fac * fineV;
+                        restR += fac * fineR;
+                    }
+                }
+            }
 
-        auto vAcc = v.get_access<access::mode::read>(cgh);
-        auto resultAcc = result.get_access<access::mode::write>(cgh);
+            int1 centerIdx = Sycl3dAccesor::shift1Index(coarseLayout, index);
+            fAcc[centerIdx] = restR;
+            vAcc[centerIdx] = restV;
+            restvAcc[centerIdx] = restV;
+        });
+    });
+
+    // restV is 0 on the boundary, so the stencil needs no bounds checks
+    queue.submit([&](handler& cgh) {
+        auto restvAcc = coarse.restV.get_access<access::mode::read>(cgh);
+        auto rfAcc = rf.get_access<access::mode::read>(cgh);
+        auto fAcc = coarse.f.get_access<access::mode::read_write>(cgh);
 
-        cgh.parallel_for<class apply>(range, [=, h=level.h, dims=v.getDims(), stencil=grid.stencil, gamma=grid.gamma](id<3> index) {
-            
+        cgh.parallel_for<class fasOperatorK>(range, [=, h=coarse.h, layout=coarse.v.getLayout(), stencil=grid.stencil, op=coarse.op, gamma=grid.gamma](id<3> index) {
             double1 stencilsum = 0.0;
-            for (std::size_t i = 0; i < stencil.values.size(); i++) {
-                const int1 flatIdx = Sycl3dAccesor::flatIndex(dims, index[0] + (stencil.getXOffset(i) + 1), index[1] + (stencil.getYOffset(i) + 1), index[2] + (stencil.getZOffset(i) + 1));
-                auto vVal = vAcc[flatIdx];
-                stencilsum += stencil.values[i] * vVal;
+            if (useGalerkin) {
+                for (std::size_t i = 0; i < op.values.size(); i++) {
+                    if (op.values[i] != 0.0) {
+                        const int1 flatIdx = Sycl3dAccesor::flatIndex(layout, index[0] + (Stencil27::getXOffset(i) + 1), index[1] + (Stencil27::getYOffset(i) + 1), index[2] + (Stencil27::getZOffset(i) + 1));
+                        auto restVal = restvAcc[flatIdx];
+                        stencilsum += op.values[i] * restVal;
+                    }
+                }
+            }else {
+                for (std::size_t i = 0; i < stencil.values.size(); i++) {
+                    const int1 flatIdx = Sycl3dAccesor::flatIndex(layout, index[0] + (stencil.getXOffset(i) + 1), index[1] + (stencil.getYOffset(i) + 1), index[2] + (stencil.getZOffset(i) + 1));
+                    auto restVal = restvAcc[flatIdx];
+                    stencilsum += stencil.values[i] * restVal;
+                }
+                stencilsum /= h * h;
             }
-            stencilsum /= h * h;
-
-            int1 centerIdx = Sycl3dAccesor::shift1Index(dims, index);
 
-            // See tutorial_multigrid.pdf, page 102, Formula 6.13
-            double1 vVal = vAcc[centerIdx];
-            double1 ex = cl::sycl::exp(vVal);
-            double1 nonLinear = gamma * vVal * ex;
-            stencilsum += nonLinear;
+            int1 centerIdx = Sycl3dAccesor::shift1Index(layout, index);
+            double1 restV = restvAcc[centerIdx];
+            stencilsum += Nonlinearity::value(gamma, restV);
 
-            resultAcc[centerIdx] = stencilsum;
+            double1 fVal = fAcc[centerIdx] + stencilsum;
+            if (tauExtrapolation) {
+                // f^2h = R f^h + tau, extrapolate to R f^h + 4/3 tau for a second order discretization
+                fVal = (4.0 / 3.0) * fVal - (1.0 / 3.0) * rfAcc[centerIdx];
+            }
+            fAcc[centerIdx] = fVal;
         });
     });
 }
@@ -288,32 +619,8 @@ double SyclSolver::sumBuffer(queue& queue, SyclBuffer& buffer)
     Timer::push("sumBuffer");
 
     std::size_t flatSize = buffer.flatSize();
-
-    std::size_t num_work_items = 1;
     bool skipFirst; // If the flat size is odd, we skip the first value in the buffer during the sum reduction, and copy it later into the accumulation buffer
-    if (flatSize % 2 != 0) {
-        assert(buffer.flatSize() % 2 != 0); // flat size is odd
-        // Ignore the first element, so we get an even number of items in the buffer
-        flatSize--;
-
-        while (true) {
-            std::size_t next = num_work_items * 2;
-            if (flatSize % next != 0) {
-                break;
-            }
-            if (next > 512) {
-                break;
-            }
-            num_work_items = next;
-        }
-
-        skipFirst = true;
-    }
-    else {
-        // Not all dimensions are odd
-        assert(false); // TODO: Implement and set num_work_items
-        skipFirst = false;
-    }
+    const std::size_t num_work_items = reductionWorkItems(flatSize, skipFirst);
 
 
     cl::sycl::buffer<double> accumBuf(num_work_items);
@@ -348,7 +655,8 @@ double SyclSolver::sumBuffer(queue& queue, SyclBuffer& buffer)
     if (skipFirst) {
         queue.submit([&](handler& cgh) {
             auto accumAcc = accumBuf.get_access<access::mode::read_write>(cgh);
-            auto accR = buffer.get_access<access::mode::read>(cgh);
+            // only the first value is needed, not the whole grid
+            auto accR = buffer.get_access<access::mode::read>(cgh, SyclBuffer::Region::point(0, 0, 0));
 
             cgh.single_task<class first>([=]() {
                 double1 val = accR[0];
@@ -374,15 +682,90 @@ double SyclSolver::sumBuffer(queue& queue, SyclBuffer& buffer)
     return ::sqrt(sum);
 }
 
-void SyclSolver::restrict(queue& queue, SyclBuffer& fine, SyclBuffer& coarse)
+double SyclSolver::dotBuffer(queue& queue, SyclBuffer& a, SyclBuffer& b)
+{
+    // Same reduction as in sumBuffer, without the final square root
+    Timer::push("dotBuffer");
+    assert(a.flatSize() == b.flatSize());
+
+    std::size_t flatSize = a.flatSize();
+    bool skipFirst;
+    const std::size_t num_work_items = reductionWorkItems(flatSize, skipFirst);
+
+    cl::sycl::buffer<double> accumBuf(num_work_items);
+
+    queue.submit([&](handler& cgh) {
+        auto accumAcc = accumBuf.get_access<access::mode::discard_write>(cgh);
+        auto accA = a.get_access<access::mode::read>(cgh);
+        auto accB = b.get_access<access::mode::read>(cgh);
+
+        cgh.parallel_for<class dotK>(range<1>(num_work_items), [=](id<1> index) {
+            double1 sum = 0;
+            SYCL_FOR(int1 i = index[0], i < flatSize, i) {
+                if (skipFirst) {
+                    double1 val = accA[i + 1] * accB[i + 1];
+                    sum += val;
+                }
+                else {
+                    double1 val = accA[i] * accB[i];
+                    sum += val;
+                }
+
+                i += num_work_items;
+            }
+            SYCL_END;
+
+            accumAcc[index[0]] = sum;
+        });
+    });
+
+    if (skipFirst) {
+        queue.submit([&](handler& cgh) {
+            auto accumAcc = accumBuf.get_access<access::mode::read_write>(cgh);
+            auto accA = a.get_access<access::mode::read>(cgh, SyclBuffer::Region::point(0, 0, 0));
+            auto accB = b.get_access<access::mode::read>(cgh, SyclBuffer::Region::point(0, 0, 0));
+
+            cgh.single_task<class dotFirst>([=]() {
+                double1 val = accA[0] * accB[0];
+                accumAcc[0] += val;
+            });
+        });
+    }
+
+#ifdef SYCL_GTX
+    auto accumAcc = accumBuf.get_access<access::mode::read, access::target::host_buffer>();
+#else
+    sycl::host_accessor accumAcc{ accumBuf, sycl::read_only };
+#endif
+
+    double sum = 0;
+    for (std::size_t i = 0; i < num_work_items; i++) {
+        sum += accumAcc[i];
+    }
+
+    Timer::pop("dotBuffer");
+    return sum;
+}
+
+void SyclSolver::restrict(queue& queue, SyclBuffer& fine, SyclBuffer& coarse, bool images)
+{
+    if (images) {
+        restrictKernel<imageTarget>(queue, fine, coarse);
+    }else {
+        restrictKernel<access::target::global_buffer>(queue, fine, coarse);
+    }
+}
+
+template<access::target readTarget>
+void SyclSolver::restrictKernel(queue& queue, SyclBuffer& fine, SyclBuffer& coarse)
 {
     queue.submit([&](handler& cgh) {
-        auto fineAcc = fine.get_access<access::mode::read>(cgh);
+        auto fineAcc = fine.get_access<access::mode::read, readTarget>(cgh);
         auto coraseAcc = coarse.get_access<access::mode::write>(cgh);
 
         range<3> range(coarse.getXdim() - 2, coarse.getYdim() - 2, coarse.getZdim() - 2);
 
-        cgh.parallel_for<class rest>(range, [=, fineDims = fine.getDims(), coarseDims = coarse.getDims()](id<3> index) {
+        cgh.parallel_for<class rest>(range, [=, fineLayout = fine.getLayout(), coarseLayout = coarse.getLayout()](id<3> index) {
             int1 xCenter = 2 * (index[0] + 1);
             int1 yCenter = 2 * (index[1] + 1);
             int1 zCenter = 2 * (index[2] + 1);
@@ -393,46 +776,69 @@ void SyclSolver::restrict(queue& queue, SyclBuffer& fine, SyclBuffer& coarse)
                 for (int jj = -2 + 1; jj < 2; jj++) {
                     for (int kk = -2 + 1; kk < 2; kk++) {
                         double fac = 0.125 * ((2.0 - abs(ii)) / 2.0) * ((2.0 - abs(jj)) / 2.0) * ((2.0 - abs(kk)) / 2.0);
-                        double1 fineVal = fineAcc[Sycl3dAccesor::flatIndex(fineDims, xCenter + ii, yCenter + jj, zCenter + kk)];
+                        double1 fineVal = fineAcc[Sycl3dAccesor::flatIndex(fineLayout, xCenter + ii, yCenter + jj, zCenter + kk)];
                         coarseValue += fac * fineVal;
                     }
                 }
             }
 
-            int1 centerIdxCoarse = Sycl3dAccesor::shift1Index(coarseDims, index);
+            int1 centerIdxCoarse = Sycl3dAccesor::shift1Index(coarseLayout, index);
             coraseAcc[centerIdxCoarse] = coarseValue;
         });
     });
 
 }
 
-void SyclSolver::interpolate(queue& queue, SyclBuffer& fine, SyclBuffer& coarse)
+void SyclSolver::copyBuffer(queue& queue, SyclBuffer& src, SyclBuffer& dst)
 {
-    // prepare
+    assert(src.flatSize() == dst.flatSize());
+
     queue.submit([&](handler& cgh) {
-        auto coarseAcc = coarse.get_access<access::mode::read>(cgh);
+        auto srcAcc = src.get_access<access::mode::read>(cgh);
+        auto dstAcc = dst.get_access<access::mode::discard_write>(cgh);
+        cgh.parallel_for<class copyK>(range<1>(dst.flatSize()), [srcAcc, dstAcc](id<1> index) {
+            dstAcc[index] = srcAcc[index];
+        });
+    });
+}
+
+template<access::target readTarget>
+void SyclSolver::injectCoarse(queue& queue, SyclBuffer& fine, SyclBuffer& coarse)
+{
+    queue.submit([&](handler& cgh) {
+        auto coarseAcc = coarse.get_access<access::mode::read, readTarget>(cgh);
         auto fineAcc = fine.get_access<access::mode::write>(cgh);
 
         range<3> rangePrep(fine.getXdim() / 2, fine.getYdim() / 2, fine.getZdim() / 2);
-        cgh.parallel_for<class prep>(rangePrep, [=, fineDims=fine.getDims(), coarseDims=coarse.getDims()](id<3> index) {
+        cgh.parallel_for<class prep>(rangePrep, [=, fineLayout=fine.getLayout(), coarseLayout=coarse.getLayout()](id<3> index) {
             int1 x = index[0] * 2;
             int1 y = index[1] * 2;
             int1 z = index[2] * 2;
-            fineAcc[Sycl3dAccesor::flatIndex(fineDims, x, y, z)] = coarseAcc[Sycl3dAccesor::flatIndex(coarseDims, index)];
+            fineAcc[Sycl3dAccesor::flatIndex(fineLayout, x, y, z)] = coarseAcc[Sycl3dAccesor::flatIndex(coarseLayout, index)];
         });
     });
+}
+
+void SyclSolver::interpolate(queue& queue, SyclBuffer& fine, SyclBuffer& coarse, bool images)
+{
+    // prepare
+    if (images) {
+        injectCoarse<imageTarget>(queue, fine, coarse);
+    }else {
+        injectCoarse<access::target::global_buffer>(queue, fine, coarse);
+    }
 
     // Interpolate in x-direction
     queue.submit([&](handler& cgh) {
         auto fineAcc = fine.get_access<access::mode::read_write>(cgh);
 
         range<3> rangeX(fine.getXdim() / 2, fine.getYdim() / 2 + 1, fine.getZdim() / 2 + 1);
-        cgh.parallel_for<class InteX>(rangeX, [=, dims=fine.getDims()](id<3> index) {
+        cgh.parallel_for<class InteX>(rangeX, [=, layout=fine.getLayout()](id<3> index) {
             int1 x = index[0] * 2;
             int1 y = index[1] * 2;
             int1 z = index[2] * 2;
-            double1 val = 0.5 * fineAcc[Sycl3dAccesor::flatIndex(dims, x, y, z)] + 0.5 * fineAcc[Sycl3dAccesor::flatIndex(dims, x + 2, y, z)];
-            fineAcc[Sycl3dAccesor::flatIndex(dims, x + 1, y, z)] = val;
+            double1 val = 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z)] + 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x + 2, y, z)];
+            fineAcc[Sycl3dAccesor::flatIndex(layout, x + 1, y, z)] = val;
         });
     });
 
@@ -441,12 +847,12 @@ void SyclSolver::interpolate(queue& queue, SyclBuffer& fine, SyclBuffer& coarse)
         auto fineAcc = fine.get_access<access::mode::read_write>(cgh);
 
         range<3> rangeY(fine.getXdim(), fine.getYdim() / 2, fine.getZdim() / 2 + 1);
-        cgh.parallel_for<class InteY>(rangeY, [=, dims = fine.getDims()](id<3> index) {
+        cgh.parallel_for<class InteY>(rangeY, [=, layout = fine.getLayout()](id<3> index) {
             int1 x = index[0];
             int1 y = index[1] * 2;
             int1 z = index[2] * 2;
-            double1 val = 0.5 * fineAcc[Sycl3dAccesor::flatIndex(dims, x, y, z)] + 0.5 * fineAcc[Sycl3dAccesor::flatIndex(dims, x, y + 2, z)];
-            fineAcc[Sycl3dAccesor::flatIndex(dims, x, y + 1, z)] = val;
+            double1 val = 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z)] + 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y + 2, z)];
+            fineAcc[Sycl3dAccesor::flatIndex(layout, x, y + 1, z)] = val;
         });
     });
 
@@ -455,12 +861,12 @@ void SyclSolver::interpolate(queue& queue, SyclBuffer& fine, SyclBuffer& coarse)
         auto fineAcc = fine.get_access<access::mode::read_write>(cgh);
 
         range<3> rangeZ(fine.getXdim(), fine.getYdim(), fine.getZdim() / 2);
-        cgh.parallel_for<class InteZ>(rangeZ, [=, dims = fine.getDims()](id<3> index) {
+        cgh.parallel_for<class InteZ>(rangeZ, [=, layout = fine.getLayout()](id<3> index) {
             int1 x = index[0];
             int1 y = index[1];
             int1 z = index[2] * 2;
-            double1 val = 0.5 * fineAcc[Sycl3dAccesor::flatIndex(dims, x, y, z)] + 0.5 * fineAcc[Sycl3dAccesor::flatIndex(dims, x, y, z + 2)];
-            fineAcc[Sycl3dAccesor::flatIndex(dims, x, y, z + 1)] = val;
+            double1 val = 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z)] + 0.5 * fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z + 2)];
+            fineAcc[Sycl3dAccesor::flatIndex(layout, x, y, z + 1)] = val;
         });
     });
 }
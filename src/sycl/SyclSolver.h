@@ -1,16 +1,33 @@
 #pragma once
 #include "SyclGridData.h"
+#include "../SolveResult.h"
 
 class SyclSolver {
 public:
-	static void solve(cl::sycl::queue& queue, SyclGridData& grid);
+	static SolveResult solve(cl::sycl::queue& queue, SyclGridData& grid);
 	static double sumBuffer(cl::sycl::queue& queue, SyclBuffer& buffer);
-	static void restrict(cl::sycl::queue& queue, SyclBuffer& fine, SyclBuffer& coarse);
+	static double dotBuffer(cl::sycl::queue& queue, SyclBuffer& a, SyclBuffer& b);
+	// images: the fine values are loaded through an image view (gtx only)
+	static void restrict(cl::sycl::queue& queue, SyclBuffer& fine, SyclBuffer& coarse, bool images = false);
+	static void copyBuffer(cl::sycl::queue& queue, SyclBuffer& src, SyclBuffer& dst);
+	// images: the coarse values are loaded through an image view (gtx only)
+	static void interpolate(cl::sycl::queue& queue, SyclBuffer& fine, SyclBuffer& coarse, bool images = false);
 
 private:
-	static double vcycle(cl::sycl::queue& queue, SyclGridData& grid);
+	static double vcycle(cl::sycl::queue& queue, SyclGridData& grid, SyclBuffer* restrictedF);
+	static void smooth(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum, std::size_t maxiter);
 	static void jacobi(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum, std::size_t maxiter);
+	static void blockJacobi(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum, std::size_t maxiter);
+	static void lineRelax(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum, std::size_t axis, std::size_t color);
 	static void compResidual(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum);
-	static void applyStencil(cl::sycl::queue& queue, SyclGridData& grid, std::size_t level, SyclBuffer& v);
-	static void interpolate(cl::sycl::queue& queue, SyclBuffer& fine, SyclBuffer& coarse);
+
+	// The read-only operands are loaded through the readTarget accessors
+	template<cl::sycl::access::target readTarget>
+	static void residual(cl::sycl::queue& queue, SyclGridData& grid, std::size_t levelNum);
+	template<cl::sycl::access::target readTarget>
+	static void restrictKernel(cl::sycl::queue& queue, SyclBuffer& fine, SyclBuffer& coarse);
+	// Copies the coarse values to the fine points they coincide with
+	template<cl::sycl::access::target readTarget>
+	static void injectCoarse(cl::sycl::queue& queue, SyclBuffer& fine, SyclBuffer& coarse);
+	static void fasTransfer(cl::sycl::queue& queue, SyclGridData& grid, std::size_t level, SyclBuffer* restrictedF);
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 
 #ifndef SYCL_IF
 #define SYCL_IF if
@@ -20,7 +21,18 @@
 #ifdef SYCL_GTX
 using cl::sycl::int1;
 using cl::sycl::double1;
+using KernelVariant = cl::sycl::kernel_archive::variant;
+// Read-only loads through an image view of the buffer
+constexpr cl::sycl::access::target imageTarget = cl::sycl::access::target::image;
 #else
 #define int1 int
 #define double1 double
+
+// Kernels are compiled ahead of time anyway
+struct KernelVariant {
+    explicit KernelVariant(const std::string&) {}
+};
+
+// Images need the image classes of SYCL 2020, the loads stay global
+constexpr sycl::access::target imageTarget = sycl::access::target::global_buffer;
 #endif